@@ -1,13 +1,30 @@
 #include "aether_dsp.hpp"
 
+#include "autotune.hpp"
+#include "bit_ops.hpp"
 #include "constants.hpp"
+#include "kernels.hpp"
+#include "late_lanes.hpp"
 #include "parameters.hpp"
+#include "rt_sanitizer.hpp"
+#include "state.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "triple_buffer.hpp"
 #include "utils.hpp"
 #include "math.hpp"
 
 #include <cmath>
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <utility>
 
 namespace Aether
@@ -19,61 +36,223 @@ inline float dBtoGain(float db) noexcept
 {
   return std::pow(10.f, db / 20.f);
 }
+
+// keeps the cutoff of the late filters below the Nyquist
+// frequency when the late reverberations run at a reduced rate
+inline float late_cutoff(float cutoff, float rate, float late_rate) noexcept
+{
+  return late_rate < rate ? std::min(cutoff, 0.45f * late_rate) : cutoff;
 }
 
-DSP::DSP(float rate)
-    : m_l_predelay(rate)
-    , m_r_predelay(rate)
-    , m_l_early_filters(rate)
-    , m_r_early_filters(rate)
-    , m_l_early_multitap(rate)
-    , m_r_early_multitap(rate)
-    , m_l_early_diffuser(rate, rng)
-    , m_r_early_diffuser(rate, rng)
-    , m_l_late_rev(rate, rng)
-    , m_r_late_rev(rate, rng)
-    , m_rate{rate}
+// the derived state regenerated after a seed or line count change
+constexpr uint32_t regenerated
+    = bit(Derived::tap_seed) | bit(Derived::early_diffusion_seed)
+    | bit(Derived::late_lines) | bit(Derived::late_seed)
+    | bit(Derived::late_diffusion_seed);
+}
+
+DSP::DerivedState::DerivedState(float rate, float late_rate, uint32_t channel_count)
 {
-  for(size_t i = 0; i != param_targets.size(); ++i)
-    param_targets[i] = params[i] = parameter_infos[i + 6].dflt;
+  channels.reserve(channel_count);
+  for(uint32_t channel = 0; channel < channel_count; ++channel)
+    channels.emplace_back(rate, late_rate);
+}
 
-  for(bool& modified : params_modified)
-    modified = true;
+DSP::DerivedState::DerivedState(
+    float rate, float late_rate, uint32_t channel_count,
+    const Parameters<float>& values)
+    : DerivedState(rate, late_rate, channel_count)
+{
+  params = values;
+  for(uint32_t d = 0; d < static_cast<uint32_t>(Derived::count); ++d)
+    update_derived(static_cast<Derived>(d), params, rate, late_rate, channels);
+}
+
+/*
+    The results are the derived state the audio thread processes with:
+    it reads the slot it has acquired last until it acquires the next one,
+    so taking over new results only exchanges a pointer. The worker
+    updates the back slot incrementally from the parameters that slot has
+    been computed from, which may be several requests behind, and
+    publishes it after every request.
+
+    The audio thread hands over the parameters at the end of a block and
+    takes the latest results at the start of one, both with a single
+    atomic exchange, without waiting and without system calls. It never
+    wakes the worker, which polls for new parameters in a timed wait,
+    sleeping longer the longer it stays idle, up to about a block. Only
+    the destructor ends the wait early.
+*/
+class DSP::Worker
+{
+public:
+  Worker(
+      float rate, float late_rate, uint32_t channels, const Parameters<float>& params)
+      : m_rate{rate}
+      , m_late_rate{late_rate}
+      , m_results{rate, late_rate, channels, params}
+      , m_published{params}
+      , m_posted{params}
+  {
+    m_thread = std::thread([this] { run(); });
+  }
 
-  param_smooth.mix = 50.f;
+  Worker(const Worker&) = delete;
+  Worker& operator=(const Worker&) = delete;
 
-  param_smooth.dry_level = 50.f;
-  param_smooth.predelay_level = 50.f;
-  param_smooth.early_level = 50.f;
-  param_smooth.late_level = 50.f;
+  ~Worker()
+  {
+    {
+      std::lock_guard lock(m_mutex);
+      m_running = false;
+    }
+    m_stopped.notify_one();
+    m_thread.join();
+  }
 
-  param_smooth.width = 50.f;
-  param_smooth.predelay = 5000.f;
+  // Audio thread
 
-  param_smooth.early_tap_mix = 50.f;
-  param_smooth.early_tap_decay = 25.f;
-  param_smooth.early_tap_length = 4000.f;
+  // hands 'params' over if any derived state depends on a changed parameter
+  void post(const Parameters<float>& params) noexcept
+  {
+    bool changed = false;
+    for(size_t p = 0; p < params.size(); ++p)
+      changed |= parameter_infos[p].affects != 0 && params[p] != m_posted[p];
+    if(changed)
+      send(params);
+  }
+
+  // after the derived state has been recomputed from 'params' synchronously
+  void reset(const Parameters<float>& params) noexcept { send(params); }
 
-  param_smooth.early_diffusion_delay = 5000.f;
-  param_smooth.early_diffusion_mod_depth = 1000.f;
-  param_smooth.early_diffusion_feedback = 500.f;
+  /*
+      Returns the latest results, or null if there are none since the last
+      call. They stay valid and unchanged until the next call.
+  */
+  const DerivedState* acquire() noexcept { return m_results.acquire(); }
+
+  // recomputed and regenerated pieces of derived state so far
+  uint64_t updates() const noexcept { return m_updates.load(std::memory_order_relaxed); }
+  uint64_t regenerations() const noexcept
+  {
+    return m_regenerations.load(std::memory_order_relaxed);
+  }
 
-  param_smooth.late_delay = 5000.f;
-  param_smooth.late_delay_mod_depth = 1000.f;
-  param_smooth.late_delay_line_feedback = 50.f;
+private:
+  float m_rate;
+  float m_late_rate;
+
+  TripleBuffer<Parameters<float>> m_requests;
+  TripleBuffer<DerivedState> m_results;
+
+  // worker thread, the parameters of the last results for the counts
+  Parameters<float> m_published;
+
+  // audio thread
+  Parameters<float> m_posted;
+
+  // worker thread and destructor, never the audio thread
+  std::mutex m_mutex;
+  std::condition_variable m_stopped;
+  bool m_running = true;
+  std::thread m_thread;
+
+  std::atomic<uint64_t> m_updates = 0;
+  std::atomic<uint64_t> m_regenerations = 0;
+
+  void send(const Parameters<float>& params) noexcept
+  {
+    m_posted = params;
+    m_requests.back() = params;
+    m_requests.publish();
+  }
+
+  void run()
+  {
+    // the interval doubles while nothing is posted, an idle worker
+    // rarely wakes up and a busy one follows within a fraction of a block
+    static constexpr std::chrono::microseconds min_interval{100};
+    static constexpr std::chrono::microseconds max_interval{2000};
+
+    auto interval = min_interval;
+    std::unique_lock lock(m_mutex);
+    while(m_running)
+    {
+      if(const Parameters<float>* params = m_requests.acquire())
+      {
+        recompute(*params);
+        interval = min_interval;
+        continue;
+      }
+
+      m_stopped.wait_for(lock, interval, [this] { return !m_running; });
+      interval = std::min(2 * interval, max_interval);
+    }
+  }
+
+  // the changes of a set of parameters to the derived state
+  static uint32_t changes(const Parameters<float>& from, const Parameters<float>& to)
+      noexcept
+  {
+    uint32_t changes = 0;
+    for(size_t p = 0; p < to.size(); ++p)
+      changes |= from[p] != to[p] ? parameter_infos[p].affects : 0;
+    return changes;
+  }
+
+  void recompute(const Parameters<float>& params) noexcept
+  {
+    // counted once per request, like the synchronous updates
+    const uint32_t requested = changes(m_published, params);
+    m_published = params;
+    m_updates.fetch_add(bits::popcount(requested), std::memory_order_relaxed);
+    m_regenerations.fetch_add(
+        bits::popcount(requested & regenerated), std::memory_order_relaxed);
+
+    DerivedState& results = m_results.back();
+    uint32_t pending = changes(results.params, params);
+    results.params = params;
+    while(pending)
+    {
+      update_derived(
+          static_cast<Derived>(bits::countr_zero(pending)), params, m_rate,
+          m_late_rate, results.channels);
+      pending &= pending - 1;
+    }
+    m_results.publish();
+  }
+};
 
-  param_smooth.late_diffusion_delay = 5000.f;
-  param_smooth.late_diffusion_mod_depth = 2000.f;
-  param_smooth.late_diffusion_feedback = 500.f;
+DSP::DSP(float rate, uint32_t channels, uint32_t seed)
+    : rng{seed}
+    , m_derived_state{rate, rate, channels}
+    , m_rate{rate}
+{
+  assert(channels >= 1 && channels <= max_channels);
 
-  param_smooth.seed_crossmix = 5000.f;
+  m_channels.reserve(channels);
+  for(uint32_t channel = 0; channel < channels; ++channel)
+    m_channels.emplace_back(rate, rng);
+  if(channels >= late_lanes)
+    m_late_lanes = std::make_unique<LateLanes<late_lanes>>();
 
-  for(float& smooth : param_smooth)
+  for(size_t i = 0; i != param_targets.size(); ++i)
   {
+    param_targets[i] = params[i] = engine_parameter_infos[i].dflt;
+
     constexpr float pi = constants::pi_v<float>;
-    if(smooth != 0.f)
-      smooth = std::exp(-2 * pi / (0.0001f * smooth * rate));
+    const float smooth = parameter_infos[i].smoothing;
+    param_smooth[i]
+        = smooth != 0.f ? std::exp(-2 * pi / (0.0001f * smooth * rate)) : 0.f;
   }
+
+  for(bool& modified : params_modified)
+    modified = true;
+}
+
+DSP::~DSP()
+{
+  set_stats_export(false);
 }
 
 void Object::prepare(halp::setup s)
@@ -82,8 +261,12 @@ void Object::prepare(halp::setup s)
   {
     std::destroy_at(&dsp);
     std::construct_at(&dsp, s.rate);
+    meter.set_sample_rate(static_cast<float>(s.rate));
   }
 
+  dsp.m_meter = &meter;
+  meter.set_channels(dsp.channels());
+
   auto ptr = dsp.param_ports.data();
 
   *ptr++ = &inputs.mix.value;
@@ -135,336 +318,1350 @@ void Object::prepare(halp::setup s)
   *ptr++ = &inputs.late_diffusion_drive.value;
 
   dsp.apply_parameters();
+#if defined(AETHER_BACKGROUND_UPDATES)
+  dsp.set_background_updates(true);
+#endif
+#if defined(AETHER_LATE_DECIMATION)
+  dsp.set_late_decimation(AETHER_LATE_DECIMATION);
+#endif
+#if defined(AETHER_STATS_EXPORT)
+  dsp.set_stats_export(true);
+#endif
+#if defined(AETHER_VELVET_DIFFUSION)
+  dsp.set_early_diffusion(DSP::EarlyDiffusion::velvet);
+#endif
+#if defined(AETHER_AUTOTUNE)
+  Parameters<float> current;
+  for(size_t p = 0; p < current.size(); ++p)
+    current[p] = *dsp.param_ports[p];
+  apply_wisdom(dsp, current, static_cast<uint32_t>(s.frames));
+#endif
 }
 
 void Object::operator()(uint32_t n_samples) noexcept
 {
-    dsp.update_parameter_targets();
-    auto audio_in_left = inputs.audio[0];
-    auto audio_in_right = inputs.audio[1];
-    auto audio_out_left = outputs.audio[0];
-    auto audio_out_right = outputs.audio[1];
-    for(uint32_t sample = 0; sample < n_samples; ++sample)
+  [[maybe_unused]] RealtimeScope realtime;
+  dsp(inputs.audio.samples, outputs.audio.samples, n_samples);
+}
+
+void DSP::operator()(
+    const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept
+{
+  using clock = std::chrono::steady_clock;
+  const auto start = m_stats ? clock::now() : clock::time_point{};
+  TraceSpan block(m_trace, TraceRecorder::Event::block, n_samples);
+  // the outputs may be the inputs
+  const bool silent_input = m_stats && silent(inputs, n_samples);
+
+  // all channels are at the same resampling phase
+  const auto late_samples
+      = static_cast<uint32_t>(m_channels[0].late_resampler.reduced_samples(n_samples));
+
+  const uint32_t variant = prepare_block();
+  {
+    TraceSpan process(m_trace, TraceRecorder::Event::process, variant);
+    (this->*select_kernel(variant))(inputs, outputs, n_samples);
+  }
+  finish_block(n_samples, late_samples);
+
+  if(m_stats)
+  {
+    const auto end = clock::now();
+    const auto time = std::chrono::nanoseconds(end - start).count();
+    const auto now = std::chrono::nanoseconds(end.time_since_epoch()).count();
+    publish_stats(
+        silent_input, outputs, n_samples, static_cast<uint64_t>(time),
+        static_cast<uint64_t>(now));
+  }
+}
+
+DSP::Kernel DSP::select_kernel(uint32_t variant) noexcept
+{
+  static constexpr auto kernels
+      = make_kernel_table<Kernel, 8>([](auto variant) -> Kernel {
+          constexpr uint32_t v = decltype(variant)::value;
+          if constexpr(variant_flag(v, 2))
+            return &DSP::process_chunked<v & 3>;
+          else
+            return &DSP::process<v>;
+        });
+  return kernels[variant];
+}
+
+uint32_t DSP::prepare_block() noexcept
+{
+  TraceSpan prepare(m_trace, TraceRecorder::Event::prepare);
+  update_parameter_targets();
+
+  if(m_worker)
+  {
+    if(const DerivedState* state = m_worker->acquire())
     {
-        dsp.update_parameters();
+      if(m_trace)
+        m_trace->instant(TraceRecorder::Event::derived_pickup);
+      m_derived = state;
+      m_tail_stale = true;
+    }
+  }
+
+  // the switches are not smoothed, their targets hold for the whole block
+  const uint32_t variant = uint32_t{param_targets.early_low_cut_enabled > 0.f}
+                         | uint32_t{param_targets.early_high_cut_enabled > 0.f} << 1
+                         | uint32_t{m_chunked && parameters_settled()} << 2;
+
+  select_stages();
+  begin_block();
+  return variant;
+}
+
+void DSP::finish_block(uint32_t n_samples, uint32_t late_samples) noexcept
+{
+  // the skipped stages keep their modulation in time
+  const bool allpass = m_early_diffusion == EarlyDiffusion::allpass;
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+  {
+    Channel& channel = m_channels[ch];
+    const DerivedChannel& derived = m_derived->channels[ch];
+    if((m_stages & early_stage) && allpass)
+      channel.early_diffuser.end_block(derived.early_diffuser, n_samples);
+    else
+      channel.early_diffuser.skip_modulation(derived.early_diffuser, n_samples);
+
+    if(m_stages & late_stage)
+      channel.late_rev.end_block(derived.late_rev, late_samples);
+    else
+      channel.late_rev.skip_modulation(derived.late_rev, late_samples);
+  }
+
+  if(m_worker)
+    m_worker->post(params);
+}
+
+void DSP::select_stages() noexcept
+{
+  // whether a level may be nonzero during the block
+  auto audible = [&](float Parameters<float>::*level) {
+    return params.*level != 0.f || param_targets.*level != 0.f;
+  };
+  const bool wet = audible(&Parameters<float>::mix);
+  const bool metered = m_meter && m_meter->attached();
+
+  uint32_t stages = 0;
+  if(metered || (wet && audible(&Parameters<float>::late_level)))
+    stages |= late_stage;
+  if((stages & late_stage) || (wet && audible(&Parameters<float>::early_level)))
+    stages |= early_stage;
+  if((stages & early_stage) || (wet && audible(&Parameters<float>::predelay_level)))
+    stages |= predelay_stage;
+
+  const uint32_t stopped = m_stages & ~stages;
+  const uint32_t resumed = stages & ~m_stages;
+  m_stages = stages;
+  if(!stopped && !resumed)
+    return;
+  m_state_resets += bits::popcount(resumed);
+
+  if(m_trace)
+  {
+    m_trace->instant(TraceRecorder::Event::stages, stages);
+    if(resumed)
+      m_trace->instant(TraceRecorder::Event::clear, resumed);
+  }
+
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+  {
+    Channel& channel = m_channels[ch];
+    const DerivedChannel& derived = m_derived->channels[ch];
+
+    // the chunks of a skipped stage are not written
+    if(stopped & predelay_stage)
+      channel.predelay_chunk.fill(0.f);
+    if(stopped & early_stage)
+      channel.early_chunk.fill(0.f);
+    if(stopped & late_stage)
+      channel.late_chunk.fill(0.f);
 
-        // Dry
-        float dry_level = dsp.params.dry_level / 100.f;
-        float dry_left = audio_in_left[sample];
-        float dry_right = audio_in_right[sample];
+    if(resumed & predelay_stage)
+      channel.predelay.clear();
+    if(resumed & early_stage)
+    {
+      channel.early_filters.lowpass.clear();
+      channel.early_filters.highpass.clear();
+      channel.early_multitap.clear();
+      channel.early_diffuser.clear();
+      channel.early_diffuser.settle(derived.early_diffuser);
+      channel.early_velvet.clear();
+    }
+    if(resumed & late_stage)
+    {
+      channel.late_rev.clear();
+      channel.late_rev.settle(derived.late_rev);
+      channel.late_resampler.clear();
+    }
+  }
+}
+
+void DSP::begin_block() noexcept
+{
+  // with background updates the derived state only changes between blocks
+  const Parameters<float>& derived = m_worker ? m_derived->params : param_targets;
+
+  // whether a smoothed parameter may be nonzero during the block
+  auto nonzero = [&](float Parameters<float>::*parameter) {
+    if(m_worker)
+      return derived.*parameter != 0.f;
+    return params.*parameter != 0.f || param_targets.*parameter != 0.f;
+  };
+
+  AllpassDiffuser<float>::PushInfo early_info = {};
+  early_info.stages = static_cast<uint32_t>(derived.early_diffusion_stages);
+  early_info.interpolate = true;
+  early_info.modulated = nonzero(&Parameters<float>::early_diffusion_mod_depth);
+  early_info.drive = derived.early_diffusion_drive != -12;
+
+  Delayline::Diffuser::PushInfo diffuser_info = {};
+  diffuser_info.stages = static_cast<uint32_t>(derived.late_diffusion_stages);
+  diffuser_info.interpolate = param_targets.interpolate > 0;
+  diffuser_info.modulated = nonzero(&Parameters<float>::late_diffusion_mod_depth);
+  diffuser_info.drive = derived.late_diffusion_drive != -12;
+
+  Delayline::Filters::PushInfo damping_info = {};
+  damping_info.ls_enable = param_targets.late_low_shelf_enabled > 0;
+  damping_info.hs_enable = param_targets.late_high_shelf_enabled > 0;
+  damping_info.hc_enable = param_targets.late_high_cut_enabled > 0;
+
+  Delayline::PushInfo late_info = {};
+  late_info.order = static_cast<Delayline::Order>(param_targets.late_order);
+  late_info.modulated = nonzero(&Parameters<float>::late_delay_mod_depth);
+  late_info.diffuser_info = diffuser_info;
+  late_info.damping_info = damping_info;
+
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+  {
+    Channel& channel = m_channels[ch];
+    channel.early_diffuser.begin_block(early_info);
+    channel.late_rev.begin_block(m_derived->channels[ch].late_rev, late_info);
+  }
+}
+
+template <uint32_t Variant>
+void DSP::process(
+    const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept
+{
+  constexpr bool low_cut = variant_flag(Variant, 0);
+  constexpr bool high_cut = variant_flag(Variant, 1);
+
+  const uint32_t channels = this->channels();
+
+  const bool metering = begin_metering();
+
+  // the skipped stages stay silent
+  Meter::StageValues stages = {};
+  auto& [dry, predelay, early, late] = stages;
+  Frame out;
+
+  for(uint32_t sample = 0; sample < n_samples; ++sample)
+  {
+    update_parameters();
+
+    // Dry
+    float dry_level = params.dry_level / 100.f;
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      dry[ch] = inputs[ch][sample];
+      out[ch] = dry_level * dry[ch];
+    }
+
+    // Predelay
+    float predelay_level = params.predelay_level / 100.f;
+    if(m_stages & predelay_stage)
+    {
+      // narrow every channel towards the sum of all channels,
+      // for two channels this is the same as crossfading left and right
+      float width = 0.5f - params.width / 200.f;
+      float sum = 0.f;
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        sum += dry[ch];
+      float scale = 2.f / static_cast<float>(channels);
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        predelay[ch] = dry[ch] + width * (scale * sum - 2.f * dry[ch]);
+
+      // predelay in samples
+      uint32_t delay = static_cast<uint32_t>(params.predelay / 1000.f * m_rate);
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        predelay[ch] = m_channels[ch].predelay.push(predelay[ch], delay);
+
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        out[ch] += predelay_level * predelay[ch];
+    }
+
+    // Early Reflections
+    float early_level = params.early_level / 100.f;
+    if(m_stages & early_stage)
+    {
+      early = predelay;
+
+      // Filtering
+      if constexpr(low_cut)
+      {
+        for(uint32_t ch = 0; ch < channels; ++ch)
         {
-            audio_out_left[sample] = dry_level * dry_left;
-            audio_out_right[sample] = dry_level * dry_right;
+          early[ch] = m_channels[ch].early_filters.highpass.push(
+              m_derived->channels[ch].early_filters.highpass, early[ch]);
         }
+      }
 
-        // Predelay
-        float predelay_level = dsp.params.predelay_level / 100.f;
-        float predelay_left = dry_left;
-        float predelay_right = dry_right;
+      if constexpr(high_cut)
+      {
+        for(uint32_t ch = 0; ch < channels; ++ch)
         {
-            float width = 0.5f - dsp.params.width / 200.f;
-            predelay_left = dry_left + width * (dry_right - dry_left);
-            predelay_right = dry_right - width * (dry_right - dry_left);
-
-            // predelay in samples
-            uint32_t delay = static_cast<uint32_t>(dsp.params.predelay / 1000.f * dsp.m_rate);
-            predelay_left = dsp.m_l_predelay.push(predelay_left, delay);
-            predelay_right = dsp.m_r_predelay.push(predelay_right, delay);
-
-            audio_out_left[sample] += predelay_level * predelay_left;
-            audio_out_right[sample] += predelay_level * predelay_right;
+          early[ch] = m_channels[ch].early_filters.lowpass.push(
+              m_derived->channels[ch].early_filters.lowpass, early[ch]);
         }
+      }
 
-        // Early Reflections
-        float early_level = dsp.params.early_level / 100.f;
-        float early_left = predelay_left;
-        float early_right = predelay_right;
+      { // multitap delay
+        uint32_t taps = static_cast<uint32_t>(params.early_taps);
+        float length = params.early_tap_length / 1000.f * m_rate;
+        float tap_mix = params.early_tap_mix / 100.f;
+
+        for(uint32_t ch = 0; ch < channels; ++ch)
         {
-            // Filtering
-            if(dsp.params.early_low_cut_enabled > 0.f)
-            {
-                early_left = dsp.m_l_early_filters.highpass.push(early_left);
-                early_right = dsp.m_r_early_filters.highpass.push(early_right);
-            }
-
-            if(dsp.params.early_high_cut_enabled > 0.f)
-            {
-                early_left = dsp.m_l_early_filters.lowpass.push(early_left);
-                early_right = dsp.m_r_early_filters.lowpass.push(early_right);
-            }
-
-            { // multitap delay
-                uint32_t taps = static_cast<uint32_t>(dsp.params.early_taps);
-                float length = dsp.params.early_tap_length / 1000.f * dsp.m_rate;
-
-                float multitap_left = dsp.m_l_early_multitap.push(early_left, taps, length);
-                float multitap_right = dsp.m_r_early_multitap.push(early_right, taps, length);
-
-                float tap_mix = dsp.params.early_tap_mix / 100.f;
-                early_left += tap_mix * (multitap_left - early_left);
-                early_right += tap_mix * (multitap_right - early_right);
+          float multitap = m_channels[ch].early_multitap.push(
+              m_derived->channels[ch].early_multitap, early[ch], taps, length);
+          early[ch] += tap_mix * (multitap - early[ch]);
+        }
       }
 
+      if(m_early_diffusion == EarlyDiffusion::velvet)
+      {
+        for(uint32_t ch = 0; ch < channels; ++ch)
+          early[ch] = m_channels[ch].early_velvet.push(
+              m_derived->channels[ch].early_velvet, early[ch]);
+      }
+      else
       { // allpass diffuser
-        AllpassDiffuser<float>::PushInfo info = {};
-        info.stages = static_cast<uint32_t>(dsp.params.early_diffusion_stages);
-        info.feedback = dsp.params.early_diffusion_feedback;
-        info.interpolate = true;
-
-        early_left = dsp.m_l_early_diffuser.push(early_left, info);
-        early_right = dsp.m_r_early_diffuser.push(early_right, info);
+        float feedback = params.early_diffusion_feedback;
+        for(uint32_t ch = 0; ch < channels; ++ch)
+        {
+          early[ch] = m_channels[ch].early_diffuser.push(
+              m_derived->channels[ch].early_diffuser, early[ch], feedback);
+        }
       }
 
-      audio_out_left[sample] += early_level * early_left;
-      audio_out_right[sample] += early_level * early_right;
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        out[ch] += early_level * early[ch];
     }
 
     // Late Reverberations
-    float late_level = dsp.params.late_level / 100.f;
-    float late_left = early_left;
-    float late_right = early_right;
+    float late_level = params.late_level / 100.f;
+    if(m_stages & late_stage)
     {
-      AllpassDiffuser<double>::PushInfo diffuser_info = {};
-      diffuser_info.stages = static_cast<uint32_t>(dsp.params.late_diffusion_stages);
-      diffuser_info.feedback = dsp.params.late_diffusion_feedback;
-      diffuser_info.interpolate = dsp.params.interpolate > 0;
+      float feedback = params.late_diffusion_feedback;
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        late[ch] = m_channels[ch].push_late(
+            m_derived->channels[ch].late_rev, early[ch], feedback);
 
-      Delayline::Filters::PushInfo damping_info = {};
-      damping_info.ls_enable = dsp.params.late_low_shelf_enabled > 0;
-      damping_info.hs_enable = dsp.params.late_high_shelf_enabled > 0;
-      damping_info.hc_enable = dsp.params.late_high_cut_enabled > 0;
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        out[ch] += late_level * late[ch];
+    }
+
+    {
+      float mix = params.mix / 100.f;
+      for(uint32_t ch = 0; ch < channels; ++ch)
+        outputs[ch][sample] = out[ch] = math::lerp(dry[ch], out[ch], mix);
+    }
 
-      Delayline::PushInfo push_info = {};
-      push_info.order = static_cast<Delayline::Order>(dsp.params.late_order);
-      push_info.diffuser_info = diffuser_info;
-      push_info.damping_info = damping_info;
+    if(metering)
+      m_meter->push(stages, out);
+  }
+}
 
-      late_left = dsp.m_l_late_rev.push(late_left, push_info);
-      late_right = dsp.m_r_late_rev.push(late_right, push_info);
-      audio_out_left[sample] += late_level * late_left;
-      audio_out_right[sample] += late_level * late_right;
+template <uint32_t Variant>
+void DSP::process_chunked(
+    const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept
+{
+  const bool metering = begin_metering();
+  const float late_feedback = params.late_diffusion_feedback;
+
+  for(uint32_t start = 0; start < n_samples; start += chunk_size)
+  {
+    const uint32_t n = std::min(chunk_size, n_samples - start);
+
+    {
+      TraceSpan early(m_trace, TraceRecorder::Event::early);
+      process_early_chunk<Variant>(inputs, start, n);
     }
 
+    if(m_stages & late_stage)
     {
-      float mix = dsp.params.mix / 100.f;
-      audio_out_left[sample] = math::lerp(dry_left, audio_out_left[sample], mix);
-      audio_out_right[sample] = math::lerp(dry_right, audio_out_right[sample], mix);
+      TraceSpan late(m_trace, TraceRecorder::Event::late);
+      process_late_chunk(n, late_feedback);
     }
+
+    TraceSpan mix(m_trace, TraceRecorder::Event::mix);
+    mix_chunk(outputs, start, n, metering);
   }
 }
 
-void DSP::update_parameter_targets() noexcept
+void DSP::process_late_chunk(uint32_t n, float feedback) noexcept
 {
-  for(size_t p = 0; p < param_targets.size(); ++p)
+  using Lanes = LateLanes<late_lanes>;
+  const uint32_t channels = this->channels();
+  uint32_t first = 0;
+
+  // the resamplers of the channels are in step, so all of them have the
+  // same reduced samples
+  while(m_late_lanes && channels - first >= 2)
   {
-    param_targets[p] = std::clamp(
-        param_ports[p] ? *param_ports[p] : parameter_infos[p + 6].dflt,
-        parameter_infos[p + 6].min, parameter_infos[p + 6].max);
+    const uint32_t count = std::min(late_lanes, channels - first);
+    Lanes::Lane<LateRev*> late = {};
+    Lanes::Lane<const LateRev::Derived*> derived = {};
+    Lanes::Lane<const float*> input = {};
+    Lanes::Lane<float*> output = {};
+    Lanes::Lane<float> feedbacks = {};
+    Lanes::Lane<std::array<float, chunk_size>> reduced;
+    Lanes::Lane<std::array<bool, chunk_size>> ready;
+    const bool resampled = m_channels[first].late_resampler.factor() != 1;
+    uint32_t samples = n;
+    for(uint32_t k = 0; k < count; ++k)
+    {
+      Channel& channel = m_channels[first + k];
+      assert(Lanes::compatible(channel.late_rev, m_channels[first].late_rev));
+      late[k] = &channel.late_rev;
+      derived[k] = &m_derived->channels[first + k].late_rev;
+      input[k] = channel.early_chunk.data();
+      output[k] = channel.late_chunk.data();
+      feedbacks[k] = feedback;
+      if(resampled)
+      {
+        samples = channel.decimate_late(
+            input[k], n, reduced[k].data(), ready[k].data());
+        input[k] = output[k] = reduced[k].data();
+      }
+    }
+
+    if(samples > 0)
+      m_late_lanes->process(late, derived, count, input, output, samples, feedbacks);
+
+    for(uint32_t k = 0; resampled && k < count; ++k)
+    {
+      Channel& channel = m_channels[first + k];
+      channel.interpolate_late(
+          reduced[k].data(), ready[k].data(), channel.late_chunk.data(), n);
+    }
+    first += count;
+  }
+
+  for(uint32_t ch = first; ch < channels; ++ch)
+  {
+    Channel& channel = m_channels[ch];
+    channel.process_late(
+        m_derived->channels[ch].late_rev, channel.early_chunk.data(),
+        channel.late_chunk.data(), n, feedback);
   }
 }
 
-void DSP::update_parameters() noexcept
+bool DSP::begin_metering() noexcept
 {
-  for(size_t p = 0; p < param_ports.size(); ++p)
+  const bool metering = m_meter && m_meter->begin_block();
+  if(metering)
   {
-    const float new_value
-        = param_targets[p] - param_smooth[p] * (param_targets[p] - params[p]);
-    params_modified[p] = (new_value != params[p]);
-    params[p] = new_value;
+    for(uint32_t ch = 0; ch < m_meter->channels(); ++ch)
+      m_meter->set_late_gain(ch, m_channels[ch].late_rev.gain());
   }
-
-  apply_parameters();
+  return metering;
 }
 
-void DSP::apply_parameters() noexcept
+template <uint32_t Variant>
+void DSP::process_early_chunk(
+    const float* const* inputs, uint32_t start, uint32_t n) noexcept
 {
-  // Early Reflections
+  constexpr bool low_cut = variant_flag(Variant, 0);
+  constexpr bool high_cut = variant_flag(Variant, 1);
+
+  const uint32_t channels = this->channels();
+
+  // the parameters hold for the whole block
+  const float width = 0.5f - params.width / 200.f;
+  const float scale = 2.f / static_cast<float>(channels);
+  const uint32_t delay = static_cast<uint32_t>(params.predelay / 1000.f * m_rate);
+
+  const uint32_t taps = static_cast<uint32_t>(params.early_taps);
+  const float length = params.early_tap_length / 1000.f * m_rate;
+  const float tap_mix = params.early_tap_mix / 100.f;
 
-  // Filters
-  if(params_modified.early_low_cut_cutoff)
+  const float early_feedback = params.early_diffusion_feedback;
+
+  // the chunks of the skipped stages hold zeros, see select_stages
+  if(!(m_stages & predelay_stage))
   {
-    float cutoff = params.early_low_cut_cutoff;
-    m_l_early_filters.highpass.set_cutoff(cutoff);
-    m_r_early_filters.highpass.set_cutoff(cutoff);
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      std::copy_n(inputs[ch] + start, n, m_channels[ch].dry_chunk.begin());
+    return;
   }
-  if(params_modified.early_high_cut_cutoff)
+  const bool early = m_stages & early_stage;
+
+  // Predelay, early filtering and multitap delay
+  for(uint32_t i = 0; i < n; ++i)
   {
-    float cutoff = params.early_high_cut_cutoff;
-    m_l_early_filters.lowpass.set_cutoff(cutoff);
-    m_r_early_filters.lowpass.set_cutoff(cutoff);
+    float sum = 0.f;
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      sum += inputs[ch][start + i];
+
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      Channel& channel = m_channels[ch];
+      const DerivedChannel& derived = m_derived->channels[ch];
+      const float input = inputs[ch][start + i];
+      channel.dry_chunk[i] = input;
+
+      float sample = input + width * (scale * sum - 2.f * input);
+      sample = channel.predelay.push(sample, delay);
+      channel.predelay_chunk[i] = sample;
+      if(!early)
+        continue;
+
+      if constexpr(low_cut)
+        sample = channel.early_filters.highpass.push(derived.early_filters.highpass, sample);
+      if constexpr(high_cut)
+        sample = channel.early_filters.lowpass.push(derived.early_filters.lowpass, sample);
+
+      float multitap
+          = channel.early_multitap.push(derived.early_multitap, sample, taps, length);
+      channel.early_chunk[i] = sample + tap_mix * (multitap - sample);
+    }
   }
 
-  // Multitap Delay
-  if(params_modified.early_tap_decay)
+  // Diffusion
+  if(!early)
+    return;
+  for(uint32_t ch = 0; ch < channels; ++ch)
   {
-    float decay = params.early_tap_decay;
-    m_l_early_multitap.set_decay(decay);
-    m_r_early_multitap.set_decay(decay);
+    Channel& channel = m_channels[ch];
+    const DerivedChannel& derived = m_derived->channels[ch];
+    if(m_early_diffusion == EarlyDiffusion::velvet)
+      channel.early_velvet.process(derived.early_velvet, channel.early_chunk.data(), n);
+    else
+    {
+      channel.early_diffuser.process(
+          derived.early_diffuser, channel.early_chunk.data(), n, early_feedback);
+    }
   }
-  if(params_modified.seed_crossmix)
+}
+
+DSP::EarlyKernel DSP::select_early_kernel(uint32_t variant) noexcept
+{
+  static constexpr auto kernels
+      = make_kernel_table<EarlyKernel, 4>([](auto variant) -> EarlyKernel {
+          return &DSP::process_early_chunk<decltype(variant)::value>;
+        });
+  return kernels[variant & 3];
+}
+
+void DSP::mix_chunk(float* const* outputs, uint32_t start, uint32_t n, bool metering)
+    noexcept
+{
+  const uint32_t channels = this->channels();
+
+  const float dry_level = params.dry_level / 100.f;
+  const float predelay_level = params.predelay_level / 100.f;
+  const float early_level = params.early_level / 100.f;
+  const float late_level = params.late_level / 100.f;
+  const float mix = params.mix / 100.f;
+
+  Meter::StageValues stages;
+  auto& [dry, predelay, early, late] = stages;
+  Frame out;
+
+  for(uint32_t i = 0; i < n; ++i)
   {
-    float crossmix = params.seed_crossmix / 200.f;
-    m_l_early_multitap.set_seed_crossmix(1.f - crossmix);
-    m_r_early_multitap.set_seed_crossmix(0.f + crossmix);
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      const Channel& channel = m_channels[ch];
+      dry[ch] = channel.dry_chunk[i];
+      predelay[ch] = channel.predelay_chunk[i];
+      early[ch] = channel.early_chunk[i];
+      late[ch] = channel.late_chunk[i];
+
+      out[ch] = dry_level * dry[ch];
+      out[ch] += predelay_level * predelay[ch];
+      out[ch] += early_level * early[ch];
+      out[ch] += late_level * late[ch];
+      outputs[ch][start + i] = out[ch] = math::lerp(dry[ch], out[ch], mix);
+    }
+
+    if(metering)
+      m_meter->push(stages, out);
   }
-  if(params_modified.tap_seed)
+}
+
+void DSP::connect_parameters(const Parameters<float>& values) noexcept
+{
+  for(size_t p = 0; p < param_ports.size(); ++p)
+    param_ports[p] = &values[p];
+}
+
+void DSP::settle_parameters() noexcept
+{
+  update_parameter_targets();
+  params = param_targets;
+  for(bool& modified : params_modified)
+    modified = true;
+  apply_parameters();
+  if(m_worker)
+    m_worker->reset(params);
+
+  for(uint32_t ch = 0; ch < channels(); ++ch)
   {
-    uint32_t seed = static_cast<uint32_t>(params.tap_seed);
-    m_l_early_multitap.set_seed(seed);
-    m_r_early_multitap.set_seed(seed);
+    m_channels[ch].early_diffuser.settle(m_derived->channels[ch].early_diffuser);
+    m_channels[ch].late_rev.settle(m_derived->channels[ch].late_rev);
   }
+}
 
-  // Diffuser
-  if(params_modified.early_diffusion_drive)
+void DSP::set_background_updates(bool enabled)
+{
+  if(enabled == (m_worker != nullptr))
+    return;
+
+  if(enabled)
   {
-    float drive = params.early_diffusion_drive == -12
-                      ? 0
-                      : dBtoGain(params.early_diffusion_drive);
-    m_l_early_diffuser.set_drive(drive);
-    m_r_early_diffuser.set_drive(drive);
+    // the worker starts from the current parameters
+    apply_parameters();
+    m_worker = std::make_unique<Worker>(m_rate, late_rate(), channels(), params);
   }
-  if(params_modified.early_diffusion_delay)
+  else
   {
-    float delay = m_rate * params.early_diffusion_delay / 1000.f;
-    m_l_early_diffuser.set_delay(delay);
-    m_r_early_diffuser.set_delay(delay);
+    // catch up with changes the worker has not handed back yet
+    stop_worker();
+    for(bool& modified : params_modified)
+      modified = true;
+    apply_parameters();
   }
-  if(params_modified.early_diffusion_mod_depth)
+}
+
+void DSP::stop_worker() noexcept
+{
+  if(!m_worker)
+    return;
+  m_derived_updates += m_worker->updates();
+  m_regenerations += m_worker->regenerations();
+  // the results go away with the worker
+  m_derived = &m_derived_state;
+  m_worker.reset();
+}
+
+void DSP::set_stats_export(bool enabled)
+{
+  if(enabled == (m_stats != nullptr))
+    return;
+
+  if(!enabled)
   {
-    float mod_depth = m_rate * params.early_diffusion_mod_depth / 1000.f;
-    m_l_early_diffuser.set_mod_depth(mod_depth);
-    m_r_early_diffuser.set_mod_depth(mod_depth);
+    StatsExport::instance()->release(m_stats, m_stats_instance);
+    m_stats = nullptr;
+    return;
   }
-  if(params_modified.early_diffusion_mod_rate)
+
+  StatsExport* exporter = StatsExport::instance();
+  m_stats = exporter ? exporter->claim() : nullptr;
+  if(!m_stats)
+    return;
+
+  m_stats_instance = m_stats->instance.load(std::memory_order_relaxed);
+  m_stats->begin_write();
+  m_stats->rate.store(m_rate, std::memory_order_relaxed);
+  m_stats->channels.store(channels(), std::memory_order_relaxed);
+  m_stats->end_write();
+}
+
+bool DSP::silent(const float* const* inputs, uint32_t n) const noexcept
+{
+  bool zero = true;
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+    for(uint32_t i = 0; i < n; ++i)
+      zero &= inputs[ch][i] == 0.f;
+  return zero;
+}
+
+void DSP::publish_stats(
+    bool silent_input, const float* const* outputs, uint32_t n, uint64_t time,
+    uint64_t now) noexcept
+{
+  if(n == 0)
+    return;
+
+  /*
+      Claimed by another instance while this one was idle for too long.
+      Claiming another record scans the segment, so it is left to the
+      next set_stats_export(true), which is not called while processing.
+  */
+  if(m_stats->instance.load(std::memory_order_relaxed) != m_stats_instance)
   {
-    float rate = params.early_diffusion_mod_rate / m_rate;
-    m_l_early_diffuser.set_mod_rate(rate);
-    m_r_early_diffuser.set_mod_rate(rate);
+    m_stats = nullptr;
+    return;
   }
-  if(params_modified.seed_crossmix)
+
+  double energy = 0.;
+  for(uint32_t ch = 0; ch < channels(); ++ch)
   {
-    float crossmix = params.seed_crossmix / 200.f;
-    m_l_early_diffuser.set_seed_crossmix(1.f - crossmix);
-    m_r_early_diffuser.set_seed_crossmix(0.f + crossmix);
+    float sum = 0.f;
+    for(uint32_t i = 0; i < n; ++i)
+      sum += outputs[ch][i] * outputs[ch][i];
+    energy += sum;
   }
-  if(params_modified.early_diffusion_seed)
+  const bool finite = std::isfinite(energy);
+  energy /= static_cast<double>(n) * channels();
+
+  double tail_energy = 0.;
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+    tail_energy += m_channels[ch].late_rev.energy();
+  tail_energy /= channels();
+
+  m_silent_samples = silent_input ? m_silent_samples + n : 0;
+  if(m_silent_samples > 0 && m_tail_stale)
   {
-    uint32_t seed = static_cast<uint32_t>(params.early_diffusion_seed);
-    m_l_early_diffuser.set_seed(seed);
-    m_r_early_diffuser.set_seed(seed);
+    m_tail_samples = tail_length();
+    m_tail_stale = false;
   }
+  const bool asleep = m_silent_samples > 0 && m_silent_samples >= m_tail_samples;
 
-  // Late Reverberations
-
-  // General
-  if(params_modified.seed_crossmix)
+  uint64_t updates = m_derived_updates;
+  uint64_t regenerations = m_regenerations;
+  if(m_worker)
   {
-    float crossmix = params.seed_crossmix / 200.f;
-    m_l_late_rev.set_seed_crossmix(1.f - crossmix);
-    m_r_late_rev.set_seed_crossmix(0.f + crossmix);
+    updates += m_worker->updates();
+    regenerations += m_worker->regenerations();
   }
-  if(params_modified.late_delay_lines)
+
+  // the only writer, so the counters can be read back
+  constexpr auto relaxed = std::memory_order_relaxed;
+  StatsRecord& r = *m_stats;
+  r.begin_write();
+  r.heartbeat.store(now, relaxed);
+  r.blocks.store(r.blocks.load(relaxed) + 1, relaxed);
+  r.samples.store(r.samples.load(relaxed) + n, relaxed);
+  r.last_block_time.store(time, relaxed);
+  r.max_block_time.store(std::max(r.max_block_time.load(relaxed), time), relaxed);
+  r.total_time.store(r.total_time.load(relaxed) + time, relaxed);
+  r.late_delay_lines.store(static_cast<uint32_t>(params.late_delay_lines), relaxed);
+  r.early_diffusion_stages.store(
+      static_cast<uint32_t>(params.early_diffusion_stages), relaxed);
+  r.late_diffusion_stages.store(
+      static_cast<uint32_t>(params.late_diffusion_stages), relaxed);
+  r.asleep.store(asleep, relaxed);
+  r.non_finite_blocks.store(r.non_finite_blocks.load(relaxed) + !finite, relaxed);
+  r.state_resets.store(m_state_resets, relaxed);
+  r.output_energy_db.store(
+      finite ? static_cast<float>(10. * std::log10(energy)) : 0.f, relaxed);
+  r.tail_energy_db.store(
+      std::isfinite(tail_energy) ? static_cast<float>(10. * std::log10(tail_energy))
+                                 : 0.f,
+      relaxed);
+  r.derived_updates.store(updates, relaxed);
+  r.regenerations.store(regenerations, relaxed);
+  r.end_write();
+}
+
+uint64_t DSP::tail_length(float threshold_db) const noexcept
+{
+  const double gain = std::pow(10., static_cast<double>(threshold_db) / 20.);
+  const double ms = static_cast<double>(m_rate) / 1000.;
+
+  Delayline::Filters::PushInfo damping_info = {};
+  damping_info.ls_enable = params.late_low_shelf_enabled > 0;
+  damping_info.hs_enable = params.late_high_shelf_enabled > 0;
+  damping_info.hc_enable = params.late_high_cut_enabled > 0;
+
+  // the stages are in series, so their delays add up while they decay
+  // at the same time, but each stage only counts if it is mixed in
+  double tail = 0.;
+  for(uint32_t ch = 0; ch < channels(); ++ch)
   {
-    uint32_t lines = static_cast<uint32_t>(params.late_delay_lines);
-    m_l_late_rev.set_delay_lines(lines);
-    m_r_late_rev.set_delay_lines(lines);
+    const Channel& channel = m_channels[ch];
+    const DerivedChannel& derived = m_derived->channels[ch];
+    const double predelay = params.predelay * ms;
+    const double taps = predelay + params.early_tap_length * ms;
+
+    // the velvet diffuser does not ring past its last tap
+    const auto& diffuser = derived.early_diffuser;
+    const bool velvet = m_early_diffusion == EarlyDiffusion::velvet;
+    const double diffuser_delay
+        = velvet ? derived.early_velvet.length() : diffuser.delay();
+    const double diffuser_decay
+        = velvet ? 0. : diffuser.decay_time(params.early_diffusion_feedback, gain);
+    const double early = taps + diffuser_delay + diffuser_decay;
+
+    const auto& resampler = channel.late_resampler;
+    const double late_tail
+        = resampler.factor()
+        * derived.late_rev.tail_length(
+            params.late_diffusion_feedback, damping_info, late_rate(), gain);
+    const double late = taps + diffuser_delay + resampler.latency()
+                      + std::max(diffuser_decay, late_tail);
+
+    if(params.predelay_level > 0.f)
+      tail = std::max(tail, predelay);
+    if(params.early_level > 0.f)
+      tail = std::max(tail, early);
+    if(params.late_level > 0.f)
+      tail = std::max(tail, late);
   }
 
-  // Modulated Delay
-  if(params_modified.late_delay)
+  // only the dry signal is left
+  if(params.mix <= 0.f)
+    return 0;
+
+  constexpr auto max = std::numeric_limits<uint64_t>::max();
+  if(!std::isfinite(tail) || tail >= static_cast<double>(max))
+    return max;
+  return static_cast<uint64_t>(std::ceil(tail));
+}
+
+void DSP::set_late_decimation(uint32_t factor)
+{
+  assert(factor == 1 || factor == 2 || factor == 4);
+  const auto stages = static_cast<uint32_t>(bits::countr_zero(factor));
+  if(stages == m_late_stages)
+    return;
+
+  // the worker holds late state computed for the old rate
+  const bool background = m_worker != nullptr;
+  stop_worker();
+
+  m_late_stages = stages;
+  for(auto& channel : m_channels)
   {
-    float delay = m_rate * params.late_delay / 1000.f;
-    m_l_late_rev.set_delay(delay);
-    m_r_late_rev.set_delay(delay);
+    channel.late_rev = LateRev(late_rate(), rng);
+    channel.late_resampler = HalfbandResampler(stages);
   }
-  if(params_modified.late_delay_mod_depth)
+
+  m_derived_state = DerivedState(m_rate, late_rate(), channels());
+  for(bool& modified : params_modified)
+    modified = true;
+  apply_parameters();
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+    m_channels[ch].late_rev.settle(m_derived->channels[ch].late_rev);
+
+  if(background)
+    m_worker = std::make_unique<Worker>(m_rate, late_rate(), channels(), params);
+}
+
+void DSP::set_early_diffusion(EarlyDiffusion diffusion) noexcept
+{
+  if(diffusion == m_early_diffusion)
+    return;
+
+  m_early_diffusion = diffusion;
+  m_tail_stale = true;
+  for(auto& channel : m_channels)
   {
-    float mod_depth = m_rate * params.late_delay_mod_depth / 1000.f;
-    m_l_late_rev.set_delay_mod_depth(mod_depth);
-    m_r_late_rev.set_delay_mod_depth(mod_depth);
+    channel.early_diffuser.clear();
+    channel.early_velvet.clear();
   }
-  if(params_modified.late_delay_mod_rate)
+}
+
+void DSP::skip_modulation(uint64_t samples) noexcept
+{
+  for(uint32_t ch = 0; ch < channels(); ++ch)
   {
-    float mod_rate = params.late_delay_mod_rate / m_rate;
-    m_l_late_rev.set_delay_mod_rate(mod_rate);
-    m_r_late_rev.set_delay_mod_rate(mod_rate);
+    Channel& channel = m_channels[ch];
+    const DerivedChannel& derived = m_derived->channels[ch];
+    channel.early_diffuser.skip_modulation(derived.early_diffuser, samples);
+    channel.late_rev.skip_modulation(
+        derived.late_rev, channel.late_resampler.reduced_samples(samples));
   }
-  if(params_modified.late_delay_line_feedback)
+}
+
+void DSP::clear() noexcept
+{
+  if(m_trace)
+    m_trace->instant(TraceRecorder::Event::clear, all_stages);
+  m_state_resets += bits::popcount(all_stages);
+
+  for(auto& channel : m_channels)
   {
-    float feedback = params.late_delay_line_feedback;
-    m_l_late_rev.set_delay_feedback(feedback);
-    m_r_late_rev.set_delay_feedback(feedback);
+    channel.predelay.clear();
+    channel.early_filters.lowpass.clear();
+    channel.early_filters.highpass.clear();
+    channel.early_multitap.clear();
+    channel.early_diffuser.clear();
+    channel.early_velvet.clear();
+    channel.late_rev.clear();
+    channel.late_resampler.clear();
   }
-  if(params_modified.delay_seed)
+}
+
+void DSP::save_state(std::vector<std::byte>& out) const
+{
+  StateWriter writer(out);
+
+  uint32_t magic = state_magic;
+  uint32_t version = state_version;
+  float rate = m_rate;
+  uint32_t channels = this->channels();
+  uint32_t late_stages = m_late_stages;
+  uint32_t lines = Capacity::lines;
+  uint32_t stages = Capacity::stages;
+  writer(magic, version, rate, channels, late_stages, lines, stages);
+
+  // serialize is shared with restoring and thus not const, saving only
+  // reads the state
+  const_cast<DSP&>(*this).serialize(writer);
+}
+
+bool DSP::restore_state(const std::byte* data, size_t size) noexcept
+{
+  StateReader reader(data, size);
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  float rate = 0.f;
+  uint32_t channels = 0;
+  uint32_t late_stages = 0;
+  uint32_t lines = 0;
+  uint32_t stages = 0;
+  reader(magic, version, rate, channels, late_stages, lines, stages);
+  if(!reader.good() || magic != state_magic || version != state_version
+     || rate != m_rate || channels != this->channels() || late_stages != m_late_stages
+     || lines != Capacity::lines || stages != Capacity::stages)
+    return false;
+
+  serialize(reader);
+  if(reader.good() && reader.at_end())
   {
-    uint32_t seed = static_cast<uint32_t>(params.delay_seed);
-    m_l_late_rev.set_delay_seed(seed);
-    m_r_late_rev.set_delay_seed(seed);
+    // the derived state is recomputed from the restored parameters
+    for(bool& modified : params_modified)
+      modified = true;
+    apply_parameters();
+    if(m_worker)
+      m_worker->reset(params);
+    return true;
   }
 
-  // Diffuser
-  if(params_modified.late_diffusion_drive)
+  // start over from silence instead of a partially restored state
+  clear();
+  settle_parameters();
+  return false;
+}
+
+template <class Archive>
+void DSP::serialize(Archive& ar)
+{
+  // the targets and smoothing coefficients are recomputed from
+  // the ports and the sample rate
+  ar(params);
+  for(size_t p = 0; p < params.size(); ++p)
   {
-    float drive
-        = params.late_diffusion_drive == -12 ? 0 : dBtoGain(params.late_diffusion_drive);
-    m_l_late_rev.set_diffusion_drive(drive);
-    m_r_late_rev.set_diffusion_drive(drive);
+    const auto& info = engine_parameter_infos[p];
+    if(!ar.check(params[p] >= info.min && params[p] <= info.max))
+      params[p] = info.dflt;
   }
-  if(params_modified.late_diffusion_delay)
+  for(auto& channel : m_channels)
   {
-    float delay = m_rate * params.late_diffusion_delay / 1000.f;
-    m_l_late_rev.set_diffusion_delay(delay);
-    m_r_late_rev.set_diffusion_delay(delay);
+    ar(channel.predelay, channel.early_filters.lowpass, channel.early_filters.highpass);
+    ar(channel.early_multitap, channel.early_diffuser, channel.early_velvet);
+    ar(channel.late_rev);
+    ar(channel.late_resampler);
   }
-  if(params_modified.late_diffusion_mod_depth)
+}
+
+void DSP::update_parameter_targets() noexcept
+{
+  for(size_t p = 0; p < param_targets.size(); ++p)
   {
-    float depth = m_rate * params.late_diffusion_mod_depth / 1000.f;
-    m_l_late_rev.set_diffusion_mod_depth(depth);
-    m_r_late_rev.set_diffusion_mod_depth(depth);
+    param_targets[p] = std::clamp(
+        param_ports[p] ? *param_ports[p] : engine_parameter_infos[p].dflt,
+        engine_parameter_infos[p].min, engine_parameter_infos[p].max);
   }
-  if(params_modified.late_diffusion_mod_rate)
+}
+
+void DSP::update_parameters() noexcept
+{
+  bool modified = false;
+  for(size_t p = 0; p < param_ports.size(); ++p)
   {
-    float rate = params.late_diffusion_mod_rate / m_rate;
-    m_l_late_rev.set_diffusion_mod_rate(rate);
-    m_r_late_rev.set_diffusion_mod_rate(rate);
+    const float new_value
+        = param_targets[p] - param_smooth[p] * (param_targets[p] - params[p]);
+    params_modified[p] = (new_value != params[p]);
+    modified |= params_modified[p];
+    params[p] = new_value;
   }
-  if(params_modified.late_diffusion_seed)
+
+  // otherwise the worker recomputes the derived state
+  if(!m_worker)
+    apply_parameters();
+  else
+    m_tail_stale |= modified;
+}
+
+bool DSP::parameters_settled() const noexcept
+{
+  for(size_t p = 0; p < param_ports.size(); ++p)
   {
-    uint32_t seed = static_cast<uint32_t>(params.late_diffusion_seed);
-    m_l_late_rev.set_diffusion_seed(seed);
-    m_r_late_rev.set_diffusion_seed(seed);
+    const float new_value
+        = param_targets[p] - param_smooth[p] * (param_targets[p] - params[p]);
+    if(new_value != params[p])
+      return false;
   }
+  return true;
+}
 
-  // Filters
-  if(params_modified.late_low_shelf_cutoff)
+void DSP::apply_parameters() noexcept
+{
+  uint32_t changes = 0;
+  bool modified = false;
+  for(size_t p = 0; p < params.size(); ++p)
   {
-    float cutoff = params.late_low_shelf_cutoff;
-    m_l_late_rev.set_low_shelf_cutoff(cutoff);
-    m_r_late_rev.set_low_shelf_cutoff(cutoff);
+    changes |= params_modified[p] ? parameter_infos[p].affects : 0;
+    modified |= params_modified[p];
   }
-  if(params_modified.late_low_shelf_gain)
+  m_tail_stale |= modified;
+
+  m_derived_updates += bits::popcount(changes);
+  m_regenerations += bits::popcount(changes & regenerated);
+
+  m_derived = &m_derived_state;
+  if(!changes)
+    return;
+  m_derived_state.params = params;
+
+  if(m_trace)
+    apply_parameters_traced(changes);
+  else
   {
-    float gain = dBtoGain(params.late_low_shelf_gain);
-    m_l_late_rev.set_low_shelf_gain(gain);
-    m_r_late_rev.set_low_shelf_gain(gain);
+    // recompute every affected quantity exactly once, in dependency order
+    while(changes)
+    {
+      update_derived(
+          static_cast<Derived>(bits::countr_zero(changes)), params, m_rate,
+          late_rate(), m_derived_state.channels);
+      changes &= changes - 1;
+    }
   }
-  if(params_modified.late_high_shelf_cutoff)
+
+  // lines deactivated within a block are cleared right away
+  for(uint32_t ch = 0; ch < channels(); ++ch)
+    m_channels[ch].late_rev.activate_lines(m_derived_state.channels[ch].late_rev);
+}
+
+void DSP::apply_parameters_traced(uint32_t changes) noexcept
+{
+  using Event = TraceRecorder::Event;
+  TraceSpan apply(m_trace, Event::apply_parameters);
+
+  // the parameters that triggered the work
+  for(size_t p = 0; p < params.size(); ++p)
   {
-    float cutoff = params.late_high_shelf_cutoff;
-    m_l_late_rev.set_high_shelf_cutoff(cutoff);
-    m_r_late_rev.set_high_shelf_cutoff(cutoff);
+    if(params_modified[p] && parameter_infos[p].affects)
+      m_trace->instant(Event::parameter, static_cast<uint32_t>(p));
   }
-  if(params_modified.late_high_shelf_gain)
+
+  while(changes)
   {
-    float gain = dBtoGain(params.late_high_shelf_gain);
-    m_l_late_rev.set_high_shelf_gain(gain);
-    m_r_late_rev.set_high_shelf_gain(gain);
+    const auto index = static_cast<uint32_t>(bits::countr_zero(changes));
+    const auto derived = static_cast<Derived>(index);
+    {
+      TraceSpan update(
+          m_trace, (bit(derived) & regenerated) ? Event::regenerate : Event::update,
+          index);
+      update_derived(derived, params, m_rate, late_rate(), m_derived_state.channels);
+    }
+    if(derived == Derived::late_lines)
+      m_trace->instant(Event::lines, static_cast<uint32_t>(params.late_delay_lines));
+    changes &= changes - 1;
   }
-  if(params_modified.late_high_cut_cutoff)
+}
+
+void DSP::update_derived(
+    Derived derived, const Parameters<float>& params, float rate, float late_rate,
+    std::vector<DerivedChannel>& channels) noexcept
+{
+  switch(derived)
   {
-    float cutoff = params.late_high_cut_cutoff;
-    m_l_late_rev.set_high_cut_cutoff(cutoff);
-    m_r_late_rev.set_high_cut_cutoff(cutoff);
+    // Early Reflections
+
+    // Filters
+    case Derived::early_low_cut:
+    {
+      float cutoff = params.early_low_cut_cutoff;
+      for(auto& channel : channels)
+        channel.early_filters.highpass.set_cutoff(cutoff);
+      break;
+    }
+    case Derived::early_high_cut:
+    {
+      float cutoff = params.early_high_cut_cutoff;
+      for(auto& channel : channels)
+        channel.early_filters.lowpass.set_cutoff(cutoff);
+      break;
+    }
+
+    // Multitap Delay
+    case Derived::tap_seed:
+      for(uint32_t ch = 0; ch < channels.size(); ++ch)
+      {
+        auto& multitap = channels[ch].early_multitap;
+        multitap.set_seed(channel_seed(params.tap_seed, ch));
+        multitap.set_seed_crossmix(channel_crossmix(params.seed_crossmix, ch));
+        multitap.generate_rand();
+      }
+      break;
+    case Derived::tap_delays:
+      for(auto& channel : channels)
+        channel.early_multitap.generate_tap_delays();
+      break;
+    case Derived::tap_gains:
+    {
+      float decay = params.early_tap_decay;
+      for(auto& channel : channels)
+      {
+        channel.early_multitap.set_decay(decay);
+        channel.early_multitap.generate_tap_gains();
+      }
+      break;
+    }
+
+    // Diffuser
+    case Derived::early_diffusion_seed:
+      for(uint32_t ch = 0; ch < channels.size(); ++ch)
+      {
+        auto& diffuser = channels[ch].early_diffuser;
+        diffuser.set_seed(channel_seed(params.early_diffusion_seed, ch));
+        diffuser.set_seed_crossmix(channel_crossmix(params.seed_crossmix, ch));
+        diffuser.generate_rand();
+
+        auto& velvet = channels[ch].early_velvet;
+        velvet.set_seed(channel_seed(params.early_diffusion_seed, ch));
+        velvet.set_seed_crossmix(channel_crossmix(params.seed_crossmix, ch));
+        velvet.generate_rand();
+      }
+      break;
+    case Derived::early_diffusion_stages:
+    {
+      uint32_t stages = static_cast<uint32_t>(params.early_diffusion_stages);
+      for(auto& channel : channels)
+      {
+        channel.early_diffuser.set_stages(stages);
+        channel.early_velvet.set_stages(stages);
+      }
+      break;
+    }
+    case Derived::early_diffusion_drive:
+    {
+      float drive = params.early_diffusion_drive == -12
+                        ? 0
+                        : dBtoGain(params.early_diffusion_drive);
+      for(auto& channel : channels)
+        channel.early_diffuser.set_drive(drive);
+      break;
+    }
+    case Derived::early_diffusion_delay:
+    {
+      float delay = rate * params.early_diffusion_delay / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.early_diffuser.set_delay(delay);
+        channel.early_diffuser.generate_delay();
+        channel.early_velvet.set_delay(delay);
+        channel.early_velvet.generate_taps();
+      }
+      break;
+    }
+    case Derived::early_diffusion_mod_depth:
+    {
+      float mod_depth = rate * params.early_diffusion_mod_depth / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.early_diffuser.set_mod_depth(mod_depth);
+        channel.early_diffuser.generate_mod_depth();
+      }
+      break;
+    }
+    case Derived::early_diffusion_mod_rate:
+    {
+      float mod_rate = params.early_diffusion_mod_rate / rate;
+      for(auto& channel : channels)
+      {
+        channel.early_diffuser.set_mod_rate(mod_rate);
+        channel.early_diffuser.generate_mod_rate();
+      }
+      break;
+    }
+
+    // Late Reverberations
+
+    // General
+    case Derived::late_lines:
+    {
+      uint32_t lines = static_cast<uint32_t>(params.late_delay_lines);
+      for(auto& channel : channels)
+        channel.late_rev.set_delay_lines(lines);
+      break;
+    }
+
+    // Modulated Delay
+    case Derived::late_seed:
+      for(uint32_t ch = 0; ch < channels.size(); ++ch)
+      {
+        auto& late_rev = channels[ch].late_rev;
+        late_rev.set_delay_seed(channel_seed(params.delay_seed, ch));
+        late_rev.set_seed_crossmix(channel_crossmix(params.seed_crossmix, ch));
+        late_rev.generate_rand();
+      }
+      break;
+    case Derived::late_delay:
+    {
+      float delay = late_rate * params.late_delay / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_delay(delay);
+        channel.late_rev.generate_delay();
+      }
+      break;
+    }
+    case Derived::late_mod_depth:
+    {
+      float mod_depth = late_rate * params.late_delay_mod_depth / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_delay_mod_depth(mod_depth);
+        channel.late_rev.generate_mod_depth();
+      }
+      break;
+    }
+    case Derived::late_mod_rate:
+    {
+      float mod_rate = params.late_delay_mod_rate / late_rate;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_delay_mod_rate(mod_rate);
+        channel.late_rev.generate_mod_rate();
+      }
+      break;
+    }
+    case Derived::late_feedback:
+    {
+      float feedback = params.late_delay_line_feedback;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_delay_feedback(feedback);
+        channel.late_rev.generate_feedback();
+      }
+      break;
+    }
+
+    // Diffuser
+    case Derived::late_diffusion_seed:
+      // the crossmix is shared with the delay seed, see Derived::late_seed
+      for(uint32_t ch = 0; ch < channels.size(); ++ch)
+      {
+        auto& late_rev = channels[ch].late_rev;
+        late_rev.set_diffusion_seed(channel_seed(params.late_diffusion_seed, ch));
+        late_rev.generate_diffusion_rand();
+      }
+      break;
+    case Derived::late_diffusion_stages:
+    {
+      uint32_t stages = static_cast<uint32_t>(params.late_diffusion_stages);
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_diffusion_stages(stages);
+        channel.late_rev.generate_diffusion_stages();
+      }
+      break;
+    }
+    case Derived::late_diffusion_drive:
+    {
+      float drive = params.late_diffusion_drive == -12
+                        ? 0
+                        : dBtoGain(params.late_diffusion_drive);
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_diffusion_drive(drive);
+        channel.late_rev.generate_diffusion_drive();
+      }
+      break;
+    }
+    case Derived::late_diffusion_delay:
+    {
+      float delay = late_rate * params.late_diffusion_delay / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_diffusion_delay(delay);
+        channel.late_rev.generate_diffusion_delay();
+      }
+      break;
+    }
+    case Derived::late_diffusion_mod_depth:
+    {
+      float depth = late_rate * params.late_diffusion_mod_depth / 1000.f;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_diffusion_mod_depth(depth);
+        channel.late_rev.generate_diffusion_mod_depth();
+      }
+      break;
+    }
+    case Derived::late_diffusion_mod_rate:
+    {
+      float mod_rate = params.late_diffusion_mod_rate / late_rate;
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_diffusion_mod_rate(mod_rate);
+        channel.late_rev.generate_diffusion_mod_rate();
+      }
+      break;
+    }
+
+    // Filters, the coefficients are computed once and shared between channels
+    case Derived::late_low_shelf:
+    {
+      auto& first = channels[0].late_rev;
+      first.set_low_shelf(
+          late_cutoff(params.late_low_shelf_cutoff, rate, late_rate),
+          dBtoGain(params.late_low_shelf_gain));
+      first.generate_low_shelf();
+      for(uint32_t ch = 1; ch < channels.size(); ++ch)
+        channels[ch].late_rev.copy_low_shelf(first);
+      break;
+    }
+    case Derived::late_high_shelf:
+    {
+      auto& first = channels[0].late_rev;
+      first.set_high_shelf(
+          late_cutoff(params.late_high_shelf_cutoff, rate, late_rate),
+          dBtoGain(params.late_high_shelf_gain));
+      first.generate_high_shelf();
+      for(uint32_t ch = 1; ch < channels.size(); ++ch)
+        channels[ch].late_rev.copy_high_shelf(first);
+      break;
+    }
+    case Derived::late_high_cut:
+    {
+      float cutoff = late_cutoff(params.late_high_cut_cutoff, rate, late_rate);
+      for(auto& channel : channels)
+      {
+        channel.late_rev.set_high_cut(cutoff);
+        channel.late_rev.generate_high_cut();
+      }
+      break;
+    }
+
+    case Derived::count:
+      break;
   }
 }
+
+uint32_t DSP::channel_seed(float seed, uint32_t channel) noexcept
+{
+  // golden ratio increments keep the seeds of different pairs far apart
+  return static_cast<uint32_t>(seed) + (channel / 2) * 0x9E3779B9u;
+}
+
+float DSP::channel_crossmix(float seed_crossmix, uint32_t channel) noexcept
+{
+  float crossmix = seed_crossmix / 200.f;
+  return channel % 2 == 0 ? 1.f - crossmix : 0.f + crossmix;
+}
 }
@@ -1,174 +1,523 @@
 #pragma once
 
+#include "capacity.hpp"
 #include "delay.hpp"
 #include "delayline.hpp"
 #include "diffuser.hpp"
 #include "filters.hpp"
+#include "halfband.hpp"
+#include "kernels.hpp"
+#include "meter.hpp"
+#include "parameters.hpp"
 #include "random.hpp"
 
 #include <halp/audio.hpp>
 #include <halp/controls.hpp>
 #include <halp/meta.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <random>
 #include <string_view>
+#include <vector>
 
 namespace Aether
 {
 class Object;
+template <uint32_t Lanes>
+class DSPBatch;
+template <uint32_t Lanes>
+class LateLanes;
+struct StatsRecord;
+class TraceRecorder;
 class DSP
 {
   friend class Object;
-  template <class T>
-  struct Parameters
-  {
-    T mix;
+  template <uint32_t Lanes>
+  friend class DSPBatch;
+  Parameters<float> params = {};
+  Parameters<float> param_targets = {};
+  Parameters<float> param_smooth = {};
+  Parameters<bool> params_modified = {};
+  std::array<const float*, Parameters<float>::size()> param_ports = {};
 
-    // mixer
-    T dry_level;
-    T predelay_level;
-    T early_level;
-    T late_level;
+  /*
+      Member Functions
+    */
+public:
+  // a fixed seed makes the modulation phases and thus the output reproducible
+  explicit DSP(
+      float rate, uint32_t channels = 2, uint32_t seed = std::random_device{}());
+  ~DSP();
+
+  // the processing holds a pointer to the derived state of the DSP
+  DSP(const DSP&) = delete;
+  DSP& operator=(const DSP&) = delete;
+
+  // inputs and outputs hold one buffer per channel
+  void operator()(
+      const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept;
+
+  // reads the parameters from 'values' instead of plugin ports
+  void connect_parameters(const Parameters<float>& values) noexcept;
+  // jumps to the current parameter values without smoothing
+  void settle_parameters() noexcept;
+  // advances all modulation as if 'samples' samples had been processed
+  void skip_modulation(uint64_t samples) noexcept;
+  // silences all buffers and filters, the parameters and derived state stay
+  void clear() noexcept;
 
-    // Global
-    T interpolate;
+  /*
+      Samples until the response to an impulse has decayed below
+      'threshold_db', for hosts to stop processing once the input has
+      been silent for that long. Computed from the current state, mostly
+      from the loop gain and loop delay of every late delay line, and
+      only for the stages that are mixed in. Returns the maximum value
+      if the tail does not decay.
+  */
+  uint64_t tail_length(float threshold_db = -90.f) const noexcept;
 
-    // predelay
-    T width;
-    T predelay;
+  /*
+      Moves the recomputation of the derived state, like the regeneration
+      after a seed change, to a helper thread. The processing then reads
+      the derived state from the results of the helper thread, so a
+      parameter change only costs the audio thread an exchange of a pointer.
 
-    // early
-    // filtering
-    T early_low_cut_enabled;
-    T early_low_cut_cutoff;
-    T early_high_cut_enabled;
-    T early_high_cut_cutoff;
-    // multitap delay
-    T early_taps;
-    T early_tap_length;
-    T early_tap_mix;
-    T early_tap_decay;
-    // diffusion
-    T early_diffusion_stages;
-    T early_diffusion_delay;
-    T early_diffusion_mod_depth;
-    T early_diffusion_mod_rate;
-    T early_diffusion_feedback;
+      The derived state follows the parameters with a latency of at least
+      one block, smoothed parameters in block sized steps. Disabled by
+      default, must not be called while processing.
+  */
+  void set_background_updates(bool enabled);
 
-    // late
-    T late_order;
-    T late_delay_lines;
-    // delay line
-    T late_delay;
-    T late_delay_mod_depth;
-    T late_delay_mod_rate;
-    T late_delay_line_feedback;
-    // diffusion
-    T late_diffusion_stages;
-    T late_diffusion_delay;
-    T late_diffusion_mod_depth;
-    T late_diffusion_mod_rate;
-    T late_diffusion_feedback;
-    // Filter
-    T late_low_shelf_enabled;
-    T late_low_shelf_cutoff;
-    T late_low_shelf_gain;
-    T late_high_shelf_enabled;
-    T late_high_shelf_cutoff;
-    T late_high_shelf_gain;
-    T late_high_cut_enabled;
-    T late_high_cut_cutoff;
+  /*
+      Runs the late reverberations at the sample rate divided by 'factor',
+      which is 1, 2 or 4, to save processing time and memory at high
+      sample rates. Their input is decimated and their output interpolated
+      with half-band filters, see HalfbandResampler, which limits them to
+      about 0.4 times the rate over 'factor' and delays them by about 30
+      samples at each halved rate. The dry, predelayed and early signals
+      keep the full bandwidth.
+
+      Resets the late reverberations. Disabled by default, must not be
+      called while processing.
+  */
+  void set_late_decimation(uint32_t factor);
 
-    // Seed
-    T seed_crossmix;
-    T tap_seed;
-    T early_diffusion_seed;
-    T delay_seed;
-    T late_diffusion_seed;
+  /*
+      Whether the blocks without smoothing run the stages chunk by chunk,
+      see process_chunked, or sample by sample like the other blocks.
+      Both produce the same output, which one is faster depends on the
+      processor and the configuration, see autotune.hpp. Enabled by
+      default, takes effect with the next block.
+  */
+  void set_chunked(bool enabled) noexcept { m_chunked = enabled; }
+  bool chunked() const noexcept { return m_chunked; }
+
+  // the factor of set_late_decimation
+  uint32_t late_decimation() const noexcept { return 1u << m_late_stages; }
 
-    // Distortion
-    T early_diffusion_drive;
-    T late_diffusion_drive;
+  /*
+      The early diffusion, either the chain of modulated allpass filters
+      or the sparse velvet noise FIR of VelvetDiffuser, which costs a
+      fraction of it and ignores the diffusion feedback, drive and
+      modulation. Both follow the diffusion seed, stages and delay.
+      Defaults to allpass, clears the selected diffuser, must not be
+      called while processing.
+  */
+  enum class EarlyDiffusion : uint32_t
+  {
+    allpass,
+    velvet
+  };
+  void set_early_diffusion(EarlyDiffusion diffusion) noexcept;
+  EarlyDiffusion early_diffusion() const noexcept { return m_early_diffusion; }
 
-    T& operator[](size_t idx) noexcept { return data()[idx]; }
-    const T& operator[](size_t idx) const noexcept { return data()[idx]; }
+  /*
+      Publishes statistics of every block to a record of the shared
+      memory segment of StatsExport, for monitoring from other processes,
+      see stats.hpp. Costs a pass over the inputs and outputs of every
+      block. Stays disabled if the segment cannot be opened or is full,
+      and stops if the record is claimed by another instance after a
+      long pause, until it is enabled again. Disabled by default, must
+      not be called while processing.
+  */
+  void set_stats_export(bool enabled);
+  bool stats_export() const noexcept { return m_stats != nullptr; }
 
-    T* data() noexcept { return reinterpret_cast<T*>(this); }
-    const T* data() const noexcept { return reinterpret_cast<const T*>(this); }
+  /*
+      Records the timeline of every block into 'trace', see trace.hpp,
+      or nothing if it is null. Taking over the state recomputed by the
+      background updates shows up as one pickup, and the blocks processed
+      by DSPBatch lack the block and process spans. Must not be called
+      while processing.
+  */
+  void set_trace(TraceRecorder* trace) noexcept { m_trace = trace; }
 
-    T* begin() noexcept { return data(); }
-    const T* begin() const noexcept { return data(); }
+  /*
+      Checkpointing of the complete processing state, see state.hpp
 
-    T* end() noexcept { return data() + size(); }
-    const T* end() const noexcept { return data() + size(); }
+      The state can only be restored into a DSP with the same sample rate,
+      channel count, late decimation and capacity. Restoring fails without
+      side effects if the header does not match, and resets the DSP to its
+      parameters if the payload turns out to be truncated, malformed or to
+      hold values out of their range. It returns false in either case and
+      must not be called while processing.
 
-    static constexpr size_t size() noexcept { return sizeof(Parameters<T>) / sizeof(T); }
-  };
-  Parameters<float> params = {};
-  Parameters<float> param_targets = {};
-  Parameters<float> param_smooth = {};
-  Parameters<bool> params_modified = {};
-  std::array<const float*, 47> param_ports = {};
+      Saving does not write to the DSP, but it reads every buffer and
+      smoother the audio thread writes, so it must not be called while
+      processing either, from any thread.
+  */
+  // appends the state to 'out'
+  void save_state(std::vector<std::byte>& out) const;
+  bool restore_state(const std::byte* data, size_t size) noexcept;
 
-  /*
-      Member Functions
-    */
-public:
-  explicit DSP(float rate);
+  uint32_t channels() const noexcept { return static_cast<uint32_t>(m_channels.size()); }
 
-  void operator()(uint32_t n_samples) noexcept;
+  float rate() const noexcept { return m_rate; }
+
+  float late_rate() const noexcept
+  {
+    return m_rate / static_cast<float>(1u << m_late_stages);
+  }
+
+  static constexpr uint32_t max_channels = 16;
+
+  /*
+      The capacity of the stages, see capacity.hpp, selected at compile
+      time with AETHER_COMPACT. The parameters are limited to what it
+      holds, see engine_parameter_infos.
+  */
+  using Capacity = EngineCapacity;
 
 private:
-  Random::Xorshift64s rng{std::random_device{}()};
+  Random::Xorshift64s rng;
 
-  // Predelay
-  Delay m_l_predelay;
-  Delay m_r_predelay;
+  using Delay = Aether::Delay<Capacity>;
+  using MultitapDelay = Aether::MultitapDelay<Capacity>;
+  template <class FpType>
+  using AllpassDiffuser = Aether::AllpassDiffuser<FpType, FpType, Capacity>;
+  using VelvetDiffuser = Aether::VelvetDiffuser<Capacity>;
+  using Delayline = Aether::Delayline<Capacity>;
+  using LateRev = Aether::LateRev<Capacity>;
 
   // Early
   struct Filters
   {
-    explicit Filters(float rate)
-        : lowpass(rate)
-        , highpass(rate)
+    // the derived state of the filters
+    struct Coefficients
     {
-    }
-    Filters(Filters&& other) noexcept = default;
-    Filters& operator=(Filters&& other) noexcept = default;
+      explicit Coefficients(float rate)
+          : lowpass(rate)
+          , highpass(rate)
+      {
+      }
+
+      Lowpass6dB<float>::Coefficients lowpass;
+      Highpass6dB<float>::Coefficients highpass;
+    };
 
     Lowpass6dB<float> lowpass;
     Highpass6dB<float> highpass;
   };
 
-  Filters m_l_early_filters;
-  Filters m_r_early_filters;
+  // The processing state of a single channel
+  struct Channel
+  {
+    template <class RNG>
+    Channel(float rate, RNG& rng)
+        : predelay(rate)
+        , early_multitap(rate)
+        , early_diffuser(rate, rng)
+        , early_velvet(rate)
+        , late_rev(rate, rng)
+    {
+    }
+    Channel(Channel&& other) noexcept = default;
+    Channel& operator=(Channel&& other) noexcept = default;
+
+    // Predelay
+    Delay predelay;
+
+    // Early
+    Filters early_filters;
+    MultitapDelay early_multitap;
+    AllpassDiffuser<float> early_diffuser;
+    VelvetDiffuser early_velvet;
+
+    // Late
+    LateRev late_rev;
+    HalfbandResampler late_resampler;
+
+    // late_rev.push at the rate of late_resampler
+    float push_late(const LateRev::Derived& d, float sample, float feedback) noexcept
+    {
+      if(late_resampler.factor() == 1)
+        return late_rev.push(d, sample, feedback);
+
+      float reduced = 0.f;
+      if(late_resampler.push(sample, reduced))
+        late_resampler.put(late_rev.push(d, reduced, feedback));
+      return late_resampler.pull();
+    }
+
+    // late_rev.process at the rate of late_resampler, 'n' is at most chunk_size
+    void process_late(
+        const LateRev::Derived& d, const float* input, float* output, uint32_t n,
+        float feedback) noexcept
+    {
+      if(late_resampler.factor() == 1)
+      {
+        late_rev.process(d, input, output, n, feedback);
+        return;
+      }
+
+      std::array<float, chunk_size> reduced = {};
+      std::array<bool, chunk_size> ready;
+      const uint32_t reduced_samples
+          = decimate_late(input, n, reduced.data(), ready.data());
+      late_rev.process(d, reduced.data(), reduced.data(), reduced_samples, feedback);
+      interpolate_late(reduced.data(), ready.data(), output, n);
+    }
+
+    // pushes 'n' samples into late_resampler, stores the samples at the
+    // reduced rate in 'reduced' and returns their count, 'ready' is set
+    // for every pushed sample that completed one of them
+    uint32_t decimate_late(const float* input, uint32_t n, float* reduced, bool* ready)
+        noexcept
+    {
+      uint32_t reduced_samples = 0;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        ready[i] = late_resampler.push(input[i], reduced[reduced_samples]);
+        reduced_samples += ready[i];
+      }
+      return reduced_samples;
+    }
+
+    // pulls 'n' samples from late_resampler, after putting the processed
+    // samples at the reduced rate from decimate_late
+    void interpolate_late(
+        const float* reduced, const bool* ready, float* output, uint32_t n) noexcept
+    {
+      for(uint32_t i = 0, j = 0; i < n; ++i)
+      {
+        if(ready[i])
+          late_resampler.put(reduced[j++]);
+        output[i] = late_resampler.pull();
+      }
+    }
+
+    // the stages of the current chunk, see process_chunked
+    std::array<float, chunk_size> dry_chunk;
+    std::array<float, chunk_size> predelay_chunk;
+    std::array<float, chunk_size> early_chunk;
+    std::array<float, chunk_size> late_chunk;
+  };
+
+  // The derived state of a channel, passed to the processing of its Channel
+  struct DerivedChannel
+  {
+    DerivedChannel(float rate, float late_rate)
+        : early_filters(rate)
+        , early_velvet(rate)
+        , late_rev(late_rate)
+    {
+    }
+
+    Filters::Coefficients early_filters;
+    MultitapDelay::Derived early_multitap;
+    AllpassDiffuser<float>::Derived early_diffuser;
+    VelvetDiffuser::Derived early_velvet;
+    LateRev::Derived late_rev;
+  };
 
-  MultitapDelay m_l_early_multitap;
-  MultitapDelay m_r_early_multitap;
+  struct DerivedState
+  {
+    // the components keep their defaults until the parameters are applied
+    DerivedState(float rate, float late_rate, uint32_t channels);
+    // computed from 'params'
+    DerivedState(
+        float rate, float late_rate, uint32_t channels, const Parameters<float>& params);
+
+    // the parameters the state has been computed from
+    Parameters<float> params = {};
+    std::vector<DerivedChannel> channels;
+  };
+
+  // Recomputes the derived state for set_background_updates
+  class Worker;
+
+  // one sample of every channel
+  using Frame = std::array<float, max_channels>;
 
-  AllpassDiffuser<float> m_l_early_diffuser;
-  AllpassDiffuser<float> m_r_early_diffuser;
+  std::vector<Channel> m_channels;
 
-  // Late
-  LateRev m_l_late_rev;
-  LateRev m_r_late_rev;
+  // the derived state apply_parameters recomputes
+  DerivedState m_derived_state;
+  // the derived state the processing reads, either m_derived_state or
+  // the latest results of the worker
+  const DerivedState* m_derived = &m_derived_state;
+
+  /*
+      The late reverberations of the channels, which always run the same
+      kernels, are processed in groups of late_lanes with one channel per
+      lane, see LateLanes, null for fewer channels. The other stages keep
+      one loop per channel over state laid out per channel: their work is
+      in the delay buffers, which are read and written one channel at a
+      time either way.
+  */
+  static constexpr uint32_t late_lanes = 4;
+  std::unique_ptr<LateLanes<late_lanes>> m_late_lanes;
 
   float m_rate;
 
-  // send audio data if ui is open
-  bool ui_open = false;
+  // the late reverberations run at m_rate / 2^m_late_stages
+  uint32_t m_late_stages = 0;
+
+  bool m_chunked = true;
+  EarlyDiffusion m_early_diffusion = EarlyDiffusion::allpass;
+
+  // the stages processed in a block, each one feeds the next
+  enum Stage : uint32_t
+  {
+    predelay_stage = 1,
+    early_stage = 2,
+    late_stage = 4,
+    all_stages = 7
+  };
+  uint32_t m_stages = all_stages;
+
+  // level meters for the ui, may be null
+  Meter* m_meter = nullptr;
+
+  // null unless the background updates are enabled
+  std::unique_ptr<Worker> m_worker;
+
+  // null unless the statistics export is enabled
+  StatsRecord* m_stats = nullptr;
+  // the instance id of the claim of m_stats
+  uint64_t m_stats_instance = 0;
+  // recomputed and regenerated pieces of derived state, without those of
+  // the current worker
+  uint64_t m_derived_updates = 0;
+  uint64_t m_regenerations = 0;
+  // clears of the state of a stage
+  uint64_t m_state_resets = 0;
+  // since the input was last nonzero
+  uint64_t m_silent_samples = 0;
+  // tail_length() for the statistics, recomputed when the parameters or
+  // the derived state have changed since
+  uint64_t m_tail_samples = 0;
+  bool m_tail_stale = true;
+
+  // null unless the timeline is recorded
+  TraceRecorder* m_trace = nullptr;
 
   // Updates param_targets
   void update_parameter_targets() noexcept;
   // Updates params & params_modified then calls apply_parameters
   void update_parameters() noexcept;
-  // Applies changes in params & params_modified to internal state
+  // Whether update_parameters would leave all of params as they are
+  bool parameters_settled() const noexcept;
+  /*
+      Applies changes in params & params_modified to m_derived_state and
+      processes with it. With the background updates the worker results
+      may be ahead of it, so every parameter has to be marked modified.
+  */
   void apply_parameters() noexcept;
+  // apply_parameters recording the work to m_trace
+  void apply_parameters_traced(uint32_t changes) noexcept;
+  // Recomputes a single piece of derived state of 'channels'
+  static void update_derived(
+      Derived derived, const Parameters<float>& params, float rate, float late_rate,
+      std::vector<DerivedChannel>& channels) noexcept;
+  // Stops the worker, keeping its counts
+  void stop_worker() noexcept;
+
+  // whether all 'n' samples of 'inputs' are zero
+  bool silent(const float* const* inputs, uint32_t n) const noexcept;
+  /*
+      Writes the statistics of a block that took 'time' nanoseconds and
+      ended at 'now' on the steady clock to m_stats
+  */
+  void publish_stats(
+      bool silent_input, const float* const* outputs, uint32_t n, uint64_t time,
+      uint64_t now) noexcept;
+
+  /*
+      The processing is specialized on the switches, which only change
+      between blocks. begin_block selects the kernels of the components,
+      process is specialized on the early filter switches.
+
+      While no parameter is being smoothed, process_chunked runs the
+      stages one after the other over chunks of the block instead of
+      running all stages for every sample, with the same result.
+  */
+  using Kernel = void (DSP::*)(const float* const*, float* const*, uint32_t) noexcept;
+  static Kernel select_kernel(uint32_t variant) noexcept;
+  void begin_block() noexcept;
+  template <uint32_t Variant>
+  void process(
+      const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept;
+  template <uint32_t Variant>
+  void process_chunked(
+      const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept;
+
+  /*
+      The steps of operator() and process_chunked, which DSPBatch runs
+      for several instances at once
+
+      prepare_block returns the kernel variant of the block. A chunk
+      is processed by process_early_chunk, then by process_late_chunk and
+      then by mix_chunk.
+  */
+  uint32_t prepare_block() noexcept;
+  void finish_block(uint32_t n_samples, uint32_t late_samples) noexcept;
+  /*
+      Skips the stages whose output is muted, by their level or the mix,
+      and is not needed by a later stage or the meter. Their chunks are
+      zeroed once when they stop, their state is cleared and settled when
+      they resume, so that they build up from silence like a new DSP
+      while their level rises.
+  */
+  void select_stages() noexcept;
+  bool begin_metering() noexcept;
+  template <uint32_t Variant>
+  void process_early_chunk(
+      const float* const* inputs, uint32_t start, uint32_t n) noexcept;
+  using EarlyKernel = void (DSP::*)(const float* const*, uint32_t, uint32_t) noexcept;
+  static EarlyKernel select_early_kernel(uint32_t variant) noexcept;
+  void mix_chunk(float* const* outputs, uint32_t start, uint32_t n, bool metering)
+      noexcept;
+  // Channel::process_late of every channel, in the lanes of m_late_lanes
+  // if there are enough channels
+  void process_late_chunk(uint32_t n, float feedback) noexcept;
+
+  template <class Archive>
+  void serialize(Archive& ar);
+
+  // Channels are decorrelated in pairs, with the seed crossmix
+  // separating the two channels of each pair like left and right
+  static uint32_t channel_seed(float seed, uint32_t channel) noexcept;
+  static float channel_crossmix(float seed_crossmix, uint32_t channel) noexcept;
 };
 
+// the range and default of the knob of a parameter
+constexpr halp::range knob_range(const ParameterInfo& info) noexcept
+{
+  return {info.min, info.max, info.dflt};
+}
+
+constexpr halp::irange iknob_range(const ParameterInfo& info) noexcept
+{
+  return {
+      static_cast<int>(info.min), static_cast<int>(info.max),
+      static_cast<int>(info.dflt)};
+}
+
 class Object
 {
 public:
@@ -182,81 +531,136 @@ public:
 
   DSP dsp{44100.};
 
-  using range = halp::range;
-  using irange = halp::irange;
+  // level meters and scope feed for the ui, see Meter
+  Meter meter{44100.f};
+
   struct
   {
     halp::fixed_audio_bus<"Audio", float, 2> audio;
 
-    halp::knob_f32<"Mix", range{0., 100., 100.}> mix;
+    halp::knob_f32<"Mix", knob_range(parameter_infos.mix)> mix;
 
     // mixer
-    halp::knob_f32<"Dry", range{0., 100., 80.}> dry_level;
-    halp::knob_f32<"Predelay level", range{0., 100., 20.}> predelay_level;
-    halp::knob_f32<"Early level", range{0., 100., 10.}> early_level;
-    halp::knob_f32<"Late level", range{0., 100., 20.}> late_level;
+    halp::knob_f32<"Dry", knob_range(parameter_infos.dry_level)> dry_level;
+    halp::knob_f32<"Predelay level", knob_range(parameter_infos.predelay_level)>
+        predelay_level;
+    halp::knob_f32<"Early level", knob_range(parameter_infos.early_level)> early_level;
+    halp::knob_f32<"Late level", knob_range(parameter_infos.late_level)> late_level;
 
     // Global
     halp::toggle_f32<"Interpolate"> interpolate;
 
     // predelay
-    halp::knob_f32<"Width", range{0., 100., 100.}> width;
-    halp::knob_f32<"Predelay", range{0., 400., 20.}> predelay;
+    halp::knob_f32<"Width", knob_range(parameter_infos.width)> width;
+    halp::knob_f32<"Predelay", knob_range(parameter_infos.predelay)> predelay;
 
     // early
     // filtering
     halp::toggle_f32<"Early low cut enabled"> early_low_cut_enabled;
-    halp::knob_f32<"Early Low Cut Cutoff", range{15, 22000, 15}> early_low_cut_cutoff;
+    halp::knob_f32<
+        "Early Low Cut Cutoff", knob_range(parameter_infos.early_low_cut_cutoff)>
+        early_low_cut_cutoff;
     halp::toggle_f32<"Early high cut enabled"> early_high_cut_enabled;
-    halp::knob_f32<"Early High Cut Cutoff", range{15, 22000, 20000}> early_high_cut_cutoff;
+    halp::knob_f32<
+        "Early High Cut Cutoff", knob_range(parameter_infos.early_high_cut_cutoff)>
+        early_high_cut_cutoff;
 
     // multitap delay
-    halp::iknob_f32<"Early taps", irange{1, 50, 12}> early_taps;
-    halp::knob_f32<"Early tap length", range{0, 500, 200}> early_tap_length;
-    halp::knob_f32<"Early tap mix", range{0, 100,100}> early_tap_mix;
-    halp::knob_f32<"Early Tap Decay", range{0, 1, 0.5f}> early_tap_decay;
+    halp::iknob_f32<"Early taps", iknob_range(parameter_infos.early_taps)> early_taps;
+    halp::knob_f32<"Early tap length", knob_range(parameter_infos.early_tap_length)>
+        early_tap_length;
+    halp::knob_f32<"Early tap mix", knob_range(parameter_infos.early_tap_mix)>
+        early_tap_mix;
+    halp::knob_f32<"Early Tap Decay", knob_range(parameter_infos.early_tap_decay)>
+        early_tap_decay;
     // diffusion
-    halp::iknob_f32<"Early diffusion stages", irange{0, 8, 7}> early_diffusion_stages;
-    halp::knob_f32<"Early diffusion delay", range{10, 100, 20}>early_diffusion_delay;
-    halp::knob_f32<"Early diffusion mod depth", range{0, 3, 0}>early_diffusion_mod_depth;
-    halp::knob_f32<"Early diffusion mod rate", range{0, 5, 1}>early_diffusion_mod_rate;
-    halp::knob_f32<"Early diffusion feedback", range{0, 1, 0.7f}> early_diffusion_feedback;
+    halp::iknob_f32<
+        "Early diffusion stages", iknob_range(parameter_infos.early_diffusion_stages)>
+        early_diffusion_stages;
+    halp::knob_f32<
+        "Early diffusion delay", knob_range(parameter_infos.early_diffusion_delay)>
+        early_diffusion_delay;
+    halp::knob_f32<
+        "Early diffusion mod depth", knob_range(parameter_infos.early_diffusion_mod_depth)>
+        early_diffusion_mod_depth;
+    halp::knob_f32<
+        "Early diffusion mod rate", knob_range(parameter_infos.early_diffusion_mod_rate)>
+        early_diffusion_mod_rate;
+    halp::knob_f32<
+        "Early diffusion feedback", knob_range(parameter_infos.early_diffusion_feedback)>
+        early_diffusion_feedback;
 
     // late
-    halp::iknob_f32<"Late order", irange{0, 1, 0}> late_order;
-    halp::iknob_f32<"Late delay lines", irange{1, 12, 3}> late_delay_lines;
+    halp::iknob_f32<"Late order", iknob_range(parameter_infos.late_order)> late_order;
+    halp::iknob_f32<"Late delay lines", iknob_range(parameter_infos.late_delay_lines)>
+        late_delay_lines;
     // delay line
-    halp::knob_f32<"Late delay", range{0.05f, 1000, 100}> late_delay;
-    halp::knob_f32<"Late delay mod depth", range{0, 50, 0.2f}> late_delay_mod_depth;
-    halp::knob_f32<"Late delay mod rate", range{0, 5, 0.2f}> late_delay_mod_rate;
-    halp::knob_f32<"Late delay line feedback", range{0, 1, 0.7f}> late_delay_line_feedback;
+    halp::knob_f32<"Late delay", knob_range(parameter_infos.late_delay)> late_delay;
+    halp::knob_f32<
+        "Late delay mod depth", knob_range(parameter_infos.late_delay_mod_depth)>
+        late_delay_mod_depth;
+    halp::knob_f32<
+        "Late delay mod rate", knob_range(parameter_infos.late_delay_mod_rate)>
+        late_delay_mod_rate;
+    halp::knob_f32<
+        "Late delay line feedback", knob_range(parameter_infos.late_delay_line_feedback)>
+        late_delay_line_feedback;
     // diffusion
-    halp::iknob_f32<"Late diffusion stages", irange{0, 8, 7}> late_diffusion_stages;
-    halp::knob_f32<"Late diffusion delay", range{10, 100, 50}> late_diffusion_delay;
-    halp::knob_f32<"Late diffusion mod depth", range{0, 3, 0.2f}> late_diffusion_mod_depth;
-    halp::knob_f32<"Late diffusion mod rate", range{0, 5, 0.5f}> late_diffusion_mod_rate;
-    halp::knob_f32<"Late diffusion feedback", range{0, 1, 0.7f}> late_diffusion_feedback;
+    halp::iknob_f32<
+        "Late diffusion stages", iknob_range(parameter_infos.late_diffusion_stages)>
+        late_diffusion_stages;
+    halp::knob_f32<
+        "Late diffusion delay", knob_range(parameter_infos.late_diffusion_delay)>
+        late_diffusion_delay;
+    halp::knob_f32<
+        "Late diffusion mod depth", knob_range(parameter_infos.late_diffusion_mod_depth)>
+        late_diffusion_mod_depth;
+    halp::knob_f32<
+        "Late diffusion mod rate", knob_range(parameter_infos.late_diffusion_mod_rate)>
+        late_diffusion_mod_rate;
+    halp::knob_f32<
+        "Late diffusion feedback", knob_range(parameter_infos.late_diffusion_feedback)>
+        late_diffusion_feedback;
     // Filter
     halp::toggle_f32<"Late low shelf enabled"> late_low_shelf_enabled;
-    halp::knob_f32<"Late low shelf cutoff", range{15, 22000, 100}> late_low_shelf_cutoff;
-    halp::knob_f32<"Late low shelf gain", range{-24, 0, -2}> late_low_shelf_gain;
+    halp::knob_f32<
+        "Late low shelf cutoff", knob_range(parameter_infos.late_low_shelf_cutoff)>
+        late_low_shelf_cutoff;
+    halp::knob_f32<
+        "Late low shelf gain", knob_range(parameter_infos.late_low_shelf_gain)>
+        late_low_shelf_gain;
     halp::toggle_f32<"Late high shelf enabled"> late_high_shelf_enabled;
-    halp::knob_f32<"Late high shelf cutoff", range{15, 22000, 1500}> late_high_shelf_cutoff;
-    halp::knob_f32<"Late high shelf gain", range{-24, 0, -3}> late_high_shelf_gain;
+    halp::knob_f32<
+        "Late high shelf cutoff", knob_range(parameter_infos.late_high_shelf_cutoff)>
+        late_high_shelf_cutoff;
+    halp::knob_f32<
+        "Late high shelf gain", knob_range(parameter_infos.late_high_shelf_gain)>
+        late_high_shelf_gain;
     halp::toggle_f32<"Late high cut enabled"> late_high_cut_enabled;
-    halp::knob_f32<"Late high cut cutoff", range{15, 22000, 20000}> late_high_cut_cutoff;
+    halp::knob_f32<
+        "Late high cut cutoff", knob_range(parameter_infos.late_high_cut_cutoff)>
+        late_high_cut_cutoff;
 
     // Seed
-    halp::knob_f32<"Seed crossmix", range{0, 100, 80}> seed_crossmix;
-
-    halp::iknob_f32<"Tap seed", irange{1, 99999, 1}> tap_seed;
-    halp::iknob_f32<"Early diffusion seed", irange{1, 99999, 1}> early_diffusion_seed;
-    halp::iknob_f32<"Delay seed", irange{1, 99999, 1}> delay_seed;
-    halp::iknob_f32<"Late diffusion seed", irange{1, 99999, 1}> late_diffusion_seed;
+    halp::knob_f32<"Seed crossmix", knob_range(parameter_infos.seed_crossmix)>
+        seed_crossmix;
+
+    halp::iknob_f32<"Tap seed", iknob_range(parameter_infos.tap_seed)> tap_seed;
+    halp::iknob_f32<
+        "Early diffusion seed", iknob_range(parameter_infos.early_diffusion_seed)>
+        early_diffusion_seed;
+    halp::iknob_f32<"Delay seed", iknob_range(parameter_infos.delay_seed)> delay_seed;
+    halp::iknob_f32<
+        "Late diffusion seed", iknob_range(parameter_infos.late_diffusion_seed)>
+        late_diffusion_seed;
 
     // Distortion
-    halp::knob_f32<"Early diffusion drive", range{-12, 12, -12}> early_diffusion_drive;
-    halp::knob_f32<"Late diffusion drive", range{-12, 12, -12}> late_diffusion_drive;
+    halp::knob_f32<
+        "Early diffusion drive", knob_range(parameter_infos.early_diffusion_drive)>
+        early_diffusion_drive;
+    halp::knob_f32<
+        "Late diffusion drive", knob_range(parameter_infos.late_diffusion_drive)>
+        late_diffusion_drive;
   } inputs;
 
   struct
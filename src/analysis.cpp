@@ -0,0 +1,364 @@
+#include "analysis.hpp"
+
+#include "aether_dsp.hpp"
+#include "constants.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace Aether::Analysis
+{
+namespace
+{
+constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+
+// the octave bands, then the unfiltered signal
+constexpr uint32_t lanes = band_count + 1;
+constexpr uint32_t broadband = band_count;
+
+template <class T>
+using Lanes = std::array<T, lanes>;
+
+/*
+    Octave band-pass filters with a peak gain of 1, each two biquad
+    sections in transposed direct form 2. The bands are the lanes of
+    the inner loops, so that they are processed as vectors.
+*/
+class Filterbank
+{
+public:
+  explicit Filterbank(float rate)
+  {
+    constexpr double pi = constants::pi_v<double>;
+    const double bandwidth = std::log(2.) / 2.;
+
+    for(auto* coefficients : {&b0, &b1, &b2, &a1, &a2, &s1, &s2})
+      for(auto& section : *coefficients)
+        section.fill(0.);
+
+    for(uint32_t band = 0; band < band_count; ++band)
+    {
+      if(!measured(rate, band))
+        continue;
+
+      const double w = 2. * pi * octave_bands[band] / rate;
+      const double alpha = std::sin(w) * std::sinh(bandwidth * w / std::sin(w));
+      const double a0 = 1. + alpha;
+      for(uint32_t s = 0; s < sections; ++s)
+      {
+        b0[s][band] = alpha / a0;
+        b2[s][band] = -alpha / a0;
+        a1[s][band] = -2. * std::cos(w) / a0;
+        a2[s][band] = (1. - alpha) / a0;
+      }
+    }
+
+    for(uint32_t s = 0; s < sections; ++s)
+      b0[s][broadband] = 1.;
+  }
+
+  static bool measured(float rate, uint32_t band) noexcept
+  {
+    return octave_bands[band] < 0.25f * rate;
+  }
+
+  // adds the energy of 'x' in every lane to 'energy'
+  void push(float x, float* energy) noexcept
+  {
+    Lanes<double> y;
+    for(uint32_t l = 0; l < lanes; ++l)
+      y[l] = x;
+
+    for(uint32_t s = 0; s < sections; ++s)
+    {
+      for(uint32_t l = 0; l < lanes; ++l)
+      {
+        const double in = y[l];
+        y[l] = b0[s][l] * in + s1[s][l];
+        s1[s][l] = s2[s][l] + b1[s][l] * in - a1[s][l] * y[l];
+        s2[s][l] = b2[s][l] * in - a2[s][l] * y[l];
+      }
+    }
+
+    for(uint32_t l = 0; l < lanes; ++l)
+      energy[l] += static_cast<float>(y[l] * y[l]);
+  }
+
+private:
+  static constexpr uint32_t sections = 2;
+
+  std::array<Lanes<double>, sections> b0, b1, b2, a1, a2;
+  std::array<Lanes<double>, sections> s1, s2;
+};
+
+// least squares line through the points with a weight of 1
+struct Regression
+{
+  Lanes<double> count{}, x{}, y{}, xx{}, xy{};
+
+  void add(uint32_t l, double weight, double time, double level) noexcept
+  {
+    count[l] += weight;
+    x[l] += weight * time;
+    y[l] += weight * level;
+    xx[l] += weight * time * time;
+    xy[l] += weight * time * level;
+  }
+
+  // seconds to decay by 60 dB
+  float decay_time(uint32_t l) const noexcept
+  {
+    const double denominator = count[l] * xx[l] - x[l] * x[l];
+    if(count[l] < 2. || denominator <= 0.)
+      return nan;
+    const double slope = (count[l] * xy[l] - x[l] * y[l]) / denominator;
+    return slope < 0. ? static_cast<float>(-60. / slope) : nan;
+  }
+};
+
+// fits the decay times to the energy decay curves of 'energy'
+void fit_decay(
+    float rate, const std::vector<Lanes<float>>& energy, Metrics& metrics) noexcept
+{
+  Lanes<double> total{};
+  for(const auto& frame : energy)
+    for(uint32_t l = 0; l < lanes; ++l)
+      total[l] += frame[l];
+
+  // the curve is the energy still to come, integrated backwards
+  Regression early, t30, t20;
+  Lanes<double> remaining = total;
+  Lanes<double> lowest{};
+  for(size_t i = 0; i < energy.size(); ++i)
+  {
+    const double time = static_cast<double>(i) / rate;
+    for(uint32_t l = 0; l < lanes; ++l)
+    {
+      const double level = remaining[l] > 0. && total[l] > 0.
+                               ? 10. * std::log10(remaining[l] / total[l])
+                               : -std::numeric_limits<double>::infinity();
+      early.add(l, level >= -10. ? 1. : 0., time, level >= -10. ? level : 0.);
+      const bool in_t20 = level <= -5. && level >= -25.;
+      const bool in_t30 = level <= -5. && level >= -35.;
+      t20.add(l, in_t20 ? 1. : 0., time, in_t20 ? level : 0.);
+      t30.add(l, in_t30 ? 1. : 0., time, in_t30 ? level : 0.);
+      lowest[l] = std::min(lowest[l], level);
+      remaining[l] -= energy[i][l];
+    }
+  }
+
+  auto rt60 = [&](uint32_t l) {
+    if(lowest[l] < -35.)
+      return t30.decay_time(l);
+    if(lowest[l] < -25.)
+      return t20.decay_time(l);
+    return nan;
+  };
+
+  for(uint32_t band = 0; band < band_count; ++band)
+  {
+    const bool measured = Filterbank::measured(rate, band);
+    metrics.rt60[band] = measured ? rt60(band) : nan;
+    metrics.edt[band] = measured ? early.decay_time(band) : nan;
+  }
+  metrics.broadband_rt60 = rt60(broadband);
+  metrics.broadband_edt = early.decay_time(broadband);
+}
+
+/*
+    Normalized echo density after Abel and Huang: the share of the
+    samples of a 20 ms Hann window that lie outside its standard
+    deviation, relative to that of Gaussian noise. Evaluated every
+    millisecond on the mean of the channels.
+*/
+void fit_density(float rate, const std::vector<float>& mono, Metrics& metrics)
+{
+  const auto window_length = static_cast<size_t>(0.02f * rate);
+  const auto hop = std::max<size_t>(static_cast<size_t>(0.001f * rate), 1);
+  const double gaussian = std::erfc(1. / constants::sqrt2_v<double>);
+
+  constexpr double pi = constants::pi_v<double>;
+  std::vector<float> window(window_length);
+  double window_sum = 0.;
+  for(size_t i = 0; i < window_length; ++i)
+  {
+    window[i] = static_cast<float>(
+        0.5 - 0.5 * std::cos(2. * pi * (i + 0.5) / static_cast<double>(window_length)));
+    window_sum += window[i];
+  }
+  for(float& w : window)
+    w = static_cast<float>(w / window_sum);
+
+  metrics.density_half_time = nan;
+  metrics.mixing_time = nan;
+  for(size_t start = 0; start + window_length <= mono.size(); start += hop)
+  {
+    const float* x = mono.data() + start;
+
+    float variance = 0.f;
+    for(size_t i = 0; i < window_length; ++i)
+      variance += window[i] * x[i] * x[i];
+    if(variance <= 0.f)
+      continue;
+    const float deviation = std::sqrt(variance);
+
+    float outside = 0.f;
+    for(size_t i = 0; i < window_length; ++i)
+      outside += std::abs(x[i]) > deviation ? window[i] : 0.f;
+
+    const double density = outside / gaussian;
+    const auto time = static_cast<float>((start + window_length / 2) / rate);
+    if(density >= 0.5 && std::isnan(metrics.density_half_time))
+      metrics.density_half_time = time;
+    if(density >= 1.)
+    {
+      metrics.mixing_time = time;
+      return;
+    }
+  }
+}
+
+Metrics analyze_one(const Settings& settings, const Parameters<float>& parameters)
+{
+  // the DSP keeps reading the parameters it is connected to
+  const Parameters<float> wet = [&] {
+    Parameters<float> p = parameters;
+    p.mix = 100.f;
+    p.dry_level = 0.f;
+    return p;
+  }();
+  auto dsp = std::make_unique<DSP>(settings.rate, settings.channels, settings.seed);
+  dsp->connect_parameters(wet);
+  dsp->settle_parameters();
+
+  const auto max_length = static_cast<uint64_t>(settings.max_length * settings.rate);
+  const uint64_t tail = dsp->tail_length(settings.floor_db);
+  const uint64_t length = std::max<uint64_t>(std::min(tail, max_length), 1);
+
+  const uint32_t channels = settings.channels;
+  const uint32_t block_size = settings.block_size;
+  std::vector<std::vector<float>> response(
+      channels, std::vector<float>(static_cast<size_t>(length)));
+  std::vector<float> input(block_size);
+  std::vector<const float*> in(channels, input.data());
+  std::vector<float*> out(channels);
+
+  input[0] = 1.f;
+  for(uint64_t pos = 0; pos < length; pos += block_size)
+  {
+    const auto n = static_cast<uint32_t>(std::min<uint64_t>(block_size, length - pos));
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      out[ch] = response[ch].data() + pos;
+    (*dsp)(in.data(), out.data(), n);
+    input[0] = 0.f;
+  }
+
+  std::vector<const float*> channel_data;
+  for(auto& channel : response)
+    channel_data.push_back(channel.data());
+
+  Metrics metrics = measure(settings.rate, channel_data.data(), channels, length);
+
+  // the tail length overestimates the decay, so only the response tells
+  // how far it has decayed: the energy of its last 10 ms relative to
+  // that of its loudest 10 ms, the range the decay curves get to
+  const auto window = std::max<uint64_t>(static_cast<uint64_t>(0.01f * settings.rate), 1);
+  double loudest = 0.;
+  double last = 0.;
+  for(uint64_t start = 0; start < length; start += window)
+  {
+    double energy = 0.;
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      for(uint64_t i = start; i < std::min(start + window, length); ++i)
+        energy += static_cast<double>(response[ch][i]) * response[ch][i];
+    loudest = std::max(loudest, energy);
+    last = energy;
+  }
+  const double floor = std::pow(10., static_cast<double>(settings.floor_db) / 10.);
+  metrics.truncated = last > floor * loudest;
+  return metrics;
+}
+}
+
+Metrics
+measure(float rate, const float* const* response, uint32_t channels, uint64_t length)
+{
+  Metrics metrics;
+  metrics.length = length;
+  metrics.truncated = false;
+
+  float peak = 0.f;
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    for(uint64_t i = 0; i < length; ++i)
+      peak = std::max(peak, std::abs(response[ch][i]));
+  metrics.peak_db = 20.f * std::log10(peak);
+
+  // the first sample within 20 dB of the peak
+  uint64_t onset = length;
+  for(uint32_t ch = 0; ch < channels; ++ch)
+  {
+    uint64_t i = 0;
+    while(i < onset && std::abs(response[ch][i]) < 0.1f * peak)
+      ++i;
+    onset = std::min(onset, i);
+  }
+  if(peak == 0.f)
+    onset = 0;
+
+  const auto measured = static_cast<size_t>(length - onset);
+  std::vector<Lanes<float>> energy(measured, Lanes<float>{});
+  std::vector<float> mono(measured);
+  for(uint32_t ch = 0; ch < channels; ++ch)
+  {
+    // the filters also see the samples before the onset
+    Filterbank filterbank(rate);
+    Lanes<float> discarded{};
+    for(uint64_t i = 0; i < length; ++i)
+    {
+      const float x = response[ch][i];
+      if(i < onset)
+      {
+        filterbank.push(x, discarded.data());
+        continue;
+      }
+      filterbank.push(x, energy[i - onset].data());
+      mono[i - onset] += x / static_cast<float>(channels);
+    }
+  }
+
+  fit_decay(rate, energy, metrics);
+  fit_density(rate, mono, metrics);
+
+  metrics.correlation = 1.f;
+  if(channels >= 2)
+  {
+    double lr = 0., ll = 0., rr = 0.;
+    for(uint64_t i = 0; i < length; ++i)
+    {
+      const double l = response[0][i];
+      const double r = response[1][i];
+      lr += l * r;
+      ll += l * l;
+      rr += r * r;
+    }
+    metrics.correlation
+        = ll > 0. && rr > 0. ? static_cast<float>(lr / std::sqrt(ll * rr)) : nan;
+  }
+
+  return metrics;
+}
+
+std::vector<Metrics>
+analyze(const Settings& settings, const std::vector<Parameters<float>>& parameters)
+{
+  std::vector<Metrics> metrics(parameters.size());
+  parallel_for(parameters.size(), settings.threads, [&](size_t i) {
+    metrics[i] = analyze_one(settings, parameters[i]);
+  });
+  return metrics;
+}
+}
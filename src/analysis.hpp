@@ -0,0 +1,84 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include "parameters.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Aether::Analysis
+{
+/*
+    Acoustic metrics of the impulse responses of parameter sets
+
+    Every parameter set is rendered by its own DSP from an impulse on all
+    channels, with the dry signal muted, until the response has decayed
+    below the floor. The responses are split into octave bands by a
+    filterbank that runs all bands at once, and the decay times are fitted
+    to the Schroeder energy decay curves of the bands, as in ISO 3382.
+    The parameter sets are spread over threads.
+*/
+
+// centre frequencies of the octave bands in Hz
+inline constexpr std::array<float, 8> octave_bands
+    = {63.f, 125.f, 250.f, 500.f, 1000.f, 2000.f, 4000.f, 8000.f};
+inline constexpr uint32_t band_count = octave_bands.size();
+
+struct Settings
+{
+  float rate = 48000.f;
+  uint32_t channels = 2;
+  uint32_t seed = 1;
+
+  // 0 uses all hardware threads
+  uint32_t threads = 0;
+  uint32_t block_size = 512;
+
+  // level relative to the impulse down to which the response is rendered
+  float floor_db = -80.f;
+  // upper limit for the length of the response, in seconds
+  float max_length = 20.f;
+};
+
+/*
+    Times in seconds from the onset, the first sample within 20 dB of
+    the peak, NaN where the response does not get there. Bands at or
+    above a quarter of the sample rate are not measured.
+*/
+struct Metrics
+{
+  // from the decay between -5 and -35 dB, or -25 dB if it ends before
+  std::array<float, band_count> rt60;
+  float broadband_rt60;
+  // early decay time, from the decay between 0 and -10 dB
+  std::array<float, band_count> edt;
+  float broadband_edt;
+
+  // until the normalized echo density first reaches 0.5 and 1
+  float density_half_time;
+  float mixing_time;
+
+  // correlation of the first two channels at lag 0, 1 with one channel
+  float correlation;
+  // of all channels relative to the impulse, in dB
+  float peak_db;
+
+  // rendered samples
+  uint64_t length;
+  // the energy of the last 10 ms of the response is still above the
+  // floor relative to its loudest 10 ms, so the decay times are
+  // underestimated
+  bool truncated;
+};
+
+// of an impulse response with one buffer of 'length' samples per channel
+Metrics
+measure(float rate, const float* const* response, uint32_t channels, uint64_t length);
+
+// in the order of 'parameters'
+std::vector<Metrics>
+analyze(const Settings& settings, const std::vector<Parameters<float>>& parameters);
+}
+
+#endif
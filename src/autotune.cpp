@@ -0,0 +1,245 @@
+#include "autotune.hpp"
+
+#include "aether_dsp.hpp"
+#include "random.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace Aether
+{
+namespace
+{
+// blocks before the measurement, and measured per candidate and round
+constexpr uint32_t warmup_blocks = 16;
+constexpr uint32_t round_blocks = 8;
+// the candidates take turns, so that they see the same load
+constexpr uint32_t rounds = 8;
+
+std::string trim(std::string text)
+{
+  const auto first = text.find_first_not_of(" \t");
+  const auto last = text.find_last_not_of(" \t");
+  if(first == std::string::npos)
+    return {};
+  return text.substr(first, last - first + 1);
+}
+
+std::string cpu_model()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  std::array<unsigned int, 12> brand = {};
+  for(unsigned int leaf = 0; leaf < 3; ++leaf)
+  {
+    unsigned int* regs = brand.data() + 4 * leaf;
+    if(!__get_cpuid(0x80000002 + leaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+      break;
+  }
+  char name[sizeof(brand) + 1] = {};
+  std::memcpy(name, brand.data(), sizeof(brand));
+  if(const std::string model = trim(name); !model.empty())
+    return model;
+#endif
+
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for(std::string line; std::getline(cpuinfo, line);)
+  {
+    if(line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0)
+    {
+      if(const auto colon = line.find(':'); colon != std::string::npos)
+        return trim(line.substr(colon + 1));
+    }
+  }
+  return "unknown processor";
+}
+
+const char* chunked_name(bool chunked) noexcept
+{
+  return chunked ? "chunked" : "sampled";
+}
+}
+
+std::string
+tuning_key(const DSP& dsp, const Parameters<float>& params, uint32_t block_size)
+{
+  static const std::string model = cpu_model();
+
+  std::ostringstream key;
+  key << model << " rate=" << dsp.rate() << " channels=" << dsp.channels()
+      << " decimation=" << dsp.late_decimation()
+      << " diffusion=" << static_cast<uint32_t>(dsp.early_diffusion())
+      << " block=" << block_size
+      << " lines=" << static_cast<uint32_t>(params.late_delay_lines)
+      << " late_stages=" << static_cast<uint32_t>(params.late_diffusion_stages)
+      << " early_stages=" << static_cast<uint32_t>(params.early_diffusion_stages)
+      << " taps=" << static_cast<uint32_t>(params.early_taps);
+  return key.str();
+}
+
+Tuning
+autotune(const DSP& reference, const Parameters<float>& params, uint32_t block_size)
+{
+  const std::array<Tuning, 2> candidates = {Tuning{true}, Tuning{false}};
+
+  const uint32_t channels = reference.channels();
+  DSP dsp(reference.rate(), channels, 1);
+  dsp.set_late_decimation(reference.late_decimation());
+  dsp.set_early_diffusion(reference.early_diffusion());
+  dsp.connect_parameters(params);
+  dsp.settle_parameters();
+
+  std::vector<std::vector<float>> input(channels, std::vector<float>(block_size));
+  std::vector<std::vector<float>> output(channels, std::vector<float>(block_size));
+  std::vector<const float*> in;
+  std::vector<float*> out;
+  Random::Xorshift64s rng{1};
+  for(uint32_t ch = 0; ch < channels; ++ch)
+  {
+    for(float& sample : input[ch])
+      sample = static_cast<float>(rng() >> 8) * 0x1.0p-24f - 0.5f;
+    in.push_back(input[ch].data());
+    out.push_back(output[ch].data());
+  }
+
+  auto run = [&](uint32_t blocks) {
+    for(uint32_t b = 0; b < blocks; ++b)
+      dsp(in.data(), out.data(), block_size);
+  };
+  run(warmup_blocks);
+
+  using clock = std::chrono::steady_clock;
+  std::vector<double> fastest(candidates.size(), std::numeric_limits<double>::max());
+  for(uint32_t round = 0; round < rounds; ++round)
+  {
+    for(size_t c = 0; c < candidates.size(); ++c)
+    {
+      dsp.set_chunked(candidates[c].chunked);
+
+      const auto start = clock::now();
+      run(round_blocks);
+      const auto stop = clock::now();
+      const double duration = std::chrono::duration<double>(stop - start).count();
+      fastest[c] = std::min(fastest[c], duration);
+    }
+  }
+
+  return candidates[std::min_element(fastest.begin(), fastest.end()) - fastest.begin()];
+}
+
+std::string Wisdom::default_path()
+{
+  if(const char* path = std::getenv("AETHER_WISDOM"))
+    return path;
+
+  std::filesystem::path cache;
+  if(const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    cache = xdg;
+  else if(const char* home = std::getenv("HOME"))
+    cache = std::filesystem::path(home) / ".cache";
+  else
+    cache = std::filesystem::temp_directory_path();
+  return (cache / "aether" / "wisdom").string();
+}
+
+/*
+    One tuning per line:
+        <chunked|sampled> <key>
+    Lines that cannot be parsed are skipped.
+*/
+Wisdom::Wisdom(std::string path)
+    : m_path{std::move(path)}
+{
+  std::ifstream file(m_path);
+  for(std::string line; std::getline(file, line);)
+  {
+    std::istringstream fields(line);
+    std::string chunked_field, key;
+    if(!(fields >> chunked_field) || !std::getline(fields, key))
+      continue;
+
+    Tuning tuning;
+    if(chunked_field != chunked_name(true) && chunked_field != chunked_name(false))
+      continue;
+    tuning.chunked = chunked_field == chunked_name(true);
+
+    m_tunings[trim(key)] = tuning;
+  }
+}
+
+std::optional<Tuning> Wisdom::find(const std::string& key) const
+{
+  const auto it = m_tunings.find(key);
+  if(it == m_tunings.end())
+    return std::nullopt;
+  return it->second;
+}
+
+void Wisdom::insert(const std::string& key, Tuning tuning)
+{
+  m_tunings[key] = tuning;
+}
+
+bool Wisdom::save() const
+{
+  // written next to the file and renamed, so that readers never see half of it
+  const std::filesystem::path path = m_path;
+  const std::filesystem::path temporary
+      = m_path + ".tmp" + std::to_string(std::random_device{}());
+
+  std::error_code error;
+  if(path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path(), error);
+
+  {
+    std::ofstream file(temporary);
+    for(const auto& [key, tuning] : m_tunings)
+      file << chunked_name(tuning.chunked) << ' ' << key << '\n';
+    if(!file.flush())
+    {
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(temporary, path, error);
+  if(error)
+  {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+Tuning apply_wisdom(
+    DSP& dsp, const Parameters<float>& params, uint32_t block_size,
+    const std::string& path)
+{
+  Wisdom wisdom(path);
+  const std::string key = tuning_key(dsp, params, block_size);
+
+  std::optional<Tuning> tuning = wisdom.find(key);
+  if(!tuning)
+  {
+    tuning = autotune(dsp, params, block_size);
+    wisdom.insert(key, *tuning);
+    wisdom.save();
+  }
+
+  dsp.set_chunked(tuning->chunked);
+  return *tuning;
+}
+}
@@ -0,0 +1,71 @@
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include "parameters.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace Aether
+{
+class DSP;
+
+/*
+    Autotuning of the processing, like the wisdom of FFTW
+
+    The chunked processing of the blocks without smoothing, see
+    DSP::set_chunked, does not change the output. Whether it is faster
+    depends on the processor, the sample rate, the block size and the
+    number of delay lines, diffusion stages and taps. autotune measures
+    both ways on a DSP with the same configuration,
+    Wisdom keeps the fastest one in a file, keyed by the processor model
+    and the configuration, so that it is only measured on the first run.
+*/
+struct Tuning
+{
+  bool chunked = true;
+};
+
+// the processor model and the configuration of 'dsp' with 'params'
+std::string
+tuning_key(const DSP& dsp, const Parameters<float>& params, uint32_t block_size);
+
+/*
+    Measures the candidates on a DSP configured like 'dsp' with 'params'.
+    Takes a few hundred blocks.
+*/
+Tuning autotune(const DSP& dsp, const Parameters<float>& params, uint32_t block_size);
+
+class Wisdom
+{
+public:
+  // AETHER_WISDOM if set, else aether/wisdom in XDG_CACHE_HOME or ~/.cache
+  static std::string default_path();
+
+  // empty if the file does not exist or cannot be read
+  explicit Wisdom(std::string path = default_path());
+
+  std::optional<Tuning> find(const std::string& key) const;
+  void insert(const std::string& key, Tuning tuning);
+
+  // replaces the file, returns false if it cannot be written
+  bool save() const;
+
+private:
+  std::string m_path;
+  std::map<std::string, Tuning> m_tunings;
+};
+
+/*
+    Applies the tuning for 'dsp' with 'params' from the wisdom at 'path',
+    after autotuning and saving it if it is missing. For prepare(), not
+    for the audio thread.
+*/
+Tuning apply_wisdom(
+    DSP& dsp, const Parameters<float>& params, uint32_t block_size,
+    const std::string& path = Wisdom::default_path());
+}
+
+#endif
@@ -0,0 +1,279 @@
+#include "batch.hpp"
+
+#include "kernels.hpp"
+#include "rt_sanitizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace Aether
+{
+template <uint32_t Lanes>
+DSPBatch<Lanes>::DSPBatch(float rate, uint32_t channels, uint32_t max_block, uint32_t seed)
+    : m_late{std::make_unique<LateLanes<Lanes>>()}
+    , m_max_block{max_block}
+    , m_buffers(size_t{2} * Lanes * channels * max_block)
+{
+  assert(max_block > 0);
+  for(uint32_t k = 0; k < Lanes; ++k)
+    m_lanes[k] = std::make_unique<DSP>(rate, channels, seed + k);
+
+  float* buffer = m_buffers.data();
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      m_inputs[k][ch] = buffer;
+      m_outputs[k][ch] = buffer + max_block;
+      buffer += 2 * max_block;
+    }
+  }
+}
+
+template <uint32_t Lanes>
+void DSPBatch<Lanes>::operator()(
+    const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept
+{
+  [[maybe_unused]] RealtimeScope realtime;
+
+  const uint32_t channels = m_lanes[0]->channels();
+  for(uint32_t start = 0; start < n_samples; start += m_max_block)
+  {
+    const uint32_t n = std::min(m_max_block, n_samples - start);
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      const float* in = inputs[ch] + size_t{start} * Lanes;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        for(uint32_t k = 0; k < Lanes; ++k)
+          m_inputs[k][ch][i] = in[i * Lanes + k];
+      }
+    }
+
+    process(n);
+
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      float* out = outputs[ch] + size_t{start} * Lanes;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        for(uint32_t k = 0; k < Lanes; ++k)
+          out[i * Lanes + k] = m_outputs[k][ch][i];
+      }
+    }
+  }
+}
+
+template <uint32_t Lanes>
+void DSPBatch<Lanes>::process(uint32_t n_samples) noexcept
+{
+  // the statistics are measured on the whole batch
+  using clock = std::chrono::steady_clock;
+  Lane<bool> silent_inputs = {};
+  bool stats = false;
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    if(m_lanes[k]->m_stats)
+    {
+      stats = true;
+      silent_inputs[k] = m_lanes[k]->silent(m_inputs[k].data(), n_samples);
+    }
+  }
+  const auto start = stats ? clock::now() : clock::time_point{};
+
+  Lane<uint32_t> variants;
+  Lane<uint32_t> late_samples;
+  Lane<bool> metering = {};
+
+  // the lanes that smooth a parameter are processed on their own
+  Lane<uint32_t> settled;
+  uint32_t settled_count = 0;
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    DSP& dsp = *m_lanes[k];
+    late_samples[k] = static_cast<uint32_t>(
+        dsp.m_channels[0].late_resampler.reduced_samples(n_samples));
+    variants[k] = dsp.prepare_block();
+
+    if(variant_flag(variants[k], 2))
+    {
+      settled[settled_count++] = k;
+      metering[k] = dsp.begin_metering();
+      continue;
+    }
+
+    (dsp.*DSP::select_kernel(variants[k]))(
+        m_inputs[k].data(), m_outputs[k].data(), n_samples);
+    dsp.finish_block(n_samples, late_samples[k]);
+  }
+
+  // the lanes that skip their late stage keep a zeroed late chunk
+  Lane<uint32_t> late;
+  uint32_t late_count = 0;
+  for(uint32_t i = 0; i < settled_count; ++i)
+  {
+    if(m_lanes[settled[i]]->m_stages & DSP::late_stage)
+      late[late_count++] = settled[i];
+  }
+
+  // the kernels only change between blocks
+  const uint32_t channels = m_lanes[0]->channels();
+  std::array<Lane<Group>, DSP::max_channels> groups;
+  std::array<uint32_t, DSP::max_channels> group_counts;
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    group_counts[ch] = group(late, late_count, ch, groups[ch]);
+
+  for(uint32_t start = 0; start < n_samples; start += chunk_size)
+  {
+    const uint32_t n = std::min(chunk_size, n_samples - start);
+
+    for(uint32_t i = 0; i < settled_count; ++i)
+    {
+      const uint32_t k = settled[i];
+      DSP& dsp = *m_lanes[k];
+      (dsp.*DSP::select_early_kernel(variants[k]))(
+          m_inputs[k].data(), start, n);
+    }
+
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      for(uint32_t g = 0; g < group_counts[ch]; ++g)
+        process_late(groups[ch][g], ch, n);
+    }
+
+    for(uint32_t i = 0; i < settled_count; ++i)
+    {
+      const uint32_t k = settled[i];
+      m_lanes[k]->mix_chunk(m_outputs[k].data(), start, n, metering[k]);
+    }
+  }
+
+  for(uint32_t i = 0; i < settled_count; ++i)
+  {
+    const uint32_t k = settled[i];
+    m_lanes[k]->finish_block(n_samples, late_samples[k]);
+  }
+
+  if(stats)
+  {
+    const auto end = clock::now();
+    const auto time = std::chrono::nanoseconds(end - start).count();
+    const auto now = std::chrono::nanoseconds(end.time_since_epoch()).count();
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      if(m_lanes[k]->m_stats)
+        m_lanes[k]->publish_stats(
+            silent_inputs[k], m_outputs[k].data(), n_samples,
+            static_cast<uint64_t>(time) / Lanes, static_cast<uint64_t>(now));
+    }
+  }
+}
+
+template <uint32_t Lanes>
+void DSPBatch<Lanes>::set_late_decimation(uint32_t factor)
+{
+  for(auto& dsp : m_lanes)
+    dsp->set_late_decimation(factor);
+}
+
+template <uint32_t Lanes>
+uint32_t DSPBatch<Lanes>::group(
+    const Lane<uint32_t>& settled, uint32_t settled_count, uint32_t channel,
+    Lane<Group>& groups) const noexcept
+{
+  // the resamplers also have to be in step
+  auto same = [&](uint32_t a, uint32_t b) {
+    const DSP::Channel& x = m_lanes[a]->m_channels[channel];
+    const DSP::Channel& y = m_lanes[b]->m_channels[channel];
+    return x.late_resampler.factor() == y.late_resampler.factor()
+        && x.late_resampler.phase() == y.late_resampler.phase()
+        && LateLanes<Lanes>::compatible(x.late_rev, y.late_rev);
+  };
+
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < settled_count; ++i)
+  {
+    const uint32_t k = settled[i];
+    auto it = std::find_if(groups.begin(), groups.begin() + count, [&](const Group& g) {
+      return same(g.lanes[0], k);
+    });
+    if(it == groups.begin() + count)
+    {
+      it->count = 0;
+      ++count;
+    }
+    it->lanes[it->count++] = k;
+  }
+  return count;
+}
+
+template <uint32_t Lanes>
+void DSPBatch<Lanes>::process_late(
+    const Group& group, uint32_t channel, uint32_t n) noexcept
+{
+  auto dsp_of = [&](uint32_t i) -> DSP& { return *m_lanes[group.lanes[i]]; };
+  auto channel_of = [&](uint32_t i) -> DSP::Channel& {
+    return dsp_of(i).m_channels[channel];
+  };
+  auto derived_of = [&](uint32_t i) -> const DSP::LateRev::Derived& {
+    return dsp_of(i).m_derived->channels[channel].late_rev;
+  };
+  auto feedback_of = [&](uint32_t i) {
+    return dsp_of(i).params.late_diffusion_feedback;
+  };
+
+  if(group.count == 1)
+  {
+    DSP::Channel& c = channel_of(0);
+    c.process_late(
+        derived_of(0), c.early_chunk.data(), c.late_chunk.data(), n, feedback_of(0));
+    return;
+  }
+
+  Lane<DSP::LateRev*> late = {};
+  Lane<const DSP::LateRev::Derived*> derived = {};
+  Lane<const float*> input = {};
+  Lane<float*> output = {};
+  Lane<float> feedback = {};
+  for(uint32_t i = 0; i < group.count; ++i)
+  {
+    DSP::Channel& c = channel_of(i);
+    late[i] = &c.late_rev;
+    derived[i] = &derived_of(i);
+    input[i] = c.early_chunk.data();
+    output[i] = c.late_chunk.data();
+    feedback[i] = feedback_of(i);
+  }
+
+  if(channel_of(0).late_resampler.factor() == 1)
+  {
+    m_late->process(late, derived, group.count, input, output, n, feedback);
+    return;
+  }
+
+  // the resamplers are in step, so all lanes have the same reduced samples
+  Lane<std::array<float, chunk_size>> reduced;
+  Lane<std::array<bool, chunk_size>> ready;
+  uint32_t reduced_samples = 0;
+  for(uint32_t i = 0; i < group.count; ++i)
+  {
+    reduced_samples = channel_of(i).decimate_late(
+        input[i], n, reduced[i].data(), ready[i].data());
+    input[i] = output[i] = reduced[i].data();
+  }
+
+  if(reduced_samples > 0)
+    m_late->process(late, derived, group.count, input, output, reduced_samples, feedback);
+
+  for(uint32_t i = 0; i < group.count; ++i)
+  {
+    DSP::Channel& c = channel_of(i);
+    c.interpolate_late(reduced[i].data(), ready[i].data(), c.late_chunk.data(), n);
+  }
+}
+
+template class DSPBatch<4>;
+template class DSPBatch<8>;
+template class DSPBatch<16>;
+}
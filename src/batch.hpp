@@ -0,0 +1,95 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "aether_dsp.hpp"
+#include "late_lanes.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace Aether
+{
+/*
+    Processes Lanes instances of DSP with the same sample rate and
+    channel count at once, for hosts running many instances on the same
+    blocks, like the reverbs of several send busses
+
+    The buffers interleave the lanes: every channel holds frames of
+    Lanes samples, one per instance. Every instance keeps its own
+    parameters and state and can be used like any other DSP through
+    lane(). The late reverberations of the instances whose parameters
+    are settled and which run the same late kernels are processed
+    together with one instance per lane, their state laid out as arrays
+    with one element per lane, see LateLanes. Everything else is
+    processed one instance after the other.
+
+    Blocks longer than 'max_block' are processed in parts of that
+    length. The output is the same as processing the instances one by
+    one on blocks of at most 'max_block' samples.
+*/
+template <uint32_t Lanes>
+class DSPBatch
+{
+  static_assert(Lanes == 4 || Lanes == 8 || Lanes == 16);
+
+public:
+  // the seeds of the lanes count up from 'seed'
+  explicit DSPBatch(
+      float rate, uint32_t channels = 2, uint32_t max_block = 1024,
+      uint32_t seed = std::random_device{}());
+
+  DSP& lane(uint32_t lane) noexcept { return *m_lanes[lane]; }
+  const DSP& lane(uint32_t lane) const noexcept { return *m_lanes[lane]; }
+
+  /*
+      inputs and outputs hold one buffer per channel, with sample i of
+      lane k at i * Lanes + k. The outputs may be the inputs.
+  */
+  void operator()(
+      const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept;
+
+  // see DSP::set_late_decimation, for all lanes
+  void set_late_decimation(uint32_t factor);
+
+private:
+  template <class T>
+  using Lane = std::array<T, Lanes>;
+  using Channels = std::array<float*, DSP::max_channels>;
+
+  // lanes whose late reverberations are processed together
+  struct Group
+  {
+    Lane<uint32_t> lanes;
+    uint32_t count = 0;
+  };
+
+  // all lanes on at most m_max_block samples of the planar buffers
+  void process(uint32_t n_samples) noexcept;
+
+  // groups the lanes in 'settled' by their late reverberations of 'channel'
+  uint32_t group(
+      const Lane<uint32_t>& settled, uint32_t settled_count, uint32_t channel,
+      Lane<Group>& groups) const noexcept;
+
+  // Channel::process_late of 'channel' of every lane in 'group'
+  void process_late(const Group& group, uint32_t channel, uint32_t n) noexcept;
+
+  std::array<std::unique_ptr<DSP>, Lanes> m_lanes;
+  std::unique_ptr<LateLanes<Lanes>> m_late;
+
+  // the planar buffers of the lanes, one of m_max_block samples per channel
+  uint32_t m_max_block;
+  std::vector<float> m_buffers;
+  Lane<Channels> m_inputs = {};
+  Lane<Channels> m_outputs = {};
+};
+
+extern template class DSPBatch<4>;
+extern template class DSPBatch<8>;
+extern template class DSPBatch<16>;
+}
+
+#endif
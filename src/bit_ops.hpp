@@ -51,6 +51,12 @@ constexpr int countr_zero(T x)
 {
   return std::countr_zero(static_cast<std::make_unsigned_t<T>>(x));
 }
+
+template <class T>
+constexpr int popcount(T x)
+{
+  return std::popcount(static_cast<std::make_unsigned_t<T>>(x));
+}
 #else
 template <class T>
 constexpr int countr_zero(T x)
@@ -63,6 +69,15 @@ constexpr int countr_zero(T x)
   }
   return count;
 }
+
+template <class T>
+constexpr int popcount(T x)
+{
+  int count = 0;
+  for(; x; x &= x - 1)
+    ++count;
+  return count;
+}
 #endif
 }
 
@@ -0,0 +1,94 @@
+#ifndef CAPACITY_HPP
+#define CAPACITY_HPP
+
+#include "parameters.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace Aether
+{
+/*
+    The compile-time capacity of the processing stages
+
+    The stage classes take a capacity as their last template parameter,
+    which sizes their fixed arrays and buffers. The random values of the
+    stages are still drawn for DefaultCapacity, so that a smaller capacity
+    sounds the same as the default one within its limits.
+
+    Delays are in seconds.
+*/
+struct DefaultCapacity
+{
+  // late delay lines
+  static constexpr uint32_t lines = 12;
+  // allpass stages of every diffuser
+  static constexpr uint32_t stages = 8;
+  // taps of the early multitap delay
+  static constexpr uint32_t taps = 50;
+
+  static constexpr float predelay = 0.5f;
+  static constexpr float tap_length = 0.5f;
+  // the delay of a late line is up to 1.5 times the late delay
+  static constexpr float line_delay = 1.5f;
+  static constexpr float line_mod = 0.05f;
+  static constexpr float allpass_delay = 0.1f;
+  static constexpr float allpass_mod = 0.003f;
+};
+
+/*
+    A small-footprint capacity for embedded targets with 4 late lines,
+    4 diffusion stages and delays of up to 250ms, which takes about a
+    seventh of the memory of DefaultCapacity
+*/
+struct CompactCapacity : DefaultCapacity
+{
+  static constexpr uint32_t lines = 4;
+  static constexpr uint32_t stages = 4;
+
+  static constexpr float predelay = 0.25f;
+  static constexpr float tap_length = 0.25f;
+  static constexpr float line_delay = 0.375f;
+};
+
+// the capacity the DSP is built with
+#if defined(AETHER_COMPACT)
+using EngineCapacity = CompactCapacity;
+#else
+using EngineCapacity = DefaultCapacity;
+#endif
+
+// parameter_infos with the ranges and defaults limited to what Capacity holds
+template <class Capacity>
+constexpr Parameters<ParameterInfo> capacity_parameter_infos() noexcept
+{
+  Parameters<ParameterInfo> infos = parameter_infos;
+  auto limit = [](ParameterInfo& info, float max) {
+    info.max = std::min(info.max, max);
+    info.dflt = std::min(info.dflt, info.max);
+  };
+
+  limit(infos.predelay, 1000.f * Capacity::predelay);
+  limit(infos.early_taps, static_cast<float>(Capacity::taps));
+  limit(infos.early_tap_length, 1000.f * Capacity::tap_length);
+  limit(infos.early_diffusion_stages, static_cast<float>(Capacity::stages));
+  limit(infos.early_diffusion_delay, 1000.f * Capacity::allpass_delay);
+  limit(infos.early_diffusion_mod_depth, 1000.f * Capacity::allpass_mod);
+  limit(infos.late_delay_lines, static_cast<float>(Capacity::lines));
+  limit(infos.late_delay, 1000.f * Capacity::line_delay / 1.5f);
+  limit(infos.late_delay_mod_depth, 1000.f * Capacity::line_mod);
+  limit(infos.late_diffusion_stages, static_cast<float>(Capacity::stages));
+  limit(infos.late_diffusion_delay, 1000.f * Capacity::allpass_delay);
+  limit(infos.late_diffusion_mod_depth, 1000.f * Capacity::allpass_mod);
+  return infos;
+}
+
+inline constexpr Parameters<ParameterInfo> engine_parameter_infos
+    = capacity_parameter_infos<EngineCapacity>();
+
+static_assert(
+    engine_parameter_infos.late_delay_lines.max >= 1
+        && engine_parameter_infos.early_taps.max >= 1,
+    "the capacity must hold at least one late line and one tap");
+}
+#endif
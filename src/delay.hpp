@@ -1,12 +1,14 @@
 #ifndef DELAY_HPP
 #define DELAY_HPP
 
+#include "capacity.hpp"
 #include "lfo.hpp"
 #include "random.hpp"
 #include "ringbuffer.hpp"
 
 #include <cmath>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef>
@@ -18,6 +20,7 @@ namespace Aether
 /*
     A basic tap delay
 */
+template <class Capacity = DefaultCapacity>
 class Delay
 {
 public:
@@ -38,13 +41,19 @@ public:
     m_buf.push(sample);
 
     auto idx = m_buf.end - delay + (m_buf.end < delay ? m_buf.size : 0);
-    return m_buf.buf[idx];
+    return m_buf[idx];
   }
 
   void clear() noexcept { m_buf.clear(); }
 
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_buf);
+  }
+
   // maximum delay in seconds
-  static constexpr float max_delay = 0.5f;
+  static constexpr float max_delay = Capacity::predelay;
 
 private:
   Ringbuffer<float> m_buf;
@@ -52,11 +61,46 @@ private:
 
 /*
     A tap delay with a modulated delay length
+
+    The samples are stored as Storage, see Ringbuffer. The delay, the
+    mod depth and the mod rate are the derived state, which is kept apart
+    in Derived and passed to the processing.
 */
-template <class FpType>
+template <class FpType, class Storage = FpType, class Capacity = DefaultCapacity>
 class ModulatedDelay
 {
 public:
+  class Derived
+  {
+  public:
+    void set_delay(float delay) noexcept { m_delay = delay; }
+    void set_mod_depth(float mod_depth) noexcept { m_mod_depth = mod_depth; }
+    void set_mod_rate(float mod_rate) noexcept { m_mod_rate = LFO::Rate(mod_rate); }
+
+    float delay() const noexcept { return std::max(m_delay, 0.f); }
+    float mod_depth() const noexcept { return m_mod_depth; }
+
+    /*
+        Splits push in two for chunks of up to lookahead() samples: every
+        sample a chunk reads has been pushed before the chunk. read returns
+        what push would return for the next 'n' samples, which write pushes
+        afterwards.
+    */
+    uint32_t lookahead() const noexcept
+    {
+      return static_cast<uint32_t>(std::max(m_delay - m_mod_depth, 0.f));
+    }
+
+  private:
+    friend class ModulatedDelay;
+    template <uint32_t>
+    friend class LateLanes;
+
+    float m_delay = 0.f;
+    float m_mod_depth = 0.f;
+    LFO::Rate m_mod_rate;
+  };
+
   ModulatedDelay(float sample_rate, float phase)
       : m_buf{static_cast<size_t>((max_delay + max_mod) * sample_rate) + 1}
       , m_lfo(phase)
@@ -67,26 +111,34 @@ public:
   ModulatedDelay(ModulatedDelay&&) noexcept = default;
   ModulatedDelay& operator=(ModulatedDelay&&) noexcept = default;
 
-  void set_delay(float delay) noexcept
+  void skip_modulation(const Derived& d, uint64_t samples) noexcept
   {
-    assert(static_cast<size_t>(m_mod_depth + m_delay) < m_buf.size);
-    m_delay = delay;
+    m_lfo.skip(d.m_mod_rate, samples);
   }
-  void set_mod_depth(float mod_depth) noexcept
-  {
-    assert(static_cast<size_t>(m_mod_depth + m_delay) < m_buf.size);
-    m_mod_depth = mod_depth;
-  }
-  void set_mod_rate(float mod_rate) noexcept { m_lfo.set_rate(mod_rate); }
 
   void clear() noexcept { m_buf.clear(); }
 
-  FpType push(FpType sample) noexcept
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_buf, m_lfo);
+  }
+
+  // the delay is constant unless Modulated is set
+  template <bool Modulated>
+  FpType push(const Derived& d, FpType sample) noexcept
   {
+    assert(static_cast<size_t>(d.m_mod_depth + d.m_delay) < m_buf.size);
+    assert(Modulated || d.m_mod_depth == 0.f);
+
     m_buf.push(sample);
 
-    float delay = std::max(m_delay + m_mod_depth * m_lfo.depth(), 0.f);
-    m_lfo.next();
+    float delay = std::max(d.m_delay, 0.f);
+    if constexpr(Modulated)
+    {
+      delay = std::max(d.m_delay + d.m_mod_depth * m_lfo.depth(), 0.f);
+      m_lfo.next(d.m_mod_rate);
+    }
 
     uint32_t delay_floor = static_cast<uint32_t>(delay);
     FpType t = static_cast<FpType>(delay - static_cast<float>(delay_floor));
@@ -94,127 +146,180 @@ public:
     size_t idx1 = m_buf.end - delay_floor + (m_buf.end < delay_floor ? m_buf.size : 0);
     size_t idx2 = idx1 - 1 + (idx1 < 1 ? m_buf.size : 0);
 
-    return m_buf.buf[idx1] + t * (m_buf.buf[idx2] - m_buf.buf[idx1]);
+    return m_buf[idx1] + t * (m_buf[idx2] - m_buf[idx1]);
+  }
+
+  // see Derived::lookahead
+  template <bool Modulated>
+  void read(const Derived& d, FpType* out, uint32_t n) noexcept
+  {
+    assert(Modulated || d.m_mod_depth == 0.f);
+    assert(n <= d.lookahead());
+
+    // the i-th sample reads relative to the end of the buffer after pushing it
+    const size_t end = m_buf.end;
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      float delay = std::max(d.m_delay, 0.f);
+      if constexpr(Modulated)
+      {
+        delay = std::max(d.m_delay + d.m_mod_depth * m_lfo.depth(), 0.f);
+        m_lfo.next(d.m_mod_rate);
+      }
+
+      uint32_t delay_floor = static_cast<uint32_t>(delay);
+      FpType t = static_cast<FpType>(delay - static_cast<float>(delay_floor));
+
+      size_t back = delay_floor - i - 1;
+      size_t idx1 = end - back + (end < back ? m_buf.size : 0);
+      size_t idx2 = idx1 - 1 + (idx1 < 1 ? m_buf.size : 0);
+
+      out[i] = m_buf[idx1] + t * (m_buf[idx2] - m_buf[idx1]);
+    }
+  }
+
+  void write(const FpType* samples, uint32_t n) noexcept
+  {
+    for(uint32_t i = 0; i < n; ++i)
+      m_buf.push(samples[i]);
   }
 
   // maximum in seconds
-  static constexpr float max_delay = 1.5f;
-  static constexpr float max_mod = 0.05f;
+  static constexpr float max_delay = Capacity::line_delay;
+  static constexpr float max_mod = Capacity::line_mod;
 
 private:
-  Ringbuffer<FpType> m_buf;
-  LFO m_lfo;
+  template <uint32_t>
+  friend class LateLanes;
 
-  float m_delay = 0.f;
-  float m_mod_depth = 0.f;
+  Ringbuffer<FpType, Storage> m_buf;
+  LFO m_lfo;
 };
 
 /*
     A single delaybuffer with multiple delay taps
+
+    The tap delays and gains are the derived state, which is kept apart
+    in Derived and passed to push. Its setters only store their value,
+    the taps are recomputed by the generate functions.
 */
+template <class Capacity = DefaultCapacity>
 class MultitapDelay
 {
+  // the random values are drawn for the default number of taps
+  static constexpr uint32_t rand_taps = DefaultCapacity::taps;
+
 public:
-  MultitapDelay(float rate);
+  static constexpr uint32_t max_taps = Capacity::taps;
+  static constexpr float max_length = Capacity::tap_length;
+  static_assert(max_taps <= rand_taps);
+
+  class Derived
+  {
+  public:
+    Derived() noexcept;
+
+    void set_seed(uint32_t seed) noexcept { m_seed = seed; }
+    void set_seed_crossmix(float crossmix) noexcept { m_crossmix = crossmix; }
+    void set_decay(float decay) noexcept { m_decay = decay; }
+
+    void generate_rand() noexcept;
+    void generate_tap_delays() noexcept;
+    void generate_tap_gains() noexcept;
+
+  private:
+    friend class MultitapDelay;
+
+    std::array<float, max_taps> m_tap_gain = {};
+    std::array<float, max_taps> m_tap_delay = {};
+
+    std::array<float, 2 * rand_taps> m_rand_vals = {};
+
+    float m_decay = 0.5f;
+    uint32_t m_seed = 0;
+    float m_crossmix = 0.5f;
+  };
+
+  explicit MultitapDelay(float rate);
   MultitapDelay(const MultitapDelay&) = delete;
   MultitapDelay& operator=(const MultitapDelay&) = delete;
   MultitapDelay(MultitapDelay&&) noexcept = default;
   MultitapDelay& operator=(MultitapDelay&&) noexcept = default;
 
-  void set_seed(uint32_t seed) noexcept;
-  void set_seed_crossmix(float crossmix) noexcept;
-  void set_decay(float decay) noexcept;
-
-  float push(float sample, uint32_t taps, float length);
+  float push(const Derived& d, float sample, uint32_t taps, float length);
 
   void clear() noexcept { m_buf.clear(); }
 
-  static constexpr uint32_t max_taps = 50;
-  static constexpr float max_length = 0.5f;
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_buf);
+  }
 
 private:
   Ringbuffer<float> m_buf;
-
-  std::array<float, max_taps> m_tap_gain = {};
-  std::array<float, max_taps> m_tap_delay = {};
-
-  std::array<float, 2 * max_taps> m_rand_vals = {};
-
-  float m_decay = 0.5f;
-  uint32_t m_seed = 0;
-  float m_crossmix = 0.5f;
-
-  void generate_tap_delays() noexcept;
-  void generate_tap_gains() noexcept;
 };
 
-inline MultitapDelay::MultitapDelay(float rate)
+template <class Capacity>
+inline MultitapDelay<Capacity>::MultitapDelay(float rate)
     : m_buf{static_cast<size_t>(max_length * rate) + 1}
 {
-  Random::generate(m_rand_vals, m_seed, m_crossmix);
-  generate_tap_delays();
-  generate_tap_gains();
 }
 
-inline float MultitapDelay::push(float sample, uint32_t taps, float length)
+template <class Capacity>
+inline float MultitapDelay<Capacity>::push(
+    const Derived& d, float sample, uint32_t taps, float length)
 {
   assert(static_cast<size_t>(length) < m_buf.size);
   assert(taps <= max_taps);
 
   m_buf.push(sample);
 
-  const float delay_coef = length / m_tap_delay[taps - 1];
+  const float delay_coef = length / d.m_tap_delay[taps - 1];
   float output = 0.f;
   for(uint32_t i = 0; i < taps; ++i)
   {
-    uint32_t delay = static_cast<uint32_t>(m_tap_delay[i] * delay_coef);
+    uint32_t delay = static_cast<uint32_t>(d.m_tap_delay[i] * delay_coef);
     size_t idx = m_buf.end - delay + (m_buf.end < delay ? m_buf.size : 0);
-    output += m_tap_gain[i] * m_buf.buf[idx];
+    output += d.m_tap_gain[i] * m_buf[idx];
   }
 
   // adjust the loudness depending on the number of taps
-  const float adjust = 0.35f + 0.21f * max_taps / static_cast<float>(20 + taps);
+  const float adjust = 0.35f + 0.21f * rand_taps / static_cast<float>(20 + taps);
   return output * adjust;
 }
 
-inline void MultitapDelay::set_seed(uint32_t seed) noexcept
+template <class Capacity>
+inline MultitapDelay<Capacity>::Derived::Derived() noexcept
 {
-  m_seed = seed;
-
-  Random::generate(m_rand_vals, m_seed, m_crossmix);
+  generate_rand();
   generate_tap_delays();
   generate_tap_gains();
 }
 
-inline void MultitapDelay::set_seed_crossmix(float crossmix) noexcept
+template <class Capacity>
+inline void MultitapDelay<Capacity>::Derived::generate_rand() noexcept
 {
-  m_crossmix = crossmix;
-
   Random::generate(m_rand_vals, m_seed, m_crossmix);
-  generate_tap_delays();
-  generate_tap_gains();
-}
-
-inline void MultitapDelay::set_decay(float decay) noexcept
-{
-  m_decay = decay;
-
-  generate_tap_gains();
 }
 
-inline void MultitapDelay::generate_tap_delays() noexcept
+template <class Capacity>
+inline void MultitapDelay<Capacity>::Derived::generate_tap_delays() noexcept
 {
   std::partial_sum(
       m_rand_vals.begin(), m_rand_vals.begin() + max_taps, m_tap_delay.begin());
 }
 
-inline void MultitapDelay::generate_tap_gains() noexcept
+template <class Capacity>
+inline void MultitapDelay<Capacity>::Derived::generate_tap_gains() noexcept
 {
+  // the delay of the last of rand_taps taps, summed like the tap delays
+  const float length
+      = std::accumulate(m_rand_vals.begin(), m_rand_vals.begin() + rand_taps, 0.f);
   for(size_t tap = 0; tap < m_tap_gain.size(); ++tap)
   {
-    float gain
-        = std::exp(-4.f * m_decay * m_tap_delay[tap] / (m_tap_delay.back() + 1.f));
-    m_tap_gain[tap] = gain * m_rand_vals[max_taps + tap];
+    float gain = std::exp(-4.f * m_decay * m_tap_delay[tap] / (length + 1.f));
+    m_tap_gain[tap] = gain * m_rand_vals[rand_taps + tap];
   }
 }
 }
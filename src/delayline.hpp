@@ -5,15 +5,37 @@
 #include "delay.hpp"
 #include "diffuser.hpp"
 #include "filters.hpp"
+#include "kernels.hpp"
+#include "math.hpp"
 #include "random.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <random>
+#include <utility>
 
 namespace Aether
 {
+/*
+    Storage of the late reverberation buffers, which take up most of the
+    memory. The processing is done in double precision regardless.
+
+    Compared to double, float storage stays below -140dB relative to the
+    output peak. The opt-in bfloat16 storage halves the memory again, but
+    errors reach about -60dB, which can be audible on sparse material.
+*/
+#if defined(AETHER_LATE_STORAGE_DOUBLE)
+using LateStorage = double;
+#elif defined(AETHER_LATE_STORAGE_BFLOAT16)
+using LateStorage = BFloat16;
+#else
+using LateStorage = float;
+#endif
+
+template <class Capacity = DefaultCapacity>
 class Delayline
 {
 public:
@@ -32,21 +54,54 @@ public:
       bool hc_enable;
     };
 
-    Filters(double rate)
-        : ls(rate)
-        , hs(rate)
-        , hc(rate)
+    // the derived state of the filters
+    struct Coefficients
     {
-    }
+      explicit Coefficients(double rate)
+          : ls(rate)
+          , hs(rate)
+          , hc(rate)
+      {
+      }
+
+      // the largest gain of the enabled filters from 20Hz to 20kHz, or up
+      // to close to the Nyquist frequency of 'rate'
+      double max_gain(PushInfo info, double rate) const noexcept
+      {
+        static constexpr uint32_t points = 32;
+        const double low = 20.;
+        const double high = std::min(20000., 0.49 * rate);
+
+        double max_gain = 0.;
+        for(uint32_t i = 0; i < points; ++i)
+        {
+          const double frequency = low * std::pow(high / low, i / (points - 1.));
+          double gain = 1.;
+          if(info.ls_enable)
+            gain *= ls.magnitude(frequency);
+          if(info.hs_enable)
+            gain *= hs.magnitude(frequency);
+          if(info.hc_enable)
+            gain *= hc.magnitude(frequency);
+          max_gain = std::max(max_gain, gain);
+        }
+        return max_gain;
+      }
+
+      typename Lowshelf<double>::Coefficients ls;
+      typename Highshelf<double>::Coefficients hs;
+      typename Lowpass6dB<double>::Coefficients hc;
+    };
 
-    double push(double sample, PushInfo info) noexcept
+    template <bool LowShelf, bool HighShelf, bool HighCut>
+    double push(const Coefficients& c, double sample) noexcept
     {
-      if(info.ls_enable)
-        sample = ls.push(sample);
-      if(info.hs_enable)
-        sample = hs.push(sample);
-      if(info.hc_enable)
-        sample = hc.push(sample);
+      if constexpr(LowShelf)
+        sample = ls.push(c.ls, sample);
+      if constexpr(HighShelf)
+        sample = hs.push(c.hs, sample);
+      if constexpr(HighCut)
+        sample = hc.push(c.hc, sample);
       return sample;
     }
 
@@ -57,20 +112,71 @@ public:
       hc.clear();
     }
 
+    template <class Archive>
+    void serialize(Archive& ar)
+    {
+      ar(ls, hs, hc);
+    }
+
     Lowshelf<double> ls;
     Highshelf<double> hs;
     Lowpass6dB<double> hc;
   };
 
+  using Delay = ModulatedDelay<double, LateStorage, Capacity>;
+  using Diffuser = AllpassDiffuser<double, LateStorage, Capacity>;
+
+  // settings that stay constant for a block
   struct PushInfo
   {
     Order order;
-    AllpassDiffuser<double>::PushInfo diffuser_info;
-    Filters::PushInfo damping_info;
+    // whether the delay mod depth may be nonzero during the block
+    bool modulated;
+    typename Diffuser::PushInfo diffuser_info;
+    typename Filters::PushInfo damping_info;
+  };
+
+  // the derived state of a line, passed to the processing
+  struct Derived
+  {
+    explicit Derived(float rate)
+        : damping(static_cast<double>(rate))
+    {
+    }
+
+    void set_feedback(float value) noexcept { feedback = static_cast<double>(value); }
+
+    /*
+        Samples until the response of the line has decayed by 'gain'.
+        Every round trip through the delay and the diffuser, which does not
+        change the magnitude, is damped by the feedback and the filters,
+        the diffuser stages ring out within the round trips. Around the
+        resonances of the diffuser a round trip lasts up to its largest
+        group delay, so these frequencies decay the slowest.
+    */
+    double tail_length(
+        float diffusion_feedback, typename Filters::PushInfo damping_info, double rate,
+        double gain) const noexcept
+    {
+      const double loop_gain = feedback * damping.max_gain(damping_info, rate);
+      const double line_delay = static_cast<double>(delay.delay() + delay.mod_depth());
+      const double loop_delay = line_delay + diffuser.delay();
+      const double slowest_loop
+          = line_delay + diffuser.max_group_delay(diffusion_feedback);
+      return loop_delay
+           + std::max(
+               diffuser.decay_time(diffusion_feedback, gain),
+               math::decay_time(slowest_loop, loop_gain, gain));
+    }
+
+    typename Delay::Derived delay;
+    typename Diffuser::Derived diffuser;
+    typename Filters::Coefficients damping;
+    double feedback = 0;
   };
 
-  ModulatedDelay<double> delay;
-  AllpassDiffuser<double> diffuser;
+  Delay delay;
+  Diffuser diffuser;
   Filters damping;
 
   // Member Functions
@@ -79,34 +185,66 @@ public:
   Delayline(float rate, RNG& rng)
       : delay(rate, std::uniform_real_distribution<float>{0.f, 1.f}(rng))
       , diffuser(rate, rng)
-      , damping(static_cast<double>(rate))
   {
   }
 
-  void set_feedback(float feedback) { m_feedback = static_cast<double>(feedback); }
-
-  double push(double sample, PushInfo info)
+  // the diffuser kernel is selected by diffuser.begin_block
+  template <Order order, bool LowShelf, bool HighShelf, bool HighCut, bool Modulated>
+  double push(const Derived& d, double sample, float diffusion_feedback) noexcept
   {
-    m_last_out = damping.push(m_last_out, info.damping_info);
+    m_last_out = damping.template push<LowShelf, HighShelf, HighCut>(d.damping, m_last_out);
 
-    sample += m_last_out * m_feedback;
+    sample += m_last_out * d.feedback;
 
-    assert(info.order == Order::pre || info.order == Order::post);
-    switch(info.order)
+    if constexpr(order == Order::pre)
     {
-      case Order::pre:
-        sample = delay.push(sample);
-        m_last_out = diffuser.push(sample, info.diffuser_info);
-        break;
-      case Order::post:
-        sample = diffuser.push(sample, info.diffuser_info);
-        m_last_out = delay.push(sample);
-        break;
+      sample = delay.template push<Modulated>(d.delay, sample);
+      m_last_out = diffuser.push(d.diffuser, sample, diffusion_feedback);
+    }
+    else
+    {
+      sample = diffuser.push(d.diffuser, sample, diffusion_feedback);
+      m_last_out = delay.template push<Modulated>(d.delay, sample);
     }
 
     return sample;
   }
 
+  /*
+      Adds the output of 'n' samples to 'output', with the same result as
+      pushing them one by one. The feedback loop is at least as long as the
+      delay, so chunks up to that length run the delay, the diffuser and
+      the damping one after the other, only lines shorter than a sample
+      fall back to push. 'n' is at most chunk_size.
+  */
+  template <Order order, bool LowShelf, bool HighShelf, bool HighCut, bool Modulated>
+  void process(
+      const Derived& d, const float* input, double* output, uint32_t n,
+      float diffusion_feedback) noexcept
+  {
+    assert(n <= chunk_size);
+
+    const uint32_t lookahead = d.delay.lookahead();
+    for(uint32_t start = 0; start < n;)
+    {
+      if(lookahead == 0)
+      {
+        output[start] += push<order, LowShelf, HighShelf, HighCut, Modulated>(
+            d, static_cast<double>(input[start]), diffusion_feedback);
+        ++start;
+        continue;
+      }
+
+      const uint32_t len = std::min(n - start, lookahead);
+      process_chunk<order, LowShelf, HighShelf, HighCut, Modulated>(
+          d, input + start, output + start, len, diffusion_feedback);
+      start += len;
+    }
+  }
+
+  // the last output of the line, which it feeds back
+  double last_output() const noexcept { return m_last_out; }
+
   void clear() noexcept
   {
     m_last_out = 0;
@@ -115,210 +253,562 @@ public:
     damping.clear();
   }
 
+  void skip_modulation(const Derived& d, uint64_t samples) noexcept
+  {
+    delay.skip_modulation(d.delay, samples);
+    diffuser.skip_modulation(d.diffuser, samples);
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(delay, diffuser, damping, m_last_out);
+  }
+
 private:
-  double m_last_out = 0;
+  template <uint32_t>
+  friend class LateLanes;
+
+  template <Order order, bool LowShelf, bool HighShelf, bool HighCut, bool Modulated>
+  void process_chunk(
+      const Derived& d, const float* input, double* output, uint32_t n,
+      float diffusion_feedback) noexcept
+  {
+    std::array<double, chunk_size> delayed;
+    delay.template read<Modulated>(d.delay, delayed.data(), n);
 
-  double m_feedback = 0;
+    if constexpr(order == Order::pre)
+    {
+      std::array<double, chunk_size> diffused = delayed;
+      diffuser.process(d.diffuser, diffused.data(), n, diffusion_feedback);
+
+      std::array<double, chunk_size> samples;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        m_last_out = damping.template push<LowShelf, HighShelf, HighCut>(
+            d.damping, m_last_out);
+        samples[i] = static_cast<double>(input[i]) + m_last_out * d.feedback;
+        m_last_out = diffused[i];
+      }
+      delay.write(samples.data(), n);
+
+      for(uint32_t i = 0; i < n; ++i)
+        output[i] += delayed[i];
+    }
+    else
+    {
+      std::array<double, chunk_size> samples;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        m_last_out = damping.template push<LowShelf, HighShelf, HighCut>(
+            d.damping, m_last_out);
+        samples[i] = static_cast<double>(input[i]) + m_last_out * d.feedback;
+        m_last_out = delayed[i];
+      }
+
+      diffuser.process(d.diffuser, samples.data(), n, diffusion_feedback);
+      delay.write(samples.data(), n);
+
+      for(uint32_t i = 0; i < n; ++i)
+        output[i] += samples[i];
+    }
+  }
+
+  double m_last_out = 0;
 };
 
+/*
+    The late reverberations, consisting of up to
+    Capacity::lines, by default 12, delay lines in parallel
+
+    The derived state of the lines is kept apart in Derived and passed to
+    the processing. Its setters only store their value, the derived state
+    of the active lines is recomputed by the generate functions.
+
+    Samples are processed by a kernel specialized on the settings
+    in Delayline::PushInfo, selected by begin_block, either one at a
+    time or in chunks with the lines one after the other
+*/
+template <class Capacity = DefaultCapacity>
 class LateRev
 {
+  // the random values are drawn for the default number of lines
+  static constexpr uint32_t rand_lines = DefaultCapacity::lines;
+
 public:
-  LateRev(LateRev&& other) noexcept = default;
-  LateRev& operator=(LateRev&& other) noexcept = default;
+  using Line = Delayline<Capacity>;
 
-  template <class RNG>
-  LateRev(float rate, RNG& rng)
-      : m_delay_lines{Delayline(rate, rng), Delayline(rate, rng), Delayline(rate, rng),
-                      Delayline(rate, rng), Delayline(rate, rng), Delayline(rate, rng),
-                      Delayline(rate, rng), Delayline(rate, rng), Delayline(rate, rng),
-                      Delayline(rate, rng), Delayline(rate, rng), Delayline(rate, rng)}
-  {
-  }
+  static constexpr uint32_t max_lines = Capacity::lines;
+  static_assert(max_lines <= rand_lines);
+
+  static constexpr float max_delay = Capacity::line_delay / 1.5f;
+  static constexpr float max_delay_mod = Capacity::line_mod / 1.15f;
 
-  // General
-  void set_seed_crossmix(float crossmix)
+  static constexpr float max_diffuse_delay_mod = Capacity::line_mod / 1.15f;
+
+  class Derived
   {
-    m_crossmix = crossmix;
+  public:
+    explicit Derived(float rate)
+        : Derived(rate, std::make_index_sequence<max_lines>{})
+    {
+    }
 
-    Random::generate(m_rand, m_delay_seed, m_crossmix);
-    generate_delay();
-    generate_mod_depth();
-    generate_mod_rate();
+    // General
+    void set_seed_crossmix(float crossmix) noexcept { m_crossmix = crossmix; }
 
-    for(auto& line : m_delay_lines)
-      line.diffuser.set_seed_crossmix(crossmix);
-  }
+    // the state of newly activated lines still has to be generated
+    void set_delay_lines(uint32_t lines) noexcept
+    {
+      assert(lines <= max_lines);
+      m_lines = lines;
+      m_gain_target = 0.3f + 0.3f * rand_lines / static_cast<float>(7 + m_lines);
+    }
 
-  void set_delay_lines(uint32_t lines)
-  {
-    if(m_lines < lines)
-      for(uint32_t i = m_lines; i < lines; ++i)
-        m_delay_lines[i].clear();
-    m_lines = lines;
-    m_gain_target = 0.3f + 0.3f * max_lines / static_cast<float>(7 + m_lines);
-  }
+    // delay line
+    void set_delay(float delay) noexcept
+    {
+      m_gain_smoothing = std::exp(-2 * constants::pi_v<float> / delay);
+      m_delay = delay;
+    }
+    void set_delay_mod_depth(float mod_depth) noexcept { m_mod_depth = mod_depth; }
+    void set_delay_mod_rate(float mod_rate) noexcept { m_mod_rate = mod_rate; }
+    void set_delay_feedback(float feedback) noexcept { m_feedback = feedback; }
+    void set_delay_seed(uint32_t seed) noexcept { m_delay_seed = seed; }
+
+    // diffusion
+    void set_diffusion_seed(uint32_t seed) noexcept { m_diffusion_seed = seed; }
+    void set_diffusion_stages(uint32_t stages) noexcept { m_diffusion_stages = stages; }
+    void set_diffusion_drive(float drive) noexcept { m_diffusion_drive = drive; }
+    void set_diffusion_delay(float delay) noexcept { m_diffusion_delay = delay; }
+    void set_diffusion_mod_depth(float mod_depth) noexcept
+    {
+      m_diffusion_mod_depth = mod_depth;
+    }
+    void set_diffusion_mod_rate(float mod_rate) noexcept
+    {
+      m_diffusion_mod_rate = mod_rate;
+    }
 
-  // delay line
-  void set_delay(float delay)
-  {
-    m_gain_smoothing = std::exp(-2 * constants::pi_v<float> / delay);
-    m_delay = delay;
-    generate_delay();
-  }
+    // Filter
+    void set_low_shelf(float cutoff, float gain) noexcept
+    {
+      m_low_shelf_cutoff = cutoff;
+      m_low_shelf_gain = gain;
+    }
+    void set_high_shelf(float cutoff, float gain) noexcept
+    {
+      m_high_shelf_cutoff = cutoff;
+      m_high_shelf_gain = gain;
+    }
+    void set_high_cut(float cutoff) noexcept { m_high_cut_cutoff = cutoff; }
 
-  void set_delay_mod_depth(float mod_depth)
-  {
-    m_mod_depth = mod_depth;
-    generate_mod_depth();
-  }
-  void set_delay_mod_rate(float mod_rate)
-  {
-    m_mod_rate = mod_rate;
-    generate_mod_rate();
-  }
-  void set_delay_feedback(float feedback)
-  {
-    m_feedback = feedback;
-    generate_feedback();
-  }
-  void set_delay_seed(uint32_t seed)
-  {
-    m_delay_seed = seed;
+    // Derived state
+    void generate_rand() noexcept { Random::generate(m_rand, m_delay_seed, m_crossmix); }
 
-    Random::generate(m_rand, m_delay_seed, m_crossmix);
-    generate_delay();
-    generate_mod_depth();
-    generate_mod_rate();
-  }
+    void generate_delay() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].delay.set_delay(line_delay(line));
+    }
+
+    void generate_mod_depth() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        float mod_depth = m_mod_depth * (0.7f + 0.3f * m_rand[line]);
+        m_delay_lines[line].delay.set_mod_depth(mod_depth);
+      }
+    }
 
-  // diffusion
-  void set_diffusion_drive(float drive)
+    void generate_mod_rate() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        float mod_rate = m_mod_rate * (0.7f + 0.3f * m_rand[line + rand_lines]);
+        m_delay_lines[line].delay.set_mod_rate(mod_rate);
+      }
+    }
+
+    void generate_feedback() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        // keep reverb time consistent between different lines
+        float feedback = std::pow(m_feedback, line_delay(line) / m_delay);
+        m_delay_lines[line].set_feedback(feedback);
+      }
+    }
+
+    void generate_diffusion_rand() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        auto& diffuser = m_delay_lines[line].diffuser;
+        diffuser.set_seed(m_diffusion_seed * (line + 1));
+        diffuser.set_seed_crossmix(m_crossmix);
+        diffuser.generate_rand();
+      }
+    }
+
+    void generate_diffusion_stages() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].diffuser.set_stages(m_diffusion_stages);
+    }
+
+    void generate_diffusion_drive() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].diffuser.set_drive(m_diffusion_drive);
+    }
+
+    void generate_diffusion_delay() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        auto& diffuser = m_delay_lines[line].diffuser;
+        diffuser.set_delay(m_diffusion_delay);
+        diffuser.generate_delay();
+      }
+    }
+
+    void generate_diffusion_mod_depth() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        auto& diffuser = m_delay_lines[line].diffuser;
+        diffuser.set_mod_depth(m_diffusion_mod_depth);
+        diffuser.generate_mod_depth();
+      }
+    }
+
+    void generate_diffusion_mod_rate() noexcept
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        auto& diffuser = m_delay_lines[line].diffuser;
+        diffuser.set_mod_rate(m_diffusion_mod_rate);
+        diffuser.generate_mod_rate();
+      }
+    }
+
+    // the coefficients are computed once and shared between all lines
+    void generate_low_shelf()
+    {
+      if(m_lines == 0)
+        return;
+      auto& first = m_delay_lines[0].damping.ls;
+      first.set_cutoff_and_gain(
+          static_cast<double>(m_low_shelf_cutoff), static_cast<double>(m_low_shelf_gain));
+      for(uint32_t line = 1; line < m_lines; ++line)
+        m_delay_lines[line].damping.ls = first;
+    }
+
+    void generate_high_shelf()
+    {
+      if(m_lines == 0)
+        return;
+      auto& first = m_delay_lines[0].damping.hs;
+      first.set_cutoff_and_gain(
+          static_cast<double>(m_high_shelf_cutoff),
+          static_cast<double>(m_high_shelf_gain));
+      for(uint32_t line = 1; line < m_lines; ++line)
+        m_delay_lines[line].damping.hs = first;
+    }
+
+    // shares the filter coefficients of a Derived with the same sample rate
+    void copy_low_shelf(const Derived& other) noexcept
+    {
+      m_low_shelf_cutoff = other.m_low_shelf_cutoff;
+      m_low_shelf_gain = other.m_low_shelf_gain;
+      const auto& first = other.m_delay_lines[0].damping.ls;
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].damping.ls = first;
+    }
+
+    void copy_high_shelf(const Derived& other) noexcept
+    {
+      m_high_shelf_cutoff = other.m_high_shelf_cutoff;
+      m_high_shelf_gain = other.m_high_shelf_gain;
+      const auto& first = other.m_delay_lines[0].damping.hs;
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].damping.hs = first;
+    }
+
+    void generate_high_cut()
+    {
+      for(uint32_t line = 0; line < m_lines; ++line)
+        m_delay_lines[line].damping.hc.set_cutoff(static_cast<double>(m_high_cut_cutoff));
+    }
+
+    // the longest tail of the active lines, see Delayline::Derived::tail_length
+    double tail_length(
+        float diffusion_feedback, typename Line::Filters::PushInfo damping_info,
+        double rate, double gain) const noexcept
+    {
+      double tail = 0.;
+      for(uint32_t line = 0; line < m_lines; ++line)
+      {
+        tail = std::max(
+            tail, m_delay_lines[line].tail_length(
+                      diffusion_feedback, damping_info, rate, gain));
+      }
+      return tail;
+    }
+
+  private:
+    friend class LateRev;
+    template <uint32_t>
+    friend class LateLanes;
+
+    template <size_t... Lines>
+    Derived(float rate, std::index_sequence<Lines...>)
+        : m_delay_lines{((void)Lines, typename Line::Derived(rate))...}
+    {
+    }
+
+    float line_delay(uint32_t line) const noexcept
+    {
+      return m_delay * (0.5f + 1.f * m_rand[line + 2 * rand_lines]);
+    }
+
+    std::array<typename Line::Derived, max_lines> m_delay_lines;
+    std::array<float, 3 * rand_lines> m_rand = {};
+
+    // gain compensation for the number of delay lines
+    float m_gain_target = 1.f;
+    float m_gain_smoothing = 1.f;
+
+    uint32_t m_lines = 0;
+    float m_delay = 0.f;
+    float m_mod_depth = 0.f;
+    float m_mod_rate = 0.f;
+    float m_feedback = 0.f;
+
+    uint32_t m_delay_seed = 0;
+    float m_crossmix = 0.f;
+
+    uint32_t m_diffusion_seed = 0;
+    uint32_t m_diffusion_stages = 0;
+    float m_diffusion_drive = 0.f;
+    float m_diffusion_delay = 0.f;
+    float m_diffusion_mod_depth = 0.f;
+    float m_diffusion_mod_rate = 0.f;
+
+    float m_low_shelf_cutoff = 0.f;
+    float m_low_shelf_gain = 1.f;
+    float m_high_shelf_cutoff = 0.f;
+    float m_high_shelf_gain = 1.f;
+    float m_high_cut_cutoff = 0.f;
+  };
+
+  LateRev(LateRev&& other) noexcept = default;
+  LateRev& operator=(LateRev&& other) noexcept = default;
+
+  template <class RNG>
+  LateRev(float rate, RNG& rng)
+      : LateRev(rate, rng, std::make_index_sequence<Capacity::lines>{})
   {
-    for(auto& line : m_delay_lines)
-      line.diffuser.set_drive(drive);
   }
-  void set_diffusion_delay(float delay)
+
+  // current gain compensation for the number of delay lines
+  float gain() const noexcept { return m_gain; }
+
+  // mean square of the feedback of the active lines
+  double energy() const noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.diffuser.set_delay(delay);
+    if(m_active_lines == 0)
+      return 0.;
+    double sum = 0.;
+    for(uint32_t line = 0; line < m_active_lines; ++line)
+      sum += m_delay_lines[line].last_output() * m_delay_lines[line].last_output();
+    return sum / m_active_lines;
   }
-  void set_diffusion_mod_depth(float mod_depth)
+
+  // jumps to the target gain and drive
+  void settle(const Derived& d) noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.diffuser.set_mod_depth(mod_depth);
+    m_gain = d.m_gain_target;
+    for(uint32_t line = 0; line < d.m_lines; ++line)
+      m_delay_lines[line].diffuser.settle(d.m_delay_lines[line].diffuser);
   }
-  void set_diffusion_mod_rate(float mod_rate)
+
+  void skip_modulation(const Derived& d, uint64_t samples) noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.diffuser.set_mod_rate(mod_rate);
+    for(uint32_t line = 0; line < d.m_lines; ++line)
+      m_delay_lines[line].skip_modulation(d.m_delay_lines[line], samples);
   }
-  void set_diffusion_seed(uint32_t seed)
+
+  void clear() noexcept
   {
-    uint32_t i = 1;
     for(auto& line : m_delay_lines)
-      line.diffuser.set_seed(seed * i++);
+      line.clear();
   }
 
-  // Filter
-  void set_low_shelf_cutoff(float cutoff)
+  template <class Archive>
+  void serialize(Archive& ar)
   {
-    for(auto& line : m_delay_lines)
-      line.damping.ls.set_cutoff(static_cast<double>(cutoff));
+    ar(m_delay_lines, m_gain, m_active_lines);
+    if(!ar.check(m_active_lines <= max_lines))
+      m_active_lines = 0;
   }
-  void set_low_shelf_gain(float gain)
+
+  /*
+      Clears the lines 'd' has deactivated since the last call, so that
+      inactive lines are always silent when they are activated again.
+      Called by begin_block, and whenever the line count of 'd' changes
+      within a block.
+  */
+  void activate_lines(const Derived& d) noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.damping.ls.set_gain(static_cast<double>(gain));
+    for(uint32_t i = d.m_lines; i < m_active_lines; ++i)
+      m_delay_lines[i].clear();
+    m_active_lines = d.m_lines;
   }
-  void set_high_shelf_cutoff(float cutoff)
+
+  void begin_block(const Derived& d, const typename Line::PushInfo& info) noexcept
   {
+    static constexpr auto kernels
+        = make_kernel_table<Kernel, kernel_variants>([](auto variant) {
+            return &LateRev::kernel<decltype(variant)::value>;
+          });
+    static constexpr auto chunk_kernels
+        = make_kernel_table<ChunkKernel, kernel_variants>([](auto variant) {
+            return &LateRev::chunk_kernel<decltype(variant)::value>;
+          });
+
+    activate_lines(d);
+
+    assert(info.order == Line::Order::pre || info.order == Line::Order::post);
+    const auto& damping = info.damping_info;
+    const uint32_t variant = static_cast<uint32_t>(info.order)
+                           | uint32_t{damping.ls_enable} << 1
+                           | uint32_t{damping.hs_enable} << 2
+                           | uint32_t{damping.hc_enable} << 3
+                           | uint32_t{info.modulated} << 4;
+    m_kernel = kernels[variant];
+    m_chunk_kernel = chunk_kernels[variant];
+    m_info = info;
+    m_modulated = info.modulated;
+
     for(auto& line : m_delay_lines)
-      line.damping.hs.set_cutoff(static_cast<double>(cutoff));
+      line.diffuser.begin_block(info.diffuser_info);
   }
-  void set_high_shelf_gain(float gain)
+
+  // advances the modulation the kernels did not step
+  void end_block(const Derived& d, uint32_t samples) noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.damping.hs.set_gain(static_cast<double>(gain));
+    for(uint32_t line = 0; line < d.m_lines; ++line)
+    {
+      const auto& derived = d.m_delay_lines[line];
+      if(!m_modulated)
+        m_delay_lines[line].delay.skip_modulation(derived.delay, samples);
+      m_delay_lines[line].diffuser.end_block(derived.diffuser, samples);
+    }
   }
-  void set_high_cut_cutoff(float cutoff)
+
+  float push(const Derived& d, float sample, float diffusion_feedback) noexcept
   {
-    for(auto& line : m_delay_lines)
-      line.damping.hc.set_cutoff(static_cast<double>(cutoff));
+    return (this->*m_kernel)(d, sample, diffusion_feedback);
   }
 
-  float push(float sample, Delayline::PushInfo push_info) noexcept
+  // same as pushing the samples one by one, 'n' is at most chunk_size
+  void process(
+      const Derived& d, const float* input, float* output, uint32_t n,
+      float diffusion_feedback) noexcept
   {
-    double output = 0;
-    for(uint32_t i = 0; i < m_lines; ++i)
-      output += m_delay_lines[i].push(static_cast<double>(sample), push_info);
-
-    m_gain = m_gain - m_gain_smoothing * (m_gain - m_gain_target);
-    return m_gain * static_cast<float>(output);
+    (this->*m_chunk_kernel)(d, input, output, n, diffusion_feedback);
   }
 
-  static constexpr uint32_t max_lines = 12;
-
-  static constexpr float max_delay = ModulatedDelay<double>::max_delay / 1.5f;
-  static constexpr float max_delay_mod = ModulatedDelay<double>::max_mod / 1.15f;
-
-  static constexpr float max_diffuse_delay_mod = ModulatedDelay<double>::max_mod / 1.15f;
-
 private:
-  std::array<Delayline, max_lines> m_delay_lines;
-  std::array<float, 3 * max_lines> m_rand = {};
-
-  // gain compensation for the number of delay lines
-  float m_gain_target = 1.f;
-  float m_gain_smoothing = 1.f;
-  float m_gain = 1.f;
+  template <uint32_t>
+  friend class LateLanes;
+
+  // the lines draw their modulation phases from 'rng' one after the other,
+  // followed by the phases of the lines of the default capacity that are
+  // left out, one for the delay and one for every diffusion stage
+  template <class RNG, size_t... Lines>
+  LateRev(float rate, RNG& rng, std::index_sequence<Lines...>)
+      : m_delay_lines{((void)Lines, Line(rate, rng))...}
+  {
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    const uint32_t left_out = (rand_lines - max_lines) * (DefaultCapacity::stages + 1);
+    for(uint32_t i = 0; i < left_out; ++i)
+      dist(rng);
+  }
 
-  uint32_t m_lines = 0;
-  float m_delay = 0.f;
-  float m_mod_depth = 0.f;
-  float m_mod_rate = 0.f;
-  float m_feedback = 0.f;
+  using Kernel = float (LateRev::*)(const Derived&, float, float) noexcept;
+  using ChunkKernel = void (LateRev::*)(
+      const Derived&, const float*, float*, uint32_t, float) noexcept;
 
-  uint32_t m_delay_seed = 0;
-  float m_crossmix = 0.f;
+  // order, low shelf, high shelf, high cut and modulated
+  static constexpr uint32_t kernel_variants = 1 << 5;
 
-  void generate_delay()
+  template <uint32_t Variant>
+  float kernel(const Derived& d, float sample, float diffusion_feedback) noexcept
   {
-    for(uint32_t line = 0; line < max_lines; ++line)
-    {
-      float delay = m_delay * (0.5f + 1.f * m_rand[line + 2 * max_lines]);
-      m_delay_lines[line].delay.set_delay(delay);
-    }
-  }
+    constexpr auto order
+        = variant_flag(Variant, 0) ? Line::Order::post : Line::Order::pre;
+    constexpr bool low_shelf = variant_flag(Variant, 1);
+    constexpr bool high_shelf = variant_flag(Variant, 2);
+    constexpr bool high_cut = variant_flag(Variant, 3);
+    constexpr bool modulated = variant_flag(Variant, 4);
+    assert(d.m_lines == m_active_lines);
 
-  void generate_mod_depth()
-  {
-    for(uint32_t line = 0; line < max_lines; ++line)
+    double output = 0;
+    for(uint32_t i = 0; i < d.m_lines; ++i)
     {
-      float mod_depth = m_mod_depth * (0.7f + 0.3f * m_rand[line]);
-      m_delay_lines[line].delay.set_mod_depth(mod_depth);
+      output += m_delay_lines[i]
+                    .template push<order, low_shelf, high_shelf, high_cut, modulated>(
+                        d.m_delay_lines[i], static_cast<double>(sample),
+                        diffusion_feedback);
     }
+
+    m_gain = m_gain - d.m_gain_smoothing * (m_gain - d.m_gain_target);
+    return m_gain * static_cast<float>(output);
   }
 
-  void generate_mod_rate()
+  template <uint32_t Variant>
+  void chunk_kernel(
+      const Derived& d, const float* input, float* output, uint32_t n,
+      float diffusion_feedback) noexcept
   {
-    for(uint32_t line = 0; line < max_lines; ++line)
+    constexpr auto order
+        = variant_flag(Variant, 0) ? Line::Order::post : Line::Order::pre;
+    constexpr bool low_shelf = variant_flag(Variant, 1);
+    constexpr bool high_shelf = variant_flag(Variant, 2);
+    constexpr bool high_cut = variant_flag(Variant, 3);
+    constexpr bool modulated = variant_flag(Variant, 4);
+    assert(d.m_lines == m_active_lines);
+    assert(n <= chunk_size);
+
+    // summed in the same order as by kernel
+    std::array<double, chunk_size> sum = {};
+    for(uint32_t i = 0; i < d.m_lines; ++i)
     {
-      float mod_rate = m_mod_rate * (0.7f + 0.3f * m_rand[line + max_lines]);
-      m_delay_lines[line].delay.set_mod_rate(mod_rate);
+      m_delay_lines[i].template process<order, low_shelf, high_shelf, high_cut, modulated>(
+          d.m_delay_lines[i], input, sum.data(), n, diffusion_feedback);
     }
-  }
 
-  void generate_feedback()
-  {
-    for(uint32_t line = 0; line < max_lines; ++line)
+    for(uint32_t i = 0; i < n; ++i)
     {
-      float delay = m_delay * (0.5f + 1.f * m_rand[line + 2 * max_lines]);
-      // keep reverb time consistent between different lines
-      float feedback = std::pow(m_feedback, delay / m_delay);
-      m_delay_lines[line].set_feedback(feedback);
+      m_gain = m_gain - d.m_gain_smoothing * (m_gain - d.m_gain_target);
+      output[i] = m_gain * static_cast<float>(sum[i]);
     }
   }
+
+  Kernel m_kernel = &LateRev::kernel<0>;
+  ChunkKernel m_chunk_kernel = &LateRev::chunk_kernel<0>;
+  // the settings the kernels have been selected for
+  typename Line::PushInfo m_info = {};
+  bool m_modulated = false;
+
+  std::array<Line, max_lines> m_delay_lines;
+
+  float m_gain = 1.f;
+  // the line count of the derived state at the last activate_lines
+  uint32_t m_active_lines = 0;
 };
 }
 #endif
@@ -1,8 +1,11 @@
 #ifndef DIFFUSER_HPP
 #define DIFFUSER_HPP
 
+#include "capacity.hpp"
 #include "constants.hpp"
+#include "kernels.hpp"
 #include "lfo.hpp"
+#include "math.hpp"
 #include "random.hpp"
 #include "ringbuffer.hpp"
 
@@ -13,18 +16,54 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <random>
 #include <utility>
+#include <vector>
 
 namespace Aether
 {
 /*
     Schroeder Allpass filter
+
+    The samples are stored as Storage, see Ringbuffer. The delay, the
+    mod depth and the mod rate are the derived state, which is kept apart
+    in Derived and passed to the processing.
 */
-template <class FpType>
+template <class FpType, class Storage = FpType, class Capacity = DefaultCapacity>
 class ModulatedAllpass
 {
 public:
+  class Derived
+  {
+  public:
+    void set_delay(float delay) noexcept
+    {
+      assert(delay >= 1.f);
+      m_delay = delay;
+      m_mod_depth = std::min(m_mod_depth, delay - 1.f);
+    }
+
+    void set_mod_depth(float mod_depth) noexcept
+    {
+      m_mod_depth = std::min(mod_depth, m_delay - 1.f);
+    }
+
+    void set_mod_rate(float mod_rate) noexcept { m_mod_rate = LFO::Rate(mod_rate); }
+
+    float delay() const noexcept { return m_delay; }
+    float mod_depth() const noexcept { return m_mod_depth; }
+
+  private:
+    friend class ModulatedAllpass;
+    template <uint32_t>
+    friend class LateLanes;
+
+    float m_delay = 1.f;
+    float m_mod_depth = 0.f;
+    LFO::Rate m_mod_rate;
+  };
+
   ModulatedAllpass() = default;
   ModulatedAllpass(float rate, float mod_phase);
   ModulatedAllpass(ModulatedAllpass&& other) noexcept;
@@ -33,61 +72,78 @@ public:
   ModulatedAllpass& operator=(ModulatedAllpass&& other) noexcept;
   ModulatedAllpass& operator=(const ModulatedAllpass&) = delete;
 
-  void set_delay(float delay) noexcept
+  void skip_modulation(const Derived& d, uint64_t samples) noexcept
   {
-    assert(delay >= 1.f);
-    m_delay = delay;
-    m_mod_depth = std::min(m_mod_depth, delay - 1.f);
+    m_lfo.skip(d.m_mod_rate, samples);
   }
 
-  void set_mod_depth(float mod_depth) noexcept
-  {
-    m_mod_depth = std::min(mod_depth, m_delay - 1.f);
-  }
-
-  void set_mod_rate(float mod_rate) noexcept { m_lfo.set_rate(mod_rate); }
-
+  // the delay is constant unless Modulated is set
+  template <bool Interpolate, bool Modulated>
   FpType push(
-      FpType sample, float feedback, bool interpolate, bool enable_drive,
+      const Derived& d, FpType sample, float feedback, bool enable_drive,
       float drive) noexcept;
 
+  /*
+      Processes 'n' samples in place with the same result as pushing them
+      one by one, in chunks no longer than the shortest delay. Every sample
+      a chunk reads has then been pushed before the chunk, so the reads,
+      the interpolation and the writes each run as a loop of their own.
+
+      'drive' holds the drive of every sample if Drive is set
+  */
+  template <bool Interpolate, bool Modulated, bool Drive>
+  void process(
+      const Derived& d, FpType* samples, uint32_t n, float feedback,
+      const float* drive) noexcept;
+
   void clear() noexcept { m_buf.clear(); }
 
-  // [10ms, 100ms]
-  static constexpr std::pair<float, float> delay_bounds = {0.01f, 0.1f};
-  // [0ms, 3ms]
-  static constexpr std::pair<float, float> mod_bounds = {0.f, 0.003f};
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_buf, m_lfo);
+  }
+
+  // [10ms, 100ms] by default
+  static constexpr std::pair<float, float> delay_bounds
+      = {0.01f, Capacity::allpass_delay};
+  // [0ms, 3ms] by default
+  static constexpr std::pair<float, float> mod_bounds = {0.f, Capacity::allpass_mod};
 
 private:
-  Ringbuffer<FpType> m_buf = {};
+  template <uint32_t>
+  friend class LateLanes;
 
-  float m_delay = 1.f;
-  float m_mod_depth = 0.f;
+  template <bool Interpolate, bool Modulated, bool Drive>
+  void process_chunk(
+      const Derived& d, FpType* samples, uint32_t n, float feedback,
+      const float* drive) noexcept;
 
+  Ringbuffer<FpType, Storage> m_buf = {};
   LFO m_lfo = {};
 };
 
-template <class FpType>
-inline ModulatedAllpass<FpType>::ModulatedAllpass(float rate, float mod_phase)
+template <class FpType, class Storage, class Capacity>
+inline ModulatedAllpass<FpType, Storage, Capacity>::ModulatedAllpass(
+    float rate, float mod_phase)
     : m_buf{static_cast<size_t>((delay_bounds.second + mod_bounds.second) * rate)}
     , m_lfo{mod_phase}
 {
 }
 
-template <class FpType>
-inline ModulatedAllpass<FpType>::ModulatedAllpass(ModulatedAllpass&& other) noexcept
+template <class FpType, class Storage, class Capacity>
+inline ModulatedAllpass<FpType, Storage, Capacity>::ModulatedAllpass(
+    ModulatedAllpass&& other) noexcept
     : ModulatedAllpass()
 {
   *this = std::move(other);
 }
 
-template <class FpType>
-inline ModulatedAllpass<FpType>&
-ModulatedAllpass<FpType>::operator=(ModulatedAllpass&& other) noexcept
+template <class FpType, class Storage, class Capacity>
+inline ModulatedAllpass<FpType, Storage, Capacity>&
+ModulatedAllpass<FpType, Storage, Capacity>::operator=(ModulatedAllpass&& other) noexcept
 {
   std::swap(m_buf, other.m_buf);
-  std::swap(m_delay, other.m_delay);
-  std::swap(m_mod_depth, other.m_mod_depth);
   std::swap(m_lfo, other.m_lfo);
   return *this;
 }
@@ -99,24 +155,32 @@ inline FpType soft_clip(FpType x, FpType drive) noexcept
   return (x - x * x * x / 3) / drive;
 }
 
-template <class FpType>
-inline FpType ModulatedAllpass<FpType>::push(
-    FpType sample, float feedback, bool interpolate, bool enable_drive,
+template <class FpType, class Storage, class Capacity>
+template <bool Interpolate, bool Modulated>
+inline FpType ModulatedAllpass<FpType, Storage, Capacity>::push(
+    const Derived& d, FpType sample, float feedback, bool enable_drive,
     float drive) noexcept
 {
-  assert(static_cast<size_t>(m_delay + m_mod_depth) <= m_buf.size);
-  assert(m_delay - m_mod_depth >= 1.f);
+  assert(static_cast<size_t>(d.m_delay + d.m_mod_depth) <= m_buf.size);
+  assert(d.m_delay - d.m_mod_depth >= 1.f);
+  assert(Modulated || d.m_mod_depth == 0.f);
 
-  float delay = m_delay + m_mod_depth * m_lfo.depth() - 1.f;
-  m_lfo.next();
+  float delay = d.m_delay - 1.f;
+  if constexpr(Modulated)
+  {
+    delay = d.m_delay + d.m_mod_depth * m_lfo.depth() - 1.f;
+    m_lfo.next(d.m_mod_rate);
+  }
 
   uint32_t delay_floor = static_cast<uint32_t>(delay);
   size_t idx1 = m_buf.end - delay_floor + (m_buf.end < delay_floor ? m_buf.size : 0);
-  size_t idx2 = idx1 - 1 + (idx1 < 1 ? m_buf.size : 0);
-  FpType t = static_cast<FpType>(delay - static_cast<float>(delay_floor));
-  FpType delayed = interpolate
-                       ? m_buf.buf[idx1] + t * (m_buf.buf[idx2] - m_buf.buf[idx1])
-                       : m_buf.buf[idx1];
+  FpType delayed = m_buf[idx1];
+  if constexpr(Interpolate)
+  {
+    size_t idx2 = idx1 - 1 + (idx1 < 1 ? m_buf.size : 0);
+    FpType t = static_cast<FpType>(delay - static_cast<float>(delay_floor));
+    delayed = m_buf[idx1] + t * (m_buf[idx2] - m_buf[idx1]);
+  }
 
   FpType buffer_input = sample + delayed * static_cast<FpType>(feedback);
   if(enable_drive)
@@ -124,22 +188,174 @@ inline FpType ModulatedAllpass<FpType>::push(
 
   m_buf.push(buffer_input);
 
-  return delayed - m_buf.buf[m_buf.end] * static_cast<FpType>(feedback);
+  return delayed - buffer_input * static_cast<FpType>(feedback);
+}
+
+template <class FpType, class Storage, class Capacity>
+template <bool Interpolate, bool Modulated, bool Drive>
+inline void ModulatedAllpass<FpType, Storage, Capacity>::process(
+    const Derived& d, FpType* samples, uint32_t n, float feedback,
+    const float* drive) noexcept
+{
+  assert(static_cast<size_t>(d.m_delay + d.m_mod_depth) <= m_buf.size);
+  assert(d.m_delay - d.m_mod_depth >= 1.f);
+  assert(Modulated || d.m_mod_depth == 0.f);
+
+  // the floor of the shortest delay push can read, which is also the
+  // age of the newest sample it reads, plus one for the sample itself
+  const uint32_t loop_delay = static_cast<uint32_t>(d.m_delay - d.m_mod_depth - 1.f) + 1;
+  const uint32_t max_chunk = std::min(loop_delay, chunk_size);
+  for(uint32_t start = 0; start < n;)
+  {
+    const uint32_t len = std::min(n - start, max_chunk);
+    process_chunk<Interpolate, Modulated, Drive>(
+        d, samples + start, len, feedback, Drive ? drive + start : nullptr);
+    start += len;
+  }
+}
+
+template <class FpType, class Storage, class Capacity>
+template <bool Interpolate, bool Modulated, bool Drive>
+inline void ModulatedAllpass<FpType, Storage, Capacity>::process_chunk(
+    const Derived& d, FpType* samples, uint32_t n, float feedback,
+    const float* drive) noexcept
+{
+  assert(n <= chunk_size);
+
+  std::array<float, chunk_size> delays;
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    delays[i] = d.m_delay - 1.f;
+    if constexpr(Modulated)
+    {
+      delays[i] = d.m_delay + d.m_mod_depth * m_lfo.depth() - 1.f;
+      m_lfo.next(d.m_mod_rate);
+    }
+  }
+
+  // the i-th sample reads relative to the end of the buffer before the chunk
+  std::array<FpType, chunk_size> delayed;
+  const size_t end = m_buf.end;
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    uint32_t delay_floor = static_cast<uint32_t>(delays[i]);
+    assert(delay_floor >= i);
+    size_t back = delay_floor - i;
+    size_t idx1 = end - back + (end < back ? m_buf.size : 0);
+    delayed[i] = m_buf[idx1];
+    if constexpr(Interpolate)
+    {
+      size_t idx2 = idx1 - 1 + (idx1 < 1 ? m_buf.size : 0);
+      FpType t = static_cast<FpType>(delays[i] - static_cast<float>(delay_floor));
+      delayed[i] = m_buf[idx1] + t * (m_buf[idx2] - m_buf[idx1]);
+    }
+  }
+
+  const auto fb = static_cast<FpType>(feedback);
+  std::array<FpType, chunk_size> buffer_input;
+  for(uint32_t i = 0; i < n; ++i)
+    buffer_input[i] = samples[i] + delayed[i] * fb;
+
+  if constexpr(Drive)
+  {
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      if(drive[i] > 0.0001f)
+        buffer_input[i] = soft_clip(buffer_input[i], static_cast<FpType>(drive[i]));
+    }
+  }
+
+  for(uint32_t i = 0; i < n; ++i)
+    m_buf.push(buffer_input[i]);
+
+  for(uint32_t i = 0; i < n; ++i)
+    samples[i] = delayed[i] - buffer_input[i] * fb;
 }
 
 /*
-    An allpass diffuser consisting of up
-    to 8 modulated allpass filters in series
+    An allpass diffuser consisting of up to Capacity::stages,
+    by default 8, modulated allpass filters in series
+
+    The derived state of the stages is kept apart in Derived and passed
+    to the processing. Its setters only store their value, the derived
+    state of the active stages is recomputed by the generate functions.
+
+    Samples are processed by a kernel specialized on the number of
+    stages and on the settings in PushInfo, selected by begin_block.
+    The chunked kernel runs one stage after the other over a chunk.
 */
-template <class FpType>
+template <class FpType, class Storage = FpType, class Capacity = DefaultCapacity>
 class AllpassDiffuser
 {
+  // the random values are drawn for the default number of stages
+  static constexpr uint32_t rand_stages = DefaultCapacity::stages;
+
 public:
+  using Allpass = ModulatedAllpass<FpType, Storage, Capacity>;
+
+  static constexpr uint32_t max_stages = Capacity::stages;
+  static_assert(max_stages <= rand_stages);
+
+  static constexpr std::pair<float, float> delay_bounds = Allpass::delay_bounds;
+  static constexpr std::pair<float, float> mod_bounds
+      = {Allpass::mod_bounds.first / 0.85f, Allpass::mod_bounds.second / 1.15f};
+
+  // settings that stay constant for a block
   struct PushInfo
   {
     uint32_t stages;
-    float feedback;
     bool interpolate;
+    // whether the mod depth may be nonzero during the block
+    bool modulated;
+    // whether the target drive may be nonzero during the block
+    bool drive;
+  };
+
+  class Derived
+  {
+  public:
+    Derived() noexcept { generate_rand(); }
+
+    void set_seed(uint32_t seed) noexcept { m_seed = seed; }
+    void set_seed_crossmix(float crossmix) noexcept { m_crossmix = crossmix; }
+    void set_stages(uint32_t stages) noexcept;
+    void set_drive(float drive) noexcept { m_target_drive = drive; }
+    void set_delay(float delay) noexcept { m_delay = delay; }
+    void set_mod_depth(float mod_depth) noexcept { m_mod_depth = mod_depth; }
+    void set_mod_rate(float mod_rate) noexcept { m_mod_rate = mod_rate; }
+
+    void generate_rand() noexcept;
+    void generate_delay() noexcept;
+    void generate_mod_depth() noexcept;
+    void generate_mod_rate() noexcept;
+
+    // the sum of the stage delays, which is also the average group delay
+    double delay() const noexcept;
+    // the largest group delay of the stages, which each one reaches at its
+    // resonances with (1 + feedback) / (1 - feedback) times its delay
+    double max_group_delay(float feedback) const noexcept;
+    // samples until the slowest stage has rung out by 'gain', the
+    // stages ring at the same time, each one delayed by the previous ones
+    double decay_time(float feedback, double gain) const noexcept;
+
+  private:
+    friend class AllpassDiffuser;
+    template <uint32_t>
+    friend class LateLanes;
+
+    std::array<typename Allpass::Derived, max_stages> m_filters = {};
+    // used for mod_amt, mod_rate and delay
+    std::array<float, 3 * rand_stages> m_rand_vals = {};
+
+    uint32_t m_stages = 0;
+    float m_delay = 10.f;
+    float m_target_drive = 0.f;
+
+    float m_mod_depth = 0.f;
+    float m_mod_rate = 0.f;
+
+    uint32_t m_seed = 0;
+    float m_crossmix = 0.f;
   };
 
   template <class RNG>
@@ -147,11 +363,14 @@ public:
       : m_drive_smoothing{std::exp(-2 * constants::pi_v<float> / (0.0001f * 100 * rate))}
       , m_rate(rate)
   {
+    // the phases are drawn for the default number of stages as well
     std::uniform_real_distribution<float> dist(0.f, 1.f);
-    for(auto& filter : m_filters)
-      filter = ModulatedAllpass<FpType>(rate, dist(rng));
-
-    Random::generate(m_rand_vals, m_seed, m_crossmix);
+    for(uint32_t stage = 0; stage < rand_stages; ++stage)
+    {
+      const float phase = dist(rng);
+      if(stage < max_stages)
+        m_filters[stage] = Allpass(rate, phase);
+    }
   }
 
   // AllpassDiffuser(const AllpassDiffuser&) = delete;
@@ -162,22 +381,19 @@ public:
 
   ~AllpassDiffuser() = default;
 
+  void begin_block(PushInfo info) noexcept;
+  // advances the modulation the kernel did not step
+  void end_block(const Derived& d, uint32_t samples) noexcept;
 
-  void set_seed(uint32_t seed) noexcept;
-  void set_seed_crossmix(float crossmix) noexcept;
-  void set_drive(float drive) noexcept;
-  void set_delay(float delay) noexcept;
-  void set_mod_depth(float mod_depth) noexcept;
-  void set_mod_rate(float mod_rate) noexcept;
+  FpType push(const Derived& d, FpType sample, float feedback) noexcept
+  {
+    return (this->*m_kernel)(d, sample, feedback);
+  }
 
-  FpType push(FpType sample, PushInfo info) noexcept
+  // same as pushing the samples one by one, 'n' is at most chunk_size
+  void process(const Derived& d, FpType* samples, uint32_t n, float feedback) noexcept
   {
-    m_drive = m_target_drive - m_drive_smoothing * (m_target_drive - m_drive);
-    bool enable_drive = m_drive > 0.0001f;
-    for(uint32_t i = 0; i < info.stages; ++i)
-      sample = m_filters[i].push(
-          sample, info.feedback, info.interpolate, enable_drive, m_drive);
-    return sample;
+    (this->*m_chunk_kernel)(d, samples, n, feedback);
   }
 
   void clear() noexcept
@@ -186,117 +402,419 @@ public:
       filter.clear();
   }
 
-  static constexpr uint32_t max_stages = 8;
+  // jumps to the target drive
+  void settle(const Derived& d) noexcept { m_drive = d.m_target_drive; }
 
-  static constexpr std::pair<float, float> delay_bounds
-      = ModulatedAllpass<FpType>::delay_bounds;
-  static constexpr std::pair<float, float> mod_bounds
-      = {ModulatedAllpass<FpType>::mod_bounds.first / 0.85f,
-         ModulatedAllpass<FpType>::mod_bounds.second / 1.15f};
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_filters, m_drive);
+  }
+
+  void skip_modulation(const Derived& d, uint64_t samples) noexcept
+  {
+    for(uint32_t i = 0; i < d.m_stages; ++i)
+      m_filters[i].skip_modulation(d.m_filters[i], samples);
+  }
 
 private:
-  std::array<ModulatedAllpass<FpType>, max_stages> m_filters = {};
-  // used for mod_amt, mod_rate and delay
-  std::array<float, 3 * max_stages> m_rand_vals = {};
+  template <uint32_t>
+  friend class LateLanes;
 
-  float m_delay = 10.f;
+  using Kernel = FpType (AllpassDiffuser::*)(const Derived&, FpType, float) noexcept;
+  using ChunkKernel
+      = void (AllpassDiffuser::*)(const Derived&, FpType*, uint32_t, float) noexcept;
 
-  float m_drive = 0.f;
-  float m_target_drive = 0.f;
-  float m_drive_smoothing{};
+  // stages in the upper bits, interpolate, modulated and drive in the lower bits
+  static constexpr uint32_t kernel_variants = (max_stages + 1) << 3;
+
+  template <uint32_t Variant>
+  FpType kernel(const Derived& d, FpType sample, float feedback) noexcept;
+  template <uint32_t Variant>
+  void chunk_kernel(const Derived& d, FpType* samples, uint32_t n, float feedback)
+      noexcept;
 
-  float m_mod_depth = 0.f;
-  float m_mod_rate = 0.f;
+  std::array<Allpass, max_stages> m_filters = {};
 
-  uint32_t m_seed = 0;
-  float m_crossmix = 0.f;
+  float m_drive = 0.f;
+  float m_drive_smoothing{};
 
   float m_rate;
 
-  void generate_delay() noexcept;
-  void generate_mod_depth() noexcept;
-  void generate_mod_rate() noexcept;
+  Kernel m_kernel = &AllpassDiffuser::kernel<0>;
+  ChunkKernel m_chunk_kernel = &AllpassDiffuser::chunk_kernel<0>;
+  // the variant of the selected kernels
+  uint32_t m_variant = 0;
+  bool m_modulated = false;
 };
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_seed(uint32_t seed) noexcept
+template <class FpType, class Storage, class Capacity>
+template <uint32_t Variant>
+inline FpType AllpassDiffuser<FpType, Storage, Capacity>::kernel(
+    const Derived& d, FpType sample, float feedback) noexcept
 {
-  m_seed = seed;
+  constexpr uint32_t stages = Variant >> 3;
+  constexpr bool interpolate = variant_flag(Variant, 0);
+  constexpr bool modulated = variant_flag(Variant, 1);
+  constexpr bool drive = variant_flag(Variant, 2);
+  assert(d.m_stages == stages);
+
+  m_drive = d.m_target_drive - m_drive_smoothing * (d.m_target_drive - m_drive);
+  const bool enable_drive = drive && m_drive > 0.0001f;
+  unroll<stages>([&](auto stage) {
+    sample = m_filters[stage].template push<interpolate, modulated>(
+        d.m_filters[stage], sample, feedback, enable_drive, m_drive);
+  });
+  return sample;
+}
 
-  Random::generate(m_rand_vals, m_seed, m_crossmix);
-  generate_delay();
-  generate_mod_depth();
-  generate_mod_rate();
+template <class FpType, class Storage, class Capacity>
+template <uint32_t Variant>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::chunk_kernel(
+    const Derived& d, FpType* samples, uint32_t n, float feedback) noexcept
+{
+  constexpr uint32_t stages = Variant >> 3;
+  constexpr bool interpolate = variant_flag(Variant, 0);
+  constexpr bool modulated = variant_flag(Variant, 1);
+  constexpr bool drive = variant_flag(Variant, 2);
+  assert(d.m_stages == stages);
+  assert(n <= chunk_size);
+
+  // the drive of every sample, shared by all stages
+  std::array<float, chunk_size> drives;
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    m_drive = d.m_target_drive - m_drive_smoothing * (d.m_target_drive - m_drive);
+    drives[i] = m_drive;
+  }
+
+  unroll<stages>([&](auto stage) {
+    m_filters[stage].template process<interpolate, modulated, drive>(
+        d.m_filters[stage], samples, n, feedback, drives.data());
+  });
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_seed_crossmix(float crossmix) noexcept
+template <class FpType, class Storage, class Capacity>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::begin_block(
+    PushInfo info) noexcept
 {
-  m_crossmix = crossmix;
+  static constexpr auto kernels
+      = make_kernel_table<Kernel, kernel_variants>([](auto variant) {
+          return &AllpassDiffuser::kernel<decltype(variant)::value>;
+        });
+  static constexpr auto chunk_kernels
+      = make_kernel_table<ChunkKernel, kernel_variants>([](auto variant) {
+          return &AllpassDiffuser::chunk_kernel<decltype(variant)::value>;
+        });
+
+  assert(info.stages <= max_stages);
+  // the drive is still fading out if the target has just been disabled
+  const bool drive = info.drive || m_drive > 0.0001f;
+  const uint32_t variant = info.stages << 3 | uint32_t{info.interpolate}
+                         | uint32_t{info.modulated} << 1 | uint32_t{drive} << 2;
+  m_kernel = kernels[variant];
+  m_chunk_kernel = chunk_kernels[variant];
+  m_variant = variant;
+  m_modulated = info.modulated;
+}
 
-  Random::generate(m_rand_vals, m_seed, m_crossmix);
-  generate_delay();
-  generate_mod_depth();
-  generate_mod_rate();
+template <class FpType, class Storage, class Capacity>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::end_block(
+    const Derived& d, uint32_t samples) noexcept
+{
+  if(!m_modulated)
+    skip_modulation(d, samples);
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_drive(float drive) noexcept
+template <class FpType, class Storage, class Capacity>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::Derived::set_stages(
+    uint32_t stages) noexcept
 {
-  m_target_drive = drive;
+  assert(stages <= max_stages);
+  m_stages = stages;
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_delay(float delay) noexcept
+template <class FpType, class Storage, class Capacity>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::Derived::generate_rand() noexcept
 {
-  m_delay = delay;
+  Random::generate(m_rand_vals, m_seed, m_crossmix);
+}
 
-  generate_delay();
+template <class FpType, class Storage, class Capacity>
+inline void AllpassDiffuser<FpType, Storage, Capacity>::Derived::generate_delay() noexcept
+{
+  for(size_t filter = 0; filter < m_stages; ++filter)
+  {
+    m_filters[filter].set_delay(m_delay * std::exp(-2.3f * m_rand_vals[filter]));
+  }
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_mod_depth(float mod_depth) noexcept
+template <class FpType, class Storage, class Capacity>
+inline void
+AllpassDiffuser<FpType, Storage, Capacity>::Derived::generate_mod_depth() noexcept
 {
-  m_mod_depth = mod_depth;
+  for(size_t filter = 0; filter < m_stages; ++filter)
+  {
+    m_filters[filter].set_mod_depth(
+        m_mod_depth * (0.85f + 0.3f * m_rand_vals[rand_stages + filter]));
+  }
+}
 
-  generate_mod_depth();
+template <class FpType, class Storage, class Capacity>
+inline void
+AllpassDiffuser<FpType, Storage, Capacity>::Derived::generate_mod_rate() noexcept
+{
+  for(size_t filter = 0; filter < m_stages; ++filter)
+  {
+    m_filters[filter].set_mod_rate(
+        m_mod_rate * (0.85f + 0.3f * m_rand_vals[2 * rand_stages + filter]));
+  }
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::set_mod_rate(float mod_rate) noexcept
+template <class FpType, class Storage, class Capacity>
+inline double AllpassDiffuser<FpType, Storage, Capacity>::Derived::delay() const noexcept
 {
-  m_mod_rate = mod_rate;
+  double delay = 0.;
+  for(uint32_t i = 0; i < m_stages; ++i)
+    delay += static_cast<double>(m_filters[i].delay());
+  return delay;
+}
 
-  generate_mod_rate();
+template <class FpType, class Storage, class Capacity>
+inline double AllpassDiffuser<FpType, Storage, Capacity>::Derived::max_group_delay(
+    float feedback) const noexcept
+{
+  const double g = std::abs(static_cast<double>(feedback));
+  if(g >= 1.)
+    return std::numeric_limits<double>::infinity();
+
+  double delay = 0.;
+  for(uint32_t i = 0; i < m_stages; ++i)
+    delay += static_cast<double>(m_filters[i].delay() + m_filters[i].mod_depth());
+  return delay * (1. + g) / (1. - g);
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::generate_delay() noexcept
+template <class FpType, class Storage, class Capacity>
+inline double AllpassDiffuser<FpType, Storage, Capacity>::Derived::decay_time(
+    float feedback, double gain) const noexcept
 {
-  for(size_t filter = 0; filter < m_filters.size(); ++filter)
+  double decay = 0.;
+  for(uint32_t i = 0; i < m_stages; ++i)
   {
-    m_filters[filter].set_delay(m_delay * std::exp(-2.3f * m_rand_vals[filter]));
+    const auto& filter = m_filters[i];
+    decay = std::max(
+        decay, math::decay_time(
+                   static_cast<double>(filter.delay() + filter.mod_depth()),
+                   static_cast<double>(feedback), gain));
   }
+  return decay;
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::generate_mod_depth() noexcept
+/*
+    A sparse FIR diffuser of velvet noise, a cheaper alternative to
+    AllpassDiffuser
+
+    Velvet noise holds one impulse of random sign per grid period, at a
+    random position within the period. A few impulses per stage are
+    spread over the delay with a decaying envelope and normalized to unit
+    energy, which smears transients like the allpass chain, without
+    feedback, modulation or drive. The impulses are drawn from the seed
+    and the crossmix like the delays of AllpassDiffuser.
+
+    The taps are the derived state, which is kept apart in Derived and
+    passed to process. Its setters only store their value, the taps are
+    recomputed by the generate functions.
+
+    The samples are kept in a linear buffer that is moved back to its
+    start when it is full, so that every tap reads a contiguous range
+    and process runs one vectorizable loop per tap.
+*/
+template <class Capacity = DefaultCapacity>
+class VelvetDiffuser
 {
-  for(size_t filter = 0; filter < m_filters.size(); ++filter)
+public:
+  static constexpr uint32_t taps_per_stage = 6;
+  static constexpr uint32_t max_stages = Capacity::stages;
+  static constexpr uint32_t max_taps = max_stages * taps_per_stage;
+
+  static constexpr std::pair<float, float> delay_bounds
+      = AllpassDiffuser<float, float, Capacity>::delay_bounds;
+
+private:
+  // the random values are drawn for the default number of stages
+  static constexpr uint32_t rand_taps = DefaultCapacity::stages * taps_per_stage;
+  static_assert(max_taps <= rand_taps);
+
+  // the samples the taps reach back at 'rate'
+  static uint32_t history(float rate) noexcept
   {
-    m_filters[filter].set_mod_depth(
-        m_mod_depth * (0.85f + 0.3f * m_rand_vals[max_stages + filter]));
+    return static_cast<uint32_t>(delay_bounds.second * rate) + 1;
   }
+
+public:
+  class Derived
+  {
+  public:
+    explicit Derived(float rate) noexcept;
+
+    void set_seed(uint32_t seed) noexcept { m_seed = seed; }
+    void set_seed_crossmix(float crossmix) noexcept { m_crossmix = crossmix; }
+    void set_stages(uint32_t stages) noexcept;
+    // the length of the impulses in samples
+    void set_delay(float delay) noexcept { m_delay = delay; }
+
+    void generate_rand() noexcept;
+    void generate_taps() noexcept;
+
+    // the delay of the last tap
+    double length() const noexcept
+    {
+      return m_taps != 0 ? static_cast<double>(m_tap_delay[m_taps - 1]) : 0.;
+    }
+
+  private:
+    friend class VelvetDiffuser;
+
+    uint32_t m_history;
+
+    std::array<uint32_t, max_taps> m_tap_delay = {};
+    std::array<float, max_taps> m_tap_gain = {};
+    // used for the position and the sign of every tap
+    std::array<float, 2 * rand_taps> m_rand_vals = {};
+    uint32_t m_taps = 0;
+
+    uint32_t m_stages = 0;
+    float m_delay = 10.f;
+    uint32_t m_seed = 0;
+    float m_crossmix = 0.f;
+  };
+
+  explicit VelvetDiffuser(float rate);
+  VelvetDiffuser(const VelvetDiffuser&) = delete;
+  VelvetDiffuser& operator=(const VelvetDiffuser&) = delete;
+  VelvetDiffuser(VelvetDiffuser&&) noexcept = default;
+  VelvetDiffuser& operator=(VelvetDiffuser&&) noexcept = default;
+
+  float push(const Derived& d, float sample) noexcept
+  {
+    process(d, &sample, 1);
+    return sample;
+  }
+
+  // same as pushing the samples one by one, 'n' is at most chunk_size
+  void process(const Derived& d, float* samples, uint32_t n) noexcept;
+
+  void clear() noexcept
+  {
+    std::fill(m_buf.begin(), m_buf.end(), 0.f);
+    m_pos = m_history;
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_pos);
+    ar.buffer(m_buf.data(), m_buf.size());
+    if(!ar.check(m_pos >= m_history && m_pos <= m_buf.size()))
+      m_pos = m_history;
+  }
+
+private:
+  // the history of m_history samples ends at m_pos
+  std::vector<float> m_buf;
+  uint32_t m_history;
+  uint32_t m_pos;
+};
+
+template <class Capacity>
+inline VelvetDiffuser<Capacity>::VelvetDiffuser(float rate)
+    : m_history{history(rate)}
+    , m_pos{m_history}
+{
+  // moved back once every m_history samples
+  m_buf.resize(m_history + std::max(m_history, chunk_size));
 }
 
-template <class FpType>
-inline void AllpassDiffuser<FpType>::generate_mod_rate() noexcept
+template <class Capacity>
+inline VelvetDiffuser<Capacity>::Derived::Derived(float rate) noexcept
+    : m_history{history(rate)}
+{
+  generate_rand();
+}
+
+template <class Capacity>
+inline void VelvetDiffuser<Capacity>::Derived::set_stages(uint32_t stages) noexcept
+{
+  assert(stages <= max_stages);
+  m_stages = stages;
+}
+
+template <class Capacity>
+inline void
+VelvetDiffuser<Capacity>::process(const Derived& d, float* samples, uint32_t n) noexcept
 {
-  for(size_t filter = 0; filter < m_filters.size(); ++filter)
+  assert(n <= chunk_size);
+  assert(d.m_history == m_history);
+  if(m_pos + n > m_buf.size())
   {
-    m_filters[filter].set_mod_rate(
-        m_mod_rate * (0.85f + 0.3f * m_rand_vals[2 * max_stages + filter]));
+    std::copy(m_buf.begin() + (m_pos - m_history), m_buf.begin() + m_pos, m_buf.begin());
+    m_pos = m_history;
+  }
+
+  // the history is kept while there are no taps, so that they do not
+  // replay the samples from before when stages are added again
+  float* const end = m_buf.data() + m_pos;
+  std::copy_n(samples, n, end);
+  if(d.m_taps == 0)
+  {
+    m_pos += n;
+    return;
+  }
+
+  // summed apart from the buffer, so that the loops cannot alias
+  std::array<float, chunk_size> output = {};
+  for(uint32_t tap = 0; tap < d.m_taps; ++tap)
+  {
+    const float gain = d.m_tap_gain[tap];
+    const float* input = end - d.m_tap_delay[tap];
+    for(uint32_t i = 0; i < n; ++i)
+      output[i] += gain * input[i];
+  }
+  std::copy_n(output.begin(), n, samples);
+  m_pos += n;
+}
+
+template <class Capacity>
+inline void VelvetDiffuser<Capacity>::Derived::generate_rand() noexcept
+{
+  Random::generate(m_rand_vals, m_seed, m_crossmix);
+}
+
+template <class Capacity>
+inline void VelvetDiffuser<Capacity>::Derived::generate_taps() noexcept
+{
+  m_taps = m_stages * taps_per_stage;
+  if(m_taps == 0)
+    return;
+
+  // the envelope decays by about 26dB over the length
+  constexpr float decay = 3.f;
+  const float length = std::clamp(m_delay, 1.f, static_cast<float>(m_history - 1));
+  const float period = length / static_cast<float>(m_taps);
+
+  float energy = 0.f;
+  for(uint32_t tap = 0; tap < m_taps; ++tap)
+  {
+    const float position = (static_cast<float>(tap) + m_rand_vals[tap]) * period;
+    const float sign = m_rand_vals[rand_taps + tap] < 0.5f ? -1.f : 1.f;
+    m_tap_delay[tap] = std::min(static_cast<uint32_t>(position), m_history - 1);
+    m_tap_gain[tap] = sign * std::exp(-decay * position / length);
+    energy += m_tap_gain[tap] * m_tap_gain[tap];
   }
+
+  const float normalize = 1.f / std::sqrt(energy);
+  for(uint32_t tap = 0; tap < m_taps; ++tap)
+    m_tap_gain[tap] *= normalize;
 }
 }
 
@@ -5,6 +5,8 @@
 
 #include <cmath>
 
+#include <complex>
+#include <cstdint>
 #include <tuple>
 
 namespace Aether
@@ -24,37 +26,58 @@ template <class FpType>
 class Lowpass6dB
 {
 public:
-  Lowpass6dB(Lowpass6dB&& other) noexcept = default;
-  Lowpass6dB& operator=(Lowpass6dB&& other) noexcept = default;
-
-  Lowpass6dB(FpType rate, FpType cutoff = 0)
-      : m_rate{rate}
-      , a{}
+  // the derived state, shared by the filters with the same sample rate
+  class Coefficients
   {
-    set_cutoff(cutoff);
-  }
-
-  FpType push(FpType sample) noexcept
+  public:
+    explicit Coefficients(FpType rate, FpType cutoff = 0)
+        : m_rate{rate}
+    {
+      set_cutoff(cutoff);
+    }
+
+    void set_cutoff(FpType cutoff) noexcept
+    {
+      FpType w = 2 * constants::pi_v<FpType> * cutoff / m_rate;
+      a = w / (1 + w);
+    }
+
+    // of the frequency response at 'frequency' in Hz
+    FpType magnitude(FpType frequency) const noexcept
+    {
+      const auto z
+          = std::polar(FpType{1}, -2 * constants::pi_v<FpType> * frequency / m_rate);
+      return a / std::abs(FpType{1} - (1 - a) * z);
+    }
+
+  private:
+    friend class Lowpass6dB;
+    template <uint32_t>
+    friend class LateLanes;
+
+    FpType m_rate;
+    FpType a = 0;
+  };
+
+  FpType push(const Coefficients& c, FpType sample) noexcept
   {
-    y = y + a * (sample - y);
+    y = y + c.a * (sample - y);
     return y;
   }
 
   void clear() noexcept { y = 0; }
 
-  void set_cutoff(FpType cutoff) noexcept
+  template <class Archive>
+  void serialize(Archive& ar)
   {
-    FpType w = 2 * constants::pi_v<FpType> * cutoff / m_rate;
-    a = w / (1 + w);
-
-    if(a == 0)
-      y = 0;
+    ar(y);
   }
 
 private:
-  FpType m_rate{};
+  template <uint32_t>
+  friend class LateLanes;
+
   FpType y = 0;
-  FpType a;
 };
 
 /*
@@ -66,19 +89,20 @@ template <class FpType>
 class Highpass6dB
 {
 public:
-  Highpass6dB(Highpass6dB&& other) noexcept = default;
-  Highpass6dB& operator=(Highpass6dB&& other) noexcept = default;
+  using Coefficients = typename Lowpass6dB<FpType>::Coefficients;
 
-  Highpass6dB(FpType rate, FpType cutoff = 0)
-      : m_lowpass(rate, cutoff)
+  FpType push(const Coefficients& c, FpType sample) noexcept
   {
+    return sample - m_lowpass.push(c, sample);
   }
 
-  FpType push(FpType sample) noexcept { return sample - m_lowpass.push(sample); }
-
   void clear() noexcept { m_lowpass.clear(); }
 
-  void set_cutoff(FpType cutoff) noexcept { m_lowpass.set_cutoff(cutoff); }
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_lowpass);
+  }
 
 private:
   Lowpass6dB<FpType> m_lowpass;
@@ -97,53 +121,67 @@ template <class Generator, class FpType>
 class Biquad
 {
 public:
-  Biquad(Biquad&& other) noexcept = default;
-  Biquad& operator=(Biquad&& other) noexcept = default;
-
-  Biquad(
-      FpType rate, FpType cutoff, FpType gain,
-      std::tuple<FpType, FpType, FpType, FpType, FpType> coefs, Generator gen)
-      : m_rate{rate}
-      , m_cutoff{cutoff}
-      , m_gain{gain}
-      , m_gen{gen}
-      , a1{std::get<0>(coefs)}
-      , a2{std::get<1>(coefs)}
-      , b0{std::get<2>(coefs)}
-      , b1{std::get<3>(coefs)}
-      , b2{std::get<4>(coefs)}
-  {
-  }
-
-  Biquad(FpType rate, Generator gen = Generator{})
-      : Biquad(
-          rate, 0, 1, gen(rate, static_cast<FpType>(0), static_cast<FpType>(1)), gen)
-  {
-  }
-
-  void set_sample_rate(FpType rate)
+  // the derived state, shared by the filters with the same sample rate
+  class Coefficients
   {
-    m_rate = rate;
-    std::tie(a1, a2, b0, b1, b2) = m_gen(m_rate, m_cutoff, m_gain);
-  }
-
-  void set_cutoff(FpType cutoff)
+  public:
+    explicit Coefficients(FpType rate, Generator gen = Generator{})
+        : m_rate{rate}
+        , m_gen{gen}
+    {
+      update();
+    }
+
+    void set_sample_rate(FpType rate)
+    {
+      m_rate = rate;
+      update();
+    }
+
+    void set_cutoff(FpType cutoff)
+    {
+      m_cutoff = cutoff;
+      update();
+    }
+
+    void set_gain(FpType gain)
+    {
+      m_gain = gain;
+      update();
+    }
+
+    void set_cutoff_and_gain(FpType cutoff, FpType gain)
+    {
+      m_cutoff = cutoff;
+      m_gain = gain;
+      update();
+    }
+
+    // of the frequency response at 'frequency' in Hz
+    FpType magnitude(FpType frequency) const noexcept
+    {
+      const auto z
+          = std::polar(FpType{1}, -2 * constants::pi_v<FpType> * frequency / m_rate);
+      return std::abs((b0 + b1 * z + b2 * z * z) / (FpType{1} + a1 * z + a2 * z * z));
+    }
+
+  private:
+    friend class Biquad;
+    template <uint32_t>
+    friend class LateLanes;
+
+    void update() { std::tie(a1, a2, b0, b1, b2) = m_gen(m_rate, m_cutoff, m_gain); }
+
+    FpType m_rate, m_cutoff = 0, m_gain = 1;
+    [[no_unique_address]] Generator m_gen;
+    FpType a1, a2, b0, b1, b2;
+  };
+
+  FpType push(const Coefficients& c, FpType x) noexcept
   {
-    m_cutoff = cutoff;
-    std::tie(a1, a2, b0, b1, b2) = m_gen(m_rate, m_cutoff, m_gain);
-  }
-
-  void set_gain(FpType gain)
-  {
-    m_gain = gain;
-    std::tie(a1, a2, b0, b1, b2) = m_gen(m_rate, m_cutoff, m_gain);
-  }
-
-  FpType push(FpType x) noexcept
-  {
-    FpType y = b0 * x + s1;
-    s1 = s2 + b1 * x - a1 * y;
-    s2 = b2 * x - a2 * y;
+    FpType y = c.b0 * x + s1;
+    s1 = s2 + c.b1 * x - c.a1 * y;
+    s2 = c.b2 * x - c.a2 * y;
     return y;
   }
 
@@ -153,12 +191,16 @@ public:
     s2 = 0;
   }
 
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(s1, s2);
+  }
+
 protected:
-  FpType m_rate, m_cutoff, m_gain;
-  // coefs
-  [[no_unique_address]] Generator m_gen;
-  FpType a1, a2, b0, b1, b2;
-  // state
+  template <uint32_t>
+  friend class LateLanes;
+
   FpType s1 = 0, s2 = 0;
 };
 
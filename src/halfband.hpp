@@ -0,0 +1,259 @@
+#ifndef HALFBAND_HPP
+#define HALFBAND_HPP
+
+#include "constants.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+namespace Aether
+{
+/*
+    Half-band lowpass for resampling by a factor of two
+
+    All even coefficients of a half-band filter are zero except for the
+    center one, which is 1/2. Split into its two polyphase components,
+    one output sample at the lower rate costs 'pairs' multiplications.
+
+    The coefficients are a Blackman windowed sinc. Relative to the higher
+    rate, the passband is flat up to about 0.17 and the stopband starts at
+    about 0.34, attenuated by at least 60dB.
+*/
+class Halfband
+{
+public:
+  // nonzero coefficient pairs besides the center
+  static constexpr uint32_t pairs = 8;
+
+  Halfband()
+  {
+    // the odd coefficients, 1 / (2 pi n) sin(pi n / 2) on both sides of the center
+    constexpr float pi = constants::pi_v<float>;
+    constexpr float half_length = 2 * pairs;
+    float sum = 0.f;
+    for(uint32_t k = 0; k < pairs; ++k)
+    {
+      const float n = static_cast<float>(2 * k + 1);
+      const float window = 0.42f + 0.5f * std::cos(pi * n / half_length)
+                         + 0.08f * std::cos(2 * pi * n / half_length);
+      m_coefficients[k] = window * std::sin(pi * n / 2) / (pi * n);
+      sum += 2 * m_coefficients[k];
+    }
+
+    // unity gain at DC
+    for(float& coefficient : m_coefficients)
+      coefficient *= 0.5f / sum;
+  }
+
+protected:
+  // the symmetric sum of history[center - k] and history[center + 1 + k]
+  template <size_t N>
+  float symmetric(const std::array<float, N>& history, uint32_t center) const noexcept
+  {
+    float sum = 0.f;
+    for(uint32_t k = 0; k < pairs; ++k)
+      sum += m_coefficients[k] * (history[center - k] + history[center + 1 + k]);
+    return sum;
+  }
+
+  std::array<float, pairs> m_coefficients;
+};
+
+/*
+    Halves the rate, push returns true and the filtered sample
+    for every second sample
+*/
+class HalfbandDecimator : Halfband
+{
+public:
+  bool push(float sample, float& out) noexcept
+  {
+    if(!m_odd)
+    {
+      m_even = sample;
+      m_odd = true;
+      return false;
+    }
+    m_odd = false;
+
+    // every pair of samples is appended to both halves of the histories,
+    // so that they can always be read as one contiguous window
+    m_pos = m_pos == 0 ? length - 1 : m_pos - 1;
+    m_evens[m_pos] = m_evens[m_pos + length] = m_even;
+    m_odds[m_pos] = m_odds[m_pos + length] = sample;
+
+    // with the newest sample first, the center of the filter is the
+    // even sample at index 'pairs - 1', and the odd samples are
+    // symmetric around the odd samples 'pairs - 1' and 'pairs'
+    const float center = m_evens[m_pos + pairs - 1];
+    out = 0.5f * center + symmetric(m_odds, m_pos + pairs - 1);
+    return true;
+  }
+
+  // keeps the phase, which the resampler relies on
+  void clear() noexcept
+  {
+    m_evens = {};
+    m_odds = {};
+    m_even = 0.f;
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_evens, m_odds, m_even, m_pos, m_odd);
+    if(!ar.check(m_pos < length))
+      m_pos = 0;
+  }
+
+private:
+  static constexpr uint32_t length = 2 * pairs;
+
+  std::array<float, 2 * length> m_evens = {};
+  std::array<float, 2 * length> m_odds = {};
+  float m_even = 0.f;
+  uint32_t m_pos = 0;
+  bool m_odd = false;
+};
+
+/*
+    Doubles the rate, every sample pushed yields two samples
+*/
+class HalfbandInterpolator : Halfband
+{
+public:
+  void push(float sample, float& first, float& second) noexcept
+  {
+    m_pos = m_pos == 0 ? length - 1 : m_pos - 1;
+    m_history[m_pos] = m_history[m_pos + length] = sample;
+
+    // the gain of 2 makes up for the zeros between the samples
+    first = 2.f * symmetric(m_history, m_pos + pairs - 1);
+    second = m_history[m_pos + pairs - 1];
+  }
+
+  void clear() noexcept { m_history = {}; }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_history, m_pos);
+    if(!ar.check(m_pos < length))
+      m_pos = 0;
+  }
+
+private:
+  static constexpr uint32_t length = 2 * pairs;
+
+  std::array<float, 2 * length> m_history = {};
+  uint32_t m_pos = 0;
+};
+
+/*
+    Runs a process at the sample rate divided by 2^stages
+
+    push takes samples at the full rate and returns true whenever a
+    sample at the reduced rate is ready, which is then processed and
+    handed to put. pull returns one sample of the processed signal at
+    the full rate for every pushed sample.
+*/
+class HalfbandResampler
+{
+public:
+  static constexpr uint32_t max_stages = 2;
+  static constexpr uint32_t max_factor = 1 << max_stages;
+
+  explicit HalfbandResampler(uint32_t stages = 0)
+      : m_stages{stages}
+  {
+    assert(stages <= max_stages);
+  }
+
+  uint32_t factor() const noexcept { return 1u << m_stages; }
+
+  // samples pushed since the last sample at the reduced rate
+  uint32_t phase() const noexcept { return m_phase; }
+
+  // the delay of the filters and the buffering in samples at the full rate
+  uint32_t latency() const noexcept
+  {
+    // both filters delay by 2 * pairs - 1 samples at the higher rate
+    return (factor() - 1) * 2 * (2 * Halfband::pairs - 1) + factor() - 1;
+  }
+
+  // the number of samples at the reduced rate for the next 'samples' pushes
+  uint64_t reduced_samples(uint64_t samples) const noexcept
+  {
+    return (m_phase + samples) >> m_stages;
+  }
+
+  bool push(float sample, float& reduced) noexcept
+  {
+    m_phase = (m_phase + 1) & (factor() - 1);
+    for(uint32_t stage = 0; stage < m_stages; ++stage)
+    {
+      if(!m_down[stage].push(sample, sample))
+        return false;
+    }
+    assert(m_phase == 0);
+    reduced = sample;
+    return true;
+  }
+
+  void put(float processed) noexcept
+  {
+    m_out[0] = processed;
+    for(uint32_t stage = m_stages, samples = 1; stage-- > 0; samples *= 2)
+    {
+      // expands in place from the back, every sample into two
+      for(uint32_t i = samples; i-- > 0;)
+        m_up[stage].push(m_out[i], m_out[2 * i], m_out[2 * i + 1]);
+    }
+    m_pos = 0;
+  }
+
+  float pull() noexcept
+  {
+    assert(m_pos < factor());
+    return m_out[m_pos++];
+  }
+
+  void clear() noexcept
+  {
+    for(auto& down : m_down)
+      down.clear();
+    for(auto& up : m_up)
+      up.clear();
+    m_out = {};
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(m_down, m_up, m_out, m_phase, m_pos);
+    if(!ar.check(m_phase < factor() && m_pos <= factor()))
+    {
+      m_phase = 0;
+      m_pos = factor();
+    }
+  }
+
+private:
+  uint32_t m_stages;
+
+  std::array<HalfbandDecimator, max_stages> m_down;
+  std::array<HalfbandInterpolator, max_stages> m_up;
+
+  // the processed samples at the full rate, returned by pull
+  std::array<float, max_factor> m_out = {};
+  // samples pushed since the last reduced sample
+  uint32_t m_phase = 0;
+  uint32_t m_pos = 0;
+};
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace Aether
+{
+/*
+    Processing kernels specialized on settings that are constant for a block
+
+    A variant is identified by an index holding the settings. All variants
+    are instantiated into a table, so that the kernel is looked up once per
+    block instead of branching on the settings for every sample.
+
+    'make' is called with a std::integral_constant holding the index
+*/
+template <class Kernel, size_t Variants, class Make>
+constexpr std::array<Kernel, Variants> make_kernel_table(Make make) noexcept
+{
+  return [&]<size_t... Is>(std::index_sequence<Is...>) {
+    return std::array<Kernel, Variants>{
+        make(std::integral_constant<uint32_t, Is>{})...};
+  }(std::make_index_sequence<Variants>{});
+}
+
+constexpr bool variant_flag(uint32_t variant, uint32_t flag) noexcept
+{
+  return (variant >> flag) & 1;
+}
+
+/*
+    Upper bound of the chunks processed by the chunked kernels, which keep
+    the intermediate results of a chunk in arrays on the stack
+*/
+inline constexpr uint32_t chunk_size = 64;
+
+// calls 'f' with a std::integral_constant for every index in [0, N)
+template <size_t N, class F>
+inline void unroll(F&& f)
+{
+  [&]<size_t... Is>(std::index_sequence<Is...>) {
+    (f(std::integral_constant<size_t, Is>{}), ...);
+  }(std::make_index_sequence<N>{});
+}
+}
+
+#endif
@@ -0,0 +1,687 @@
+#ifndef LATE_LANES_HPP
+#define LATE_LANES_HPP
+
+#include "delayline.hpp"
+#include "diffuser.hpp"
+#include "kernels.hpp"
+#include "lfo.hpp"
+#include "ringbuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace Aether
+{
+/*
+    The late reverberations of up to Lanes LateRev instances, processed
+    together with one instance per lane
+
+    Within an instance, every sample depends on the previous ones through
+    the allpass stages, the damping and the feedback. Across instances
+    nothing does, so the chunks of Delayline::process run as loops over
+    the lanes, which the compiler vectorizes: the modulation, the
+    interpolation, the damping and the drive. The state of the instances
+    is copied into arrays with one element per lane for every chunk and
+    back afterwards. Only the delay buffers stay where they are, they are
+    read and written one lane at a time.
+
+    The instances have to run the same kernels, see compatible. Their
+    derived state is read from the LateRev::Derived they are processed
+    with. The result is the same as processing them one by one. They have the capacity of
+    the DSP, see EngineCapacity.
+*/
+template <uint32_t Lanes>
+class LateLanes
+{
+public:
+  using LateRev = Aether::LateRev<EngineCapacity>;
+  using Delayline = Aether::Delayline<EngineCapacity>;
+
+  template <class T>
+  using Lane = std::array<T, Lanes>;
+
+  // whether 'a' and 'b' run the same kernels, only the drive may differ
+  static bool compatible(const LateRev& a, const LateRev& b) noexcept
+  {
+    const Delayline::PushInfo& x = a.m_info;
+    const Delayline::PushInfo& y = b.m_info;
+    return a.m_active_lines == b.m_active_lines && x.order == y.order && x.modulated == y.modulated
+        && x.damping_info.ls_enable == y.damping_info.ls_enable
+        && x.damping_info.hs_enable == y.damping_info.hs_enable
+        && x.damping_info.hc_enable == y.damping_info.hc_enable
+        && x.diffuser_info.stages == y.diffuser_info.stages
+        && x.diffuser_info.interpolate == y.diffuser_info.interpolate
+        && x.diffuser_info.modulated == y.diffuser_info.modulated;
+  }
+
+  /*
+      Same as late[k]->process(*derived[k], input[k], output[k], n, feedback[k])
+      for the first 'count' lanes, which are compatible. 'n' is at most
+      chunk_size.
+  */
+  void process(
+      const Lane<LateRev*>& late, const Lane<const LateRev::Derived*>& derived,
+      uint32_t count, const Lane<const float*>& input, const Lane<float*>& output,
+      uint32_t n, const Lane<float>& feedback) noexcept;
+
+private:
+  using Ring = Ringbuffer<double, LateStorage>;
+  using Diffuser = Delayline::Diffuser;
+
+  static constexpr uint32_t max_stages = Diffuser::max_stages;
+
+  struct Modulation
+  {
+    Lane<double> re;
+    Lane<double> im;
+    Lane<double> step_re;
+    Lane<double> step_im;
+
+    void load(uint32_t k, const LFO& lfo, const LFO::Rate& rate) noexcept
+    {
+      re[k] = lfo.m_phase.real();
+      im[k] = lfo.m_phase.imag();
+      step_re[k] = rate.step.real();
+      step_im[k] = rate.step.imag();
+    }
+
+    void store(uint32_t k, LFO& lfo) const noexcept { lfo.m_phase = {re[k], im[k]}; }
+
+    // LFO::next
+    void next() noexcept
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        const double r = re[k] * step_re[k] - im[k] * step_im[k];
+        im[k] = re[k] * step_im[k] + im[k] * step_re[k];
+        re[k] = r;
+      }
+    }
+  };
+
+  struct Biquad
+  {
+    Lane<double> a1, a2, b0, b1, b2;
+    Lane<double> s1, s2;
+
+    template <class Filter>
+    void load(
+        uint32_t k, const typename Filter::Coefficients& c, const Filter& filter) noexcept
+    {
+      a1[k] = c.a1;
+      a2[k] = c.a2;
+      b0[k] = c.b0;
+      b1[k] = c.b1;
+      b2[k] = c.b2;
+      s1[k] = filter.s1;
+      s2[k] = filter.s2;
+    }
+
+    template <class Filter>
+    void store(uint32_t k, Filter& filter) const noexcept
+    {
+      filter.s1 = s1[k];
+      filter.s2 = s2[k];
+    }
+
+    void push(Lane<double>& x) noexcept
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        const double y = b0[k] * x[k] + s1[k];
+        s1[k] = s2[k] + b1[k] * x[k] - a1[k] * y;
+        s2[k] = b2[k] * x[k] - a2[k] * y;
+        x[k] = y;
+      }
+    }
+  };
+
+  struct Allpass
+  {
+    Lane<Ring*> buf;
+    Lane<float> delay;
+    Lane<float> mod_depth;
+    Modulation lfo;
+  };
+
+  // the state of one delay line of every lane
+  struct Line
+  {
+    Lane<double> last_out;
+    Lane<double> feedback;
+
+    Biquad low_shelf;
+    Biquad high_shelf;
+    Lane<double> high_cut_a;
+    Lane<double> high_cut_y;
+
+    Lane<Ring*> buf;
+    Lane<float> delay;
+    Lane<float> mod_depth;
+    Modulation lfo;
+
+    Lane<float> drive;
+    Lane<float> target_drive;
+    Lane<float> drive_smoothing;
+    // whether the diffuser kernel of the lane applies the drive
+    Lane<bool> drive_enabled;
+    std::array<Allpass, max_stages> stages;
+  };
+
+  template <class T>
+  using Chunk = std::array<Lane<T>, chunk_size>;
+
+  using Kernel = void (LateLanes::*)(uint32_t, uint32_t, uint32_t) noexcept;
+
+  // order, modulated, interpolate, diffuser modulated and drive
+  static constexpr uint32_t kernel_variants = 1 << 5;
+
+  // the unused lanes repeat the last one, but are never written back
+  void load(
+      const Lane<LateRev*>& late, const Lane<const LateRev::Derived*>& derived,
+      uint32_t count) noexcept;
+  void store(const Lane<LateRev*>& late, uint32_t count) const noexcept;
+
+  // Delayline::process for every lane, adds to m_sum
+  template <uint32_t Variant>
+  void kernel(uint32_t line, uint32_t count, uint32_t n) noexcept;
+
+  template <Delayline::Order order, bool Modulated, bool Interpolate,
+            bool DiffuserModulated, bool Drive>
+  void process_chunk(Line& line, uint32_t count, uint32_t start, uint32_t n) noexcept;
+
+  // the loop over the lanes of the damping
+  void damp(Line& line) noexcept;
+
+  // ModulatedDelay::read
+  template <bool Modulated>
+  void read(Line& line, Lane<double>* out, uint32_t n) noexcept;
+
+  // AllpassDiffuser::process
+  template <bool Interpolate, bool Modulated, bool Drive>
+  void diffuse(Line& line, uint32_t count, Lane<double>* samples, uint32_t n) noexcept;
+
+  // ModulatedAllpass::process_chunk
+  template <bool Interpolate, bool Modulated, bool Drive>
+  void process_allpass(
+      Allpass& stage, const Line& line, uint32_t count, Lane<double>* samples,
+      const Lane<float>* drives, uint32_t n) noexcept;
+
+  // pushes 'n' samples of every used lane
+  static void write(
+      const Lane<Ring*>& buf, uint32_t count, const Lane<double>* samples,
+      uint32_t n) noexcept;
+
+  std::array<Line, LateRev::max_lines> m_lines;
+  uint32_t m_line_count = 0;
+  Delayline::Filters::PushInfo m_damping = {};
+  uint32_t m_stages = 0;
+
+  Lane<float> m_gain;
+  Lane<float> m_gain_target;
+  Lane<float> m_gain_smoothing;
+  Lane<double> m_feedback;
+
+  Chunk<double> m_input;
+  Chunk<double> m_sum;
+
+  // the intermediate results of a chunk
+  Chunk<double> m_delayed;
+  Chunk<double> m_diffused;
+  Chunk<double> m_samples;
+  Chunk<float> m_drives;
+  Chunk<float> m_delays;
+  Chunk<uint32_t> m_floors;
+  Chunk<double> m_taps;
+  Chunk<double> m_next_taps;
+  Chunk<double> m_buffer_input;
+  Chunk<float> m_output;
+};
+
+template <uint32_t Lanes>
+inline void LateLanes<Lanes>::process(
+    const Lane<LateRev*>& late, const Lane<const LateRev::Derived*>& derived,
+    uint32_t count, const Lane<const float*>& input, const Lane<float*>& output,
+    uint32_t n, const Lane<float>& feedback) noexcept
+{
+  static constexpr auto kernels
+      = make_kernel_table<Kernel, kernel_variants>([](auto variant) {
+          return &LateLanes::kernel<decltype(variant)::value>;
+        });
+
+  assert(count > 0 && count <= Lanes);
+  assert(n <= chunk_size);
+
+  // lines shorter than a sample are pushed one sample at a time
+  const uint32_t lines = late[0]->m_active_lines;
+  for(uint32_t k = 0; k < count; ++k)
+  {
+    for(uint32_t line = 0; line < lines; ++line)
+    {
+      if(derived[k]->m_delay_lines[line].delay.lookahead() == 0)
+      {
+        for(uint32_t j = 0; j < count; ++j)
+          late[j]->process(*derived[j], input[j], output[j], n, feedback[j]);
+        return;
+      }
+    }
+  }
+
+  load(late, derived, count);
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    const uint32_t from = std::min(k, count - 1);
+    m_feedback[k] = static_cast<double>(feedback[from]);
+    for(uint32_t i = 0; i < n; ++i)
+      m_input[i][k] = static_cast<double>(input[from][i]);
+  }
+
+  const Delayline::PushInfo& info = late[0]->m_info;
+  bool drive = false;
+  for(uint32_t line = 0; line < lines; ++line)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+      drive = drive || m_lines[line].drive_enabled[k];
+  }
+  const uint32_t variant = static_cast<uint32_t>(info.order)
+                         | uint32_t{info.modulated} << 1
+                         | uint32_t{info.diffuser_info.interpolate} << 2
+                         | uint32_t{info.diffuser_info.modulated} << 3
+                         | uint32_t{drive} << 4;
+
+  // summed in the same order as by LateRev::chunk_kernel
+  for(uint32_t i = 0; i < n; ++i)
+    m_sum[i] = {};
+  for(uint32_t line = 0; line < lines; ++line)
+    (this->*kernels[variant])(line, count, n);
+
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      m_gain[k] = m_gain[k] - m_gain_smoothing[k] * (m_gain[k] - m_gain_target[k]);
+      m_output[i][k] = m_gain[k] * static_cast<float>(m_sum[i][k]);
+    }
+  }
+  for(uint32_t k = 0; k < count; ++k)
+  {
+    for(uint32_t i = 0; i < n; ++i)
+      output[k][i] = m_output[i][k];
+  }
+
+  store(late, count);
+}
+
+template <uint32_t Lanes>
+inline void LateLanes<Lanes>::load(
+    const Lane<LateRev*>& late, const Lane<const LateRev::Derived*>& derived,
+    uint32_t count) noexcept
+{
+  m_line_count = late[0]->m_active_lines;
+  m_damping = late[0]->m_info.damping_info;
+  m_stages = late[0]->m_info.diffuser_info.stages;
+
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    const uint32_t from = std::min(k, count - 1);
+    LateRev& rev = *late[from];
+    const LateRev::Derived& rev_derived = *derived[from];
+    m_gain[k] = rev.m_gain;
+    m_gain_target[k] = rev_derived.m_gain_target;
+    m_gain_smoothing[k] = rev_derived.m_gain_smoothing;
+
+    for(uint32_t l = 0; l < m_line_count; ++l)
+    {
+      Line& line = m_lines[l];
+      Delayline& d = rev.m_delay_lines[l];
+      const Delayline::Derived& dd = rev_derived.m_delay_lines[l];
+      line.last_out[k] = d.m_last_out;
+      line.feedback[k] = dd.feedback;
+
+      line.low_shelf.load(k, dd.damping.ls, d.damping.ls);
+      line.high_shelf.load(k, dd.damping.hs, d.damping.hs);
+      line.high_cut_a[k] = dd.damping.hc.a;
+      line.high_cut_y[k] = d.damping.hc.y;
+
+      // the unused lanes only read
+      line.buf[k] = &d.delay.m_buf;
+      line.delay[k] = dd.delay.m_delay;
+      line.mod_depth[k] = dd.delay.m_mod_depth;
+      line.lfo.load(k, d.delay.m_lfo, dd.delay.m_mod_rate);
+
+      Diffuser& diffuser = d.diffuser;
+      line.drive[k] = diffuser.m_drive;
+      line.target_drive[k] = dd.diffuser.m_target_drive;
+      line.drive_smoothing[k] = diffuser.m_drive_smoothing;
+      line.drive_enabled[k] = variant_flag(diffuser.m_variant, 2);
+      for(uint32_t s = 0; s < m_stages; ++s)
+      {
+        Allpass& stage = line.stages[s];
+        auto& filter = diffuser.m_filters[s];
+        const auto& filter_derived = dd.diffuser.m_filters[s];
+        stage.buf[k] = &filter.m_buf;
+        stage.delay[k] = filter_derived.m_delay;
+        stage.mod_depth[k] = filter_derived.m_mod_depth;
+        stage.lfo.load(k, filter.m_lfo, filter_derived.m_mod_rate);
+      }
+    }
+  }
+}
+
+template <uint32_t Lanes>
+inline void
+LateLanes<Lanes>::store(const Lane<LateRev*>& late, uint32_t count) const noexcept
+{
+  for(uint32_t k = 0; k < count; ++k)
+  {
+    LateRev& rev = *late[k];
+    rev.m_gain = m_gain[k];
+
+    for(uint32_t l = 0; l < m_line_count; ++l)
+    {
+      const Line& line = m_lines[l];
+      Delayline& d = rev.m_delay_lines[l];
+      d.m_last_out = line.last_out[k];
+
+      line.low_shelf.store(k, d.damping.ls);
+      line.high_shelf.store(k, d.damping.hs);
+      d.damping.hc.y = line.high_cut_y[k];
+
+      line.lfo.store(k, d.delay.m_lfo);
+
+      d.diffuser.m_drive = line.drive[k];
+      for(uint32_t s = 0; s < m_stages; ++s)
+        line.stages[s].lfo.store(k, d.diffuser.m_filters[s].m_lfo);
+    }
+  }
+}
+
+template <uint32_t Lanes>
+template <uint32_t Variant>
+inline void LateLanes<Lanes>::kernel(uint32_t line, uint32_t count, uint32_t n) noexcept
+{
+  constexpr auto order
+      = variant_flag(Variant, 0) ? Delayline::Order::post : Delayline::Order::pre;
+  constexpr bool modulated = variant_flag(Variant, 1);
+  constexpr bool interpolate = variant_flag(Variant, 2);
+  constexpr bool diffuser_modulated = variant_flag(Variant, 3);
+  constexpr bool drive = variant_flag(Variant, 4);
+
+  Line& l = m_lines[line];
+  uint32_t lookahead = chunk_size;
+  for(uint32_t k = 0; k < count; ++k)
+  {
+    lookahead = std::min(
+        lookahead,
+        static_cast<uint32_t>(std::max(l.delay[k] - l.mod_depth[k], 0.f)));
+  }
+  assert(lookahead > 0);
+
+  for(uint32_t start = 0; start < n;)
+  {
+    const uint32_t len = std::min(n - start, lookahead);
+    process_chunk<order, modulated, interpolate, diffuser_modulated, drive>(
+        l, count, start, len);
+    start += len;
+  }
+}
+
+template <uint32_t Lanes>
+template <Delayline<EngineCapacity>::Order order, bool Modulated, bool Interpolate,
+          bool DiffuserModulated, bool Drive>
+inline void LateLanes<Lanes>::process_chunk(
+    Line& line, uint32_t count, uint32_t start, uint32_t n) noexcept
+{
+  read<Modulated>(line, m_delayed.data(), n);
+
+  if constexpr(order == Delayline::Order::pre)
+  {
+    for(uint32_t i = 0; i < n; ++i)
+      m_diffused[i] = m_delayed[i];
+    diffuse<Interpolate, DiffuserModulated, Drive>(line, count, m_diffused.data(), n);
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      damp(line);
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        m_samples[i][k] = m_input[start + i][k] + line.last_out[k] * line.feedback[k];
+        line.last_out[k] = m_diffused[i][k];
+      }
+    }
+    write(line.buf, count, m_samples.data(), n);
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+        m_sum[start + i][k] += m_delayed[i][k];
+    }
+  }
+  else
+  {
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      damp(line);
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        m_samples[i][k] = m_input[start + i][k] + line.last_out[k] * line.feedback[k];
+        line.last_out[k] = m_delayed[i][k];
+      }
+    }
+
+    diffuse<Interpolate, DiffuserModulated, Drive>(line, count, m_samples.data(), n);
+    write(line.buf, count, m_samples.data(), n);
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+        m_sum[start + i][k] += m_samples[i][k];
+    }
+  }
+}
+
+template <uint32_t Lanes>
+inline void LateLanes<Lanes>::damp(Line& line) noexcept
+{
+  if(m_damping.ls_enable)
+    line.low_shelf.push(line.last_out);
+  if(m_damping.hs_enable)
+    line.high_shelf.push(line.last_out);
+  if(m_damping.hc_enable)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      double& y = line.high_cut_y[k];
+      y = y + line.high_cut_a[k] * (line.last_out[k] - y);
+      line.last_out[k] = y;
+    }
+  }
+}
+
+template <uint32_t Lanes>
+template <bool Modulated>
+inline void LateLanes<Lanes>::read(Line& line, Lane<double>* out, uint32_t n) noexcept
+{
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      m_delays[i][k] = std::max(line.delay[k], 0.f);
+      if constexpr(Modulated)
+      {
+        m_delays[i][k] = std::max(
+            line.delay[k] + line.mod_depth[k] * static_cast<float>(line.lfo.im[k]), 0.f);
+      }
+      m_floors[i][k] = static_cast<uint32_t>(m_delays[i][k]);
+    }
+    if constexpr(Modulated)
+      line.lfo.next();
+  }
+
+  // the i-th sample reads relative to the end of the buffer after pushing it
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    const Ring& buf = *line.buf[k];
+    const size_t end = buf.end;
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      size_t back = m_floors[i][k] - i - 1;
+      size_t idx1 = end - back + (end < back ? buf.size : 0);
+      size_t idx2 = idx1 - 1 + (idx1 < 1 ? buf.size : 0);
+      m_taps[i][k] = buf[idx1];
+      m_next_taps[i][k] = buf[idx2];
+    }
+  }
+
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      const auto t
+          = static_cast<double>(m_delays[i][k] - static_cast<float>(m_floors[i][k]));
+      out[i][k] = m_taps[i][k] + t * (m_next_taps[i][k] - m_taps[i][k]);
+    }
+  }
+}
+
+template <uint32_t Lanes>
+template <bool Interpolate, bool Modulated, bool Drive>
+inline void LateLanes<Lanes>::diffuse(
+    Line& line, uint32_t count, Lane<double>* samples, uint32_t n) noexcept
+{
+  // the drive of every sample, shared by all stages
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      line.drive[k] = line.target_drive[k]
+                    - line.drive_smoothing[k] * (line.target_drive[k] - line.drive[k]);
+      m_drives[i][k] = line.drive[k];
+    }
+  }
+
+  for(uint32_t s = 0; s < m_stages; ++s)
+  {
+    Allpass& stage = line.stages[s];
+
+    // see ModulatedAllpass::process
+    uint32_t max_chunk = chunk_size;
+    for(uint32_t k = 0; k < count; ++k)
+    {
+      const uint32_t loop_delay
+          = static_cast<uint32_t>(stage.delay[k] - stage.mod_depth[k] - 1.f) + 1;
+      max_chunk = std::min(max_chunk, loop_delay);
+    }
+
+    for(uint32_t start = 0; start < n;)
+    {
+      const uint32_t len = std::min(n - start, max_chunk);
+      process_allpass<Interpolate, Modulated, Drive>(
+          stage, line, count, samples + start, m_drives.data() + start, len);
+      start += len;
+    }
+  }
+}
+
+template <uint32_t Lanes>
+template <bool Interpolate, bool Modulated, bool Drive>
+inline void LateLanes<Lanes>::process_allpass(
+    Allpass& stage, const Line& line, uint32_t count, Lane<double>* samples,
+    const Lane<float>* drives, uint32_t n) noexcept
+{
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+    {
+      m_delays[i][k] = stage.delay[k] - 1.f;
+      if constexpr(Modulated)
+      {
+        m_delays[i][k] = stage.delay[k]
+                       + stage.mod_depth[k] * static_cast<float>(stage.lfo.im[k]) - 1.f;
+      }
+      m_floors[i][k] = static_cast<uint32_t>(m_delays[i][k]);
+    }
+    if constexpr(Modulated)
+      stage.lfo.next();
+  }
+
+  // the i-th sample reads relative to the end of the buffer before the chunk
+  for(uint32_t k = 0; k < Lanes; ++k)
+  {
+    const Ring& buf = *stage.buf[k];
+    const size_t end = buf.end;
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      size_t back = m_floors[i][k] - i;
+      size_t idx1 = end - back + (end < back ? buf.size : 0);
+      m_taps[i][k] = buf[idx1];
+      if constexpr(Interpolate)
+      {
+        size_t idx2 = idx1 - 1 + (idx1 < 1 ? buf.size : 0);
+        m_next_taps[i][k] = buf[idx2];
+      }
+    }
+  }
+
+  if constexpr(Interpolate)
+  {
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        const auto t
+            = static_cast<double>(m_delays[i][k] - static_cast<float>(m_floors[i][k]));
+        m_taps[i][k] = m_taps[i][k] + t * (m_next_taps[i][k] - m_taps[i][k]);
+      }
+    }
+  }
+
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+      m_buffer_input[i][k] = samples[i][k] + m_taps[i][k] * m_feedback[k];
+  }
+
+  if constexpr(Drive)
+  {
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      for(uint32_t k = 0; k < Lanes; ++k)
+      {
+        const double x = m_buffer_input[i][k];
+        const auto drive = static_cast<double>(drives[i][k]);
+        const double clipped = soft_clip(x, drive);
+        const bool enable = line.drive_enabled[k] && drives[i][k] > 0.0001f;
+        m_buffer_input[i][k] = enable ? clipped : x;
+      }
+    }
+  }
+
+  write(stage.buf, count, m_buffer_input.data(), n);
+
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    for(uint32_t k = 0; k < Lanes; ++k)
+      samples[i][k] = m_taps[i][k] - m_buffer_input[i][k] * m_feedback[k];
+  }
+}
+
+template <uint32_t Lanes>
+inline void LateLanes<Lanes>::write(
+    const Lane<Ring*>& buf, uint32_t count, const Lane<double>* samples,
+    uint32_t n) noexcept
+{
+  for(uint32_t k = 0; k < count; ++k)
+  {
+    Ring& ring = *buf[k];
+    for(uint32_t i = 0; i < n; ++i)
+      ring.push(samples[i][k]);
+  }
+}
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <cmath>
 
+#include <limits>
+
 #if __has_include(<version>)
 #include <version>
 #endif
@@ -22,6 +24,17 @@ inline constexpr T lerp(T a, T b, T t) noexcept
   return a + t * (b - a);
 }
 #endif
+
+// samples until a recursion with the gain 'feedback' every 'period'
+// samples has decayed by 'gain'
+inline double decay_time(double period, double feedback, double gain) noexcept
+{
+  if(feedback <= 0.)
+    return period;
+  if(feedback >= 1.)
+    return std::numeric_limits<double>::infinity();
+  return period * std::log(gain) / std::log(feedback);
+}
 }
 
 #endif
@@ -0,0 +1,264 @@
+#ifndef METER_HPP
+#define METER_HPP
+
+#include "bit_ops.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Aether
+{
+/*
+    Wait-free single producer single consumer queue
+    with a fixed capacity
+*/
+template <class T, size_t Capacity>
+class SpscQueue
+{
+  static_assert(bits::has_single_bit(Capacity), "capacity must be a power of two");
+  static_assert(std::atomic<size_t>::is_always_lock_free);
+
+public:
+  // producer side, fails if the queue is full
+  bool try_push(const T& value) noexcept
+  {
+    const size_t write = m_write.load(std::memory_order_relaxed);
+    if(write - m_read.load(std::memory_order_acquire) == Capacity)
+      return false;
+
+    m_items[write & (Capacity - 1)] = value;
+    m_write.store(write + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, fails if the queue is empty
+  bool try_pop(T& value) noexcept
+  {
+    const size_t read = m_read.load(std::memory_order_relaxed);
+    if(read == m_write.load(std::memory_order_acquire))
+      return false;
+
+    value = m_items[read & (Capacity - 1)];
+    m_read.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, Capacity> m_items = {};
+
+  alignas(64) std::atomic<size_t> m_write = 0;
+  alignas(64) std::atomic<size_t> m_read = 0;
+};
+
+/*
+    Level meters and an oscilloscope feed for the ui
+
+    The audio thread accumulates the per stage peak and rms values
+    and publishes them once per frame. Nothing is computed or published
+    while no consumer is attached.
+*/
+class Meter
+{
+public:
+  enum Stage : uint32_t
+  {
+    dry,
+    predelay,
+    early,
+    late,
+    stages
+  };
+
+  static constexpr uint32_t max_channels = 16;
+
+  using ChannelValues = std::array<float, max_channels>;
+  using StageValues = std::array<ChannelValues, stages>;
+
+  struct Frame
+  {
+    StageValues peak;
+    StageValues rms;
+    ChannelValues late_gain;
+    uint32_t channels;
+    // sample position of the end of the frame
+    uint64_t position;
+  };
+
+  struct ScopeBlock
+  {
+    static constexpr uint32_t length = 256;
+
+    std::array<std::array<float, length>, max_channels> samples;
+    uint32_t channels;
+    // sample position of the end of the block
+    uint64_t position;
+  };
+
+  explicit Meter(float rate, float frame_rate = 30.f, uint32_t scope_decimation = 4)
+      : m_frame_rate{frame_rate}
+      , m_scope_decimation{std::max(scope_decimation, uint32_t{1})}
+  {
+    set_sample_rate(rate);
+  }
+
+  Meter(const Meter&) = delete;
+  Meter& operator=(const Meter&) = delete;
+
+  // Consumer
+
+  void attach(bool scope = false) noexcept
+  {
+    m_scope_enabled.store(scope, std::memory_order_relaxed);
+    m_attached.store(true, std::memory_order_release);
+  }
+
+  void detach() noexcept { m_attached.store(false, std::memory_order_release); }
+
+  bool pop(Frame& frame) noexcept { return m_frames.try_pop(frame); }
+  bool pop(ScopeBlock& block) noexcept { return m_scope_blocks.try_pop(block); }
+
+  // Producer
+
+  // must not be called concurrently with the other producer functions
+  void set_sample_rate(float rate) noexcept
+  {
+    m_frame_length = std::max(static_cast<uint32_t>(rate / m_frame_rate), uint32_t{1});
+    reset_frame();
+  }
+
+  // channels above max_channels are not metered
+  void set_channels(uint32_t channels) noexcept
+  {
+    m_channels = std::min(channels, max_channels);
+    reset_frame();
+  }
+  uint32_t channels() const noexcept { return m_channels; }
+
+  // whether a consumer is attached, the next begin_block may differ
+  bool attached() const noexcept { return m_attached.load(std::memory_order_relaxed); }
+
+  // call once per block, returns whether the block should be metered
+  bool begin_block() noexcept
+  {
+    const bool active = m_attached.load(std::memory_order_acquire);
+    if(active && !m_active)
+    {
+      reset_frame();
+      m_scope_fill = 0;
+      m_scope_count = 0;
+      m_scope_sum = {};
+    }
+    m_active = active;
+    m_scope = active && m_scope_enabled.load(std::memory_order_relaxed);
+    return active;
+  }
+
+  void set_late_gain(uint32_t channel, float gain) noexcept
+  {
+    m_late_gain[channel] = gain;
+  }
+
+  void push(const StageValues& values, const ChannelValues& output) noexcept
+  {
+    for(uint32_t stage = 0; stage < stages; ++stage)
+    {
+      for(uint32_t channel = 0; channel < m_channels; ++channel)
+      {
+        const float value = values[stage][channel];
+        m_peak[stage][channel] = std::max(m_peak[stage][channel], std::abs(value));
+        m_sum_sq[stage][channel] += value * value;
+      }
+    }
+
+    if(++m_frame_fill == m_frame_length)
+      publish_frame();
+
+    if(m_scope)
+      push_scope(output);
+
+    ++m_position;
+  }
+
+private:
+  SpscQueue<Frame, 64> m_frames;
+  SpscQueue<ScopeBlock, 16> m_scope_blocks;
+
+  std::atomic<bool> m_attached = false;
+  std::atomic<bool> m_scope_enabled = false;
+
+  // audio thread state
+  float m_frame_rate;
+  uint32_t m_frame_length = 1;
+  uint32_t m_scope_decimation;
+  uint32_t m_channels = 2;
+
+  bool m_active = false;
+  bool m_scope = false;
+  uint64_t m_position = 0;
+
+  StageValues m_peak = {};
+  StageValues m_sum_sq = {};
+  ChannelValues m_late_gain = {};
+  uint32_t m_frame_fill = 0;
+
+  ScopeBlock m_scope_block = {};
+  ChannelValues m_scope_sum = {};
+  uint32_t m_scope_count = 0;
+  uint32_t m_scope_fill = 0;
+
+  void reset_frame() noexcept
+  {
+    m_peak = {};
+    m_sum_sq = {};
+    m_frame_fill = 0;
+  }
+
+  void publish_frame() noexcept
+  {
+    Frame frame;
+    frame.peak = m_peak;
+    for(uint32_t stage = 0; stage < stages; ++stage)
+      for(uint32_t channel = 0; channel < m_channels; ++channel)
+        frame.rms[stage][channel] = std::sqrt(m_sum_sq[stage][channel] / m_frame_fill);
+    frame.late_gain = m_late_gain;
+    frame.channels = m_channels;
+    frame.position = m_position + 1;
+
+    // frames are dropped if the consumer falls behind
+    m_frames.try_push(frame);
+    reset_frame();
+  }
+
+  void push_scope(const ChannelValues& output) noexcept
+  {
+    for(uint32_t channel = 0; channel < m_channels; ++channel)
+      m_scope_sum[channel] += output[channel];
+
+    if(++m_scope_count < m_scope_decimation)
+      return;
+
+    for(uint32_t channel = 0; channel < m_channels; ++channel)
+    {
+      m_scope_block.samples[channel][m_scope_fill]
+          = m_scope_sum[channel] / static_cast<float>(m_scope_decimation);
+      m_scope_sum[channel] = 0.f;
+    }
+    m_scope_count = 0;
+
+    if(++m_scope_fill == ScopeBlock::length)
+    {
+      m_scope_block.channels = m_channels;
+      m_scope_block.position = m_position + 1;
+      m_scope_blocks.try_push(m_scope_block);
+      m_scope_fill = 0;
+    }
+  }
+};
+}
+
+#endif
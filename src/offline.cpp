@@ -0,0 +1,203 @@
+#include "offline.hpp"
+
+#include "aether_dsp.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace Aether::Offline
+{
+namespace
+{
+// renders [begin, end) of the input into the output, starting from 'dsp'
+void render_range(
+    DSP& dsp, uint32_t channels, uint32_t block_size, const float* const* inputs,
+    float* const* outputs, uint64_t begin, uint64_t end)
+{
+  std::vector<const float*> in(channels);
+  std::vector<float*> out(channels);
+  for(uint64_t pos = begin; pos < end; pos += block_size)
+  {
+    const auto n = static_cast<uint32_t>(std::min<uint64_t>(block_size, end - pos));
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      in[ch] = inputs[ch] + pos;
+      out[ch] = outputs[ch] + pos;
+    }
+    dsp(in.data(), out.data(), n);
+  }
+}
+
+// renders 'length' samples while discarding the output
+void preroll(
+    DSP& dsp, uint32_t channels, uint32_t block_size,
+    const std::vector<std::vector<float>>& inputs, uint64_t length)
+{
+  std::vector<float> scratch(static_cast<size_t>(channels) * block_size);
+  std::vector<const float*> in(channels);
+  std::vector<float*> out(channels);
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    out[ch] = scratch.data() + ch * block_size;
+
+  for(uint64_t pos = 0; pos < length; pos += block_size)
+  {
+    const auto n = static_cast<uint32_t>(std::min<uint64_t>(block_size, length - pos));
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      in[ch] = inputs[ch].data() + pos;
+    dsp(in.data(), out.data(), n);
+  }
+}
+
+std::unique_ptr<DSP> make_dsp(const Settings& settings)
+{
+  auto dsp = std::make_unique<DSP>(settings.rate, settings.channels, settings.seed);
+  dsp->connect_parameters(settings.parameters);
+  dsp->settle_parameters();
+  return dsp;
+}
+
+/*
+    The pre-roll after which the impulse response holds at most 'gain'
+    squared of its energy, from the energy decay curve of the response
+    rendered for 'length' samples. The dropped tail sums up over all of
+    the input before the pre-roll, so it is its energy that has to be
+    below the threshold rather than its level. The peaks of the error
+    stand out more than those of the output, hence the margin.
+*/
+uint64_t measure_decay(const Settings& settings, float gain, uint64_t length)
+{
+  auto dsp = make_dsp(settings);
+  const uint32_t channels = settings.channels;
+  const uint32_t block_size = settings.block_size;
+  std::vector<float> input(block_size);
+  std::vector<float> scratch(static_cast<size_t>(channels) * block_size);
+  std::vector<const float*> in(channels, input.data());
+  std::vector<float*> out(channels);
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    out[ch] = scratch.data() + ch * block_size;
+
+  std::vector<double> energy(static_cast<size_t>(length));
+  input[0] = 1.f;
+  for(uint64_t pos = 0; pos < length; pos += block_size)
+  {
+    const auto n = static_cast<uint32_t>(std::min<uint64_t>(block_size, length - pos));
+    (*dsp)(in.data(), out.data(), n);
+    input[0] = 0.f;
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      for(uint32_t i = 0; i < n; ++i)
+        energy[pos + i] += static_cast<double>(out[ch][i]) * out[ch][i];
+  }
+
+  double total = 0.;
+  for(double e : energy)
+    total += e;
+  constexpr double margin = 0.1; // -10 dB
+  const double allowed = margin * gain * gain * total;
+
+  // integrated backwards
+  double remaining = 0.;
+  uint64_t decay = length;
+  while(decay > 0 && remaining + energy[decay - 1] <= allowed)
+    remaining += energy[--decay];
+  return decay;
+}
+}
+
+Result render(
+    const Settings& settings, const float* const* inputs, float* const* outputs,
+    uint64_t length)
+{
+  Result result;
+
+  const uint32_t threads = thread_count(settings.threads);
+  const uint64_t segment_length
+      = settings.segment_length != 0
+            ? settings.segment_length
+            : std::max<uint64_t>((length + threads - 1) / threads, 1);
+
+  result.segments
+      = static_cast<uint32_t>((length + segment_length - 1) / segment_length);
+  // the estimate bounds the decay from above, usually by about twice, and
+  // no segment pre-rolls from before the start
+  const uint64_t estimate = std::min(
+      {make_dsp(settings)->tail_length(settings.tail_threshold_db),
+       static_cast<uint64_t>(settings.max_warmup * settings.rate),
+       (result.segments - 1) * segment_length});
+  result.warmup = measure_decay(
+      settings, std::pow(10.f, settings.tail_threshold_db / 20.f), estimate);
+
+  // the outputs may overlap the inputs, so the segments that finish first
+  // would overwrite the input the later ones pre-roll
+  std::vector<std::vector<std::vector<float>>> prerolls(result.segments);
+  for(uint32_t segment = 1; segment < result.segments; ++segment)
+  {
+    const uint64_t begin = segment * segment_length;
+    const uint64_t warmup_begin = begin - std::min(result.warmup, begin);
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+      prerolls[segment].emplace_back(inputs[ch] + warmup_begin, inputs[ch] + begin);
+  }
+  // the verification renders all of the input again
+  std::vector<std::vector<float>> verify_inputs;
+  if(settings.verify)
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+      verify_inputs.emplace_back(inputs[ch], inputs[ch] + length);
+
+  parallel_for(result.segments, threads, [&](size_t segment) {
+    const uint64_t begin = segment * segment_length;
+    const uint64_t end = std::min(begin + segment_length, length);
+    const uint64_t warmup_begin = begin - std::min(result.warmup, begin);
+
+    auto dsp = make_dsp(settings);
+    dsp->skip_modulation(warmup_begin);
+    preroll(
+        *dsp, settings.channels, settings.block_size, prerolls[segment],
+        begin - warmup_begin);
+    render_range(
+        *dsp, settings.channels, settings.block_size, inputs, outputs, begin, end);
+  });
+
+  float peak = 0.f;
+  for(uint32_t ch = 0; ch < settings.channels; ++ch)
+    for(uint64_t i = 0; i < length; ++i)
+      peak = std::max(peak, std::abs(outputs[ch][i]));
+  result.error_bound = peak * std::pow(10.f, settings.tail_threshold_db / 20.f);
+
+  if(settings.verify)
+  {
+    std::vector<std::vector<float>> serial(
+        settings.channels, std::vector<float>(static_cast<size_t>(length)));
+    std::vector<float*> serial_out;
+    for(auto& channel : serial)
+      serial_out.push_back(channel.data());
+
+    std::vector<const float*> serial_in;
+    for(auto& channel : verify_inputs)
+      serial_in.push_back(channel.data());
+
+    auto dsp = make_dsp(settings);
+    render_range(
+        *dsp, settings.channels, settings.block_size, serial_in.data(),
+        serial_out.data(), 0, length);
+
+    double sum_sq = 0.;
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+    {
+      for(uint64_t i = 0; i < length; ++i)
+      {
+        const float error = std::abs(outputs[ch][i] - serial[ch][i]);
+        result.max_error = std::max(result.max_error, error);
+        sum_sq += static_cast<double>(error) * error;
+      }
+    }
+    result.rms_error = static_cast<float>(
+        std::sqrt(sum_sq / static_cast<double>(length * settings.channels)));
+    result.verified = result.max_error <= result.error_bound;
+  }
+
+  return result;
+}
+}
@@ -0,0 +1,68 @@
+#ifndef OFFLINE_HPP
+#define OFFLINE_HPP
+
+#include "parameters.hpp"
+
+#include <cstdint>
+
+namespace Aether::Offline
+{
+/*
+    Offline rendering split into segments that are rendered in parallel
+
+    Every segment is rendered by its own DSP, created with the same seed
+    and with its modulation advanced to the start of the segment. Before
+    rendering its own samples, a segment pre-rolls the input preceding it
+    for the length of the impulse response down to the threshold, measured
+    once before the segments are rendered. The state it starts from then
+    only differs from a serial render by what has decayed below the
+    threshold.
+*/
+struct Settings
+{
+  float rate = 48000.f;
+  uint32_t channels = 2;
+  uint32_t seed = 1;
+  Parameters<float> parameters = default_parameters();
+
+  // 0 uses all hardware threads
+  uint32_t threads = 0;
+  // 0 splits the input into one segment per thread
+  uint64_t segment_length = 0;
+  uint32_t block_size = 512;
+
+  // level relative to the output peak below which the tail is ignored
+  float tail_threshold_db = -100.f;
+  // upper limit for the pre-roll, in seconds
+  float max_warmup = 60.f;
+
+  // additionally renders serially and measures the error
+  bool verify = false;
+};
+
+struct Result
+{
+  uint32_t segments = 0;
+  // pre-roll of each segment in samples
+  uint64_t warmup = 0;
+
+  // maximum absolute error allowed by the tail threshold
+  float error_bound = 0.f;
+
+  // only set if Settings::verify was set
+  bool verified = false;
+  float max_error = 0.f;
+  float rms_error = 0.f;
+};
+
+/*
+    inputs and outputs hold one buffer of 'length' samples per channel.
+    The outputs may be the inputs, the pre-rolls are copied before any
+    segment is rendered.
+*/
+Result render(
+    const Settings& settings, const float* const* inputs, float* const* outputs,
+    uint64_t length);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace Aether
+{
+// the number of threads for a setting where 0 means all hardware threads
+inline uint32_t thread_count(uint32_t threads) noexcept
+{
+  return threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+/*
+    Calls 'job(i)' for every i in [0, count) on up to 'threads' threads,
+    see thread_count, including the calling one. The threads take the
+    next index as they finish, so jobs of uneven length balance out.
+    Returns once all jobs are done.
+*/
+template <class Job>
+void parallel_for(size_t count, uint32_t threads, Job&& job)
+{
+  std::atomic<size_t> next = 0;
+  auto worker = [&] {
+    for(size_t i = next++; i < count; i = next++)
+      job(i);
+  };
+
+  std::vector<std::thread> pool;
+  for(size_t t = 1; t < std::min<size_t>(thread_count(threads), count); ++t)
+    pool.emplace_back(worker);
+  worker();
+  for(auto& thread : pool)
+    thread.join();
+}
+}
+
+#endif
@@ -1,83 +1,336 @@
 #ifndef PARAMETERS_HPP
 #define PARAMETERS_HPP
 
+#include <cstddef>
+#include <cstdint>
+
 namespace Aether
 {
+template <class T>
+struct Parameters
+{
+  T mix;
+
+  // mixer
+  T dry_level;
+  T predelay_level;
+  T early_level;
+  T late_level;
+
+  // Global
+  T interpolate;
+
+  // predelay
+  T width;
+  T predelay;
+
+  // early
+  // filtering
+  T early_low_cut_enabled;
+  T early_low_cut_cutoff;
+  T early_high_cut_enabled;
+  T early_high_cut_cutoff;
+  // multitap delay
+  T early_taps;
+  T early_tap_length;
+  T early_tap_mix;
+  T early_tap_decay;
+  // diffusion
+  T early_diffusion_stages;
+  T early_diffusion_delay;
+  T early_diffusion_mod_depth;
+  T early_diffusion_mod_rate;
+  T early_diffusion_feedback;
+
+  // late
+  T late_order;
+  T late_delay_lines;
+  // delay line
+  T late_delay;
+  T late_delay_mod_depth;
+  T late_delay_mod_rate;
+  T late_delay_line_feedback;
+  // diffusion
+  T late_diffusion_stages;
+  T late_diffusion_delay;
+  T late_diffusion_mod_depth;
+  T late_diffusion_mod_rate;
+  T late_diffusion_feedback;
+  // Filter
+  T late_low_shelf_enabled;
+  T late_low_shelf_cutoff;
+  T late_low_shelf_gain;
+  T late_high_shelf_enabled;
+  T late_high_shelf_cutoff;
+  T late_high_shelf_gain;
+  T late_high_cut_enabled;
+  T late_high_cut_cutoff;
+
+  // Seed
+  T seed_crossmix;
+  T tap_seed;
+  T early_diffusion_seed;
+  T delay_seed;
+  T late_diffusion_seed;
+
+  // Distortion
+  T early_diffusion_drive;
+  T late_diffusion_drive;
+
+  T& operator[](size_t idx) noexcept { return data()[idx]; }
+  const T& operator[](size_t idx) const noexcept { return data()[idx]; }
+
+  T* data() noexcept { return reinterpret_cast<T*>(this); }
+  const T* data() const noexcept { return reinterpret_cast<const T*>(this); }
+
+  T* begin() noexcept { return data(); }
+  const T* begin() const noexcept { return data(); }
+
+  T* end() noexcept { return data() + size(); }
+  const T* end() const noexcept { return data() + size(); }
+
+  static constexpr size_t size() noexcept { return sizeof(Parameters<T>) / sizeof(T); }
+};
+
+/*
+    Internal state computed from one or more parameters.
+
+    The enumerators are listed in the order in which the state is
+    recomputed, so everything a quantity is computed from must come
+    before it. This is checked at compile time below.
+*/
+enum class Derived : uint32_t
+{
+  // early reflections
+  early_low_cut,
+  early_high_cut,
+  tap_seed,
+  tap_delays,
+  tap_gains,
+  early_diffusion_seed,
+  early_diffusion_stages,
+  early_diffusion_drive,
+  early_diffusion_delay,
+  early_diffusion_mod_depth,
+  early_diffusion_mod_rate,
+
+  // late reverberations
+  late_lines,
+  late_seed,
+  late_delay,
+  late_mod_depth,
+  late_mod_rate,
+  late_feedback,
+  late_diffusion_seed,
+  late_diffusion_stages,
+  late_diffusion_drive,
+  late_diffusion_delay,
+  late_diffusion_mod_depth,
+  late_diffusion_mod_rate,
+  late_low_shelf,
+  late_high_shelf,
+  late_high_cut,
+
+  count
+};
+
+constexpr uint32_t bit(Derived d) noexcept
+{
+  return uint32_t{1} << static_cast<uint32_t>(d);
+}
+
+static_assert(static_cast<uint32_t>(Derived::count) <= 32);
+
+/*
+    The derived state that has to be recomputed
+    whenever 'd' has been recomputed
+*/
+constexpr uint32_t derived_dependents(Derived d) noexcept
+{
+  switch(d)
+  {
+    case Derived::tap_seed:
+      return bit(Derived::tap_delays);
+    case Derived::tap_delays:
+      return bit(Derived::tap_gains);
+
+    case Derived::early_diffusion_seed:
+    case Derived::early_diffusion_stages:
+      return bit(Derived::early_diffusion_delay)
+           | bit(Derived::early_diffusion_mod_depth)
+           | bit(Derived::early_diffusion_mod_rate);
+    // the mod depth is limited by the delay
+    case Derived::early_diffusion_delay:
+      return bit(Derived::early_diffusion_mod_depth);
+
+    // only active lines are kept up to date
+    case Derived::late_lines:
+      return bit(Derived::late_delay) | bit(Derived::late_mod_depth)
+           | bit(Derived::late_mod_rate) | bit(Derived::late_feedback)
+           | bit(Derived::late_diffusion_seed) | bit(Derived::late_diffusion_stages)
+           | bit(Derived::late_diffusion_drive) | bit(Derived::late_low_shelf)
+           | bit(Derived::late_high_shelf) | bit(Derived::late_high_cut);
+    case Derived::late_seed:
+      return bit(Derived::late_delay) | bit(Derived::late_mod_depth)
+           | bit(Derived::late_mod_rate) | bit(Derived::late_feedback);
+    // the feedback of each line is scaled by its delay
+    case Derived::late_delay:
+      return bit(Derived::late_feedback);
+
+    case Derived::late_diffusion_seed:
+    case Derived::late_diffusion_stages:
+      return bit(Derived::late_diffusion_delay)
+           | bit(Derived::late_diffusion_mod_depth)
+           | bit(Derived::late_diffusion_mod_rate);
+    case Derived::late_diffusion_delay:
+      return bit(Derived::late_diffusion_mod_depth);
+
+    default:
+      return 0;
+  }
+}
+
+constexpr bool derived_order_is_valid() noexcept
+{
+  for(uint32_t d = 0; d < static_cast<uint32_t>(Derived::count); ++d)
+  {
+    const uint32_t dependents = derived_dependents(static_cast<Derived>(d));
+    if(dependents & ((uint32_t{2} << d) - 1))
+      return false;
+  }
+  return true;
+}
+
+static_assert(
+    derived_order_is_valid(), "derived state must only depend on earlier derived state");
+
+// adds everything that depends on the state in 'mask'
+constexpr uint32_t with_dependents(uint32_t mask) noexcept
+{
+  // dependents always come later, so a single pass reaches the closure
+  for(uint32_t d = 0; d < static_cast<uint32_t>(Derived::count); ++d)
+    if(mask & bit(static_cast<Derived>(d)))
+      mask |= derived_dependents(static_cast<Derived>(d));
+  return mask;
+}
+
+template <class... Ds>
+constexpr uint32_t affects(Ds... derived) noexcept
+{
+  return with_dependents((bit(derived) | ... | uint32_t{0}));
+}
+
 struct ParameterInfo
 {
   float min;
   float max;
   float dflt;
   bool integer;
+  // smoothing time in tenths of a millisecond, 0 disables smoothing
+  float smoothing = 0.f;
+  // derived state that has to be recomputed when the parameter changes
+  uint32_t affects = 0;
 
-  float range() const noexcept { return max - min; }
+  constexpr float range() const noexcept { return max - min; }
 };
 
-static constexpr ParameterInfo parameter_infos[] = {
-    {0, 0, 0, false}, // Atom Ports
-    {0, 0, 0, false}, // 1
-
-
-    {-1, 1, 0, false},                                                    // Audio
-    {-1, 1, 0, false},
-    {-1, 1, 0, false},
-    {-1, 1, 0, false}, // 5
-
-    {0, 100, 100, false}, // Mixer
-    {0, 100, 80, false},
-    {0, 100, 20, false},
-    {0, 100, 10, false},
-    {0, 100, 20, false}, // 10
-
-    {0, 1, 1, true},                             // Predelay/Interpolation
-    {0, 100, 100, false},
-    {0, 400, 20, false}, // 13
-
-    {0, 1, 0, true}, // Early
-    {15, 22000, 15, false},
-    {0, 1, 0, true},
-    {15, 22000, 20000, false},
-    {1, 50, 12, true},
-
-    {0, 500, 200, false},
-    {0, 100, 100, false},
-
-    {0, 1, 0.5f, false},
-    {0, 8, 7, true},
-    {10, 100, 20, false},
-    {0, 3, 0, false},
-    {0, 5, 1, false},
-    {0, 1, 0.7f, false}, // 26
-
-    {0, 1, 0, true}, // Late
-    {1, 12, 3, true},
-    {0.05f, 1000, 100, false},
-    {0, 50, 0.2f, false},
-    {0, 5, 0.2f, false},
-    {0, 1, 0.7f, false},
-    {0, 8, 7, true},
-    {10, 100, 50, false},
-
-    {0, 3, 0.2f, false},
-    {0, 5, 0.5f, false},
-    {0, 1, 0.7f, false},
-    {0, 1, 0, true},
-    {15, 22000, 100, false},
-    {-24, 0, -2, false},
-    {0, 1, 0, true},
-    {15, 22000, 1500, false},
-    {-24, 0, -3, false},
-    {0, 1, 0, true},
-    {15, 22000, 20000, false}, // 45
-
-    {0, 100, 80, false}, // seeds
-    {1, 99999, 1, true},
-    {1, 99999, 1, true},
-    {1, 99999, 1, true},
-    {1, 99999, 1, true}, // 50
-
-    {-12, 12, -12, false}, // Distortion
-    {-12, 12, -12, false}  // 52
+inline constexpr Parameters<ParameterInfo> parameter_infos = {
+    .mix = {0, 100, 100, false, 50},
+
+    // mixer
+    .dry_level = {0, 100, 80, false, 50},
+    .predelay_level = {0, 100, 20, false, 50},
+    .early_level = {0, 100, 10, false, 50},
+    .late_level = {0, 100, 20, false, 50},
+
+    // Global
+    .interpolate = {0, 1, 1, true},
+
+    // predelay
+    .width = {0, 100, 100, false, 50},
+    .predelay = {0, 400, 20, false, 5000},
+
+    // early
+    // filtering
+    .early_low_cut_enabled = {0, 1, 0, true},
+    .early_low_cut_cutoff
+    = {15, 22000, 15, false, 0, affects(Derived::early_low_cut)},
+    .early_high_cut_enabled = {0, 1, 0, true},
+    .early_high_cut_cutoff
+    = {15, 22000, 20000, false, 0, affects(Derived::early_high_cut)},
+    // multitap delay
+    .early_taps = {1, 50, 12, true},
+    .early_tap_length = {0, 500, 200, false, 4000},
+    .early_tap_mix = {0, 100, 100, false, 50},
+    .early_tap_decay = {0, 1, 0.5f, false, 25, affects(Derived::tap_gains)},
+    // diffusion
+    .early_diffusion_stages
+    = {0, 8, 7, true, 0, affects(Derived::early_diffusion_stages)},
+    .early_diffusion_delay
+    = {10, 100, 20, false, 5000, affects(Derived::early_diffusion_delay)},
+    .early_diffusion_mod_depth
+    = {0, 3, 0, false, 1000, affects(Derived::early_diffusion_mod_depth)},
+    .early_diffusion_mod_rate
+    = {0, 5, 1, false, 0, affects(Derived::early_diffusion_mod_rate)},
+    .early_diffusion_feedback = {0, 1, 0.7f, false, 500},
+
+    // late
+    .late_order = {0, 1, 0, true},
+    .late_delay_lines = {1, 12, 3, true, 0, affects(Derived::late_lines)},
+    // delay line
+    .late_delay = {0.05f, 1000, 100, false, 5000, affects(Derived::late_delay)},
+    .late_delay_mod_depth = {0, 50, 0.2f, false, 1000, affects(Derived::late_mod_depth)},
+    .late_delay_mod_rate = {0, 5, 0.2f, false, 0, affects(Derived::late_mod_rate)},
+    .late_delay_line_feedback
+    = {0, 1, 0.7f, false, 50, affects(Derived::late_feedback)},
+    // diffusion
+    .late_diffusion_stages
+    = {0, 8, 7, true, 0, affects(Derived::late_diffusion_stages)},
+    .late_diffusion_delay
+    = {10, 100, 50, false, 5000, affects(Derived::late_diffusion_delay)},
+    .late_diffusion_mod_depth
+    = {0, 3, 0.2f, false, 2000, affects(Derived::late_diffusion_mod_depth)},
+    .late_diffusion_mod_rate
+    = {0, 5, 0.5f, false, 0, affects(Derived::late_diffusion_mod_rate)},
+    .late_diffusion_feedback = {0, 1, 0.7f, false, 500},
+    // Filter
+    .late_low_shelf_enabled = {0, 1, 0, true},
+    .late_low_shelf_cutoff
+    = {15, 22000, 100, false, 0, affects(Derived::late_low_shelf)},
+    .late_low_shelf_gain = {-24, 0, -2, false, 0, affects(Derived::late_low_shelf)},
+    .late_high_shelf_enabled = {0, 1, 0, true},
+    .late_high_shelf_cutoff
+    = {15, 22000, 1500, false, 0, affects(Derived::late_high_shelf)},
+    .late_high_shelf_gain = {-24, 0, -3, false, 0, affects(Derived::late_high_shelf)},
+    .late_high_cut_enabled = {0, 1, 0, true},
+    .late_high_cut_cutoff
+    = {15, 22000, 20000, false, 0, affects(Derived::late_high_cut)},
+
+    // Seed
+    .seed_crossmix
+    = {0, 100, 80, false, 5000,
+       affects(
+           Derived::tap_seed, Derived::early_diffusion_seed, Derived::late_seed,
+           Derived::late_diffusion_seed)},
+    .tap_seed = {1, 99999, 1, true, 0, affects(Derived::tap_seed)},
+    .early_diffusion_seed
+    = {1, 99999, 1, true, 0, affects(Derived::early_diffusion_seed)},
+    .delay_seed = {1, 99999, 1, true, 0, affects(Derived::late_seed)},
+    .late_diffusion_seed = {1, 99999, 1, true, 0, affects(Derived::late_diffusion_seed)},
+
+    // Distortion
+    .early_diffusion_drive
+    = {-12, 12, -12, false, 0, affects(Derived::early_diffusion_drive)},
+    .late_diffusion_drive
+    = {-12, 12, -12, false, 0, affects(Derived::late_diffusion_drive)},
 };
+
+inline Parameters<float> default_parameters() noexcept
+{
+  Parameters<float> values;
+  for(size_t p = 0; p < values.size(); ++p)
+    values[p] = parameter_infos[p].dflt;
+  return values;
+}
 }
 #endif
@@ -0,0 +1,184 @@
+#include "preset_switcher.hpp"
+
+#include "constants.hpp"
+#include "rt_sanitizer.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <cassert>
+
+namespace Aether
+{
+/*
+    The control thread leaves the idle state, either to prepare a switch
+    or to configure both instances and back again. The helper thread moves
+    from preparing to prepared and the audio thread from prepared to
+    fading and back to idle. Each side only touches the other instance
+    while it owns the state, and the transitions are stored with release
+    and loaded with acquire, so the instance is handed over with them.
+*/
+PresetSwitcher::PresetSwitcher(
+    float rate, const Parameters<float>& params, uint32_t channels, uint32_t seed)
+    : m_params{params, params}
+    , m_rate{rate}
+    , m_fade_buffers(channels)
+    , m_fade_outputs(channels)
+{
+  for(uint32_t k = 0; k < 2; ++k)
+  {
+    m_engines[k] = std::make_unique<DSP>(rate, channels, seed + k);
+    m_engines[k]->connect_parameters(m_params[k]);
+    m_engines[k]->settle_parameters();
+  }
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    m_fade_outputs[ch] = m_fade_buffers[ch].data();
+
+  m_thread = std::thread([this] { run(); });
+}
+
+PresetSwitcher::~PresetSwitcher()
+{
+  m_running.store(false, std::memory_order_relaxed);
+  m_requests_count.fetch_add(1, std::memory_order_release);
+  m_requests_count.notify_one();
+  m_thread.join();
+}
+
+void PresetSwitcher::operator()(
+    const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept
+{
+  [[maybe_unused]] RealtimeScope realtime;
+
+  if(m_state.load(std::memory_order_acquire) == State::prepared)
+  {
+    m_fade_position = 0;
+    m_state.store(State::fading, std::memory_order_relaxed);
+  }
+
+  const uint32_t channels = active().channels();
+  std::array<const float*, DSP::max_channels> in;
+  std::array<float*, DSP::max_channels> out;
+
+  for(uint32_t start = 0; start < n_samples;)
+  {
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      in[ch] = inputs[ch] + start;
+      out[ch] = outputs[ch] + start;
+    }
+
+    if(m_state.load(std::memory_order_relaxed) != State::fading)
+    {
+      (*m_engines[m_active])(in.data(), out.data(), n_samples - start);
+      return;
+    }
+
+    if(m_fade_position >= m_fade_samples)
+    {
+      // the old instance is free for the next load
+      m_active = 1 - m_active;
+      m_state.store(State::idle, std::memory_order_release);
+      continue;
+    }
+
+    const auto remaining = static_cast<uint32_t>(
+        std::min<uint64_t>(m_fade_samples - m_fade_position, fade_block));
+    const uint32_t n = std::min(n_samples - start, remaining);
+    fade(in.data(), out.data(), n);
+    start += n;
+  }
+
+  // the fade may have ended with the block
+  if(m_state.load(std::memory_order_relaxed) == State::fading
+     && m_fade_position >= m_fade_samples)
+  {
+    m_active = 1 - m_active;
+    m_state.store(State::idle, std::memory_order_release);
+  }
+}
+
+bool PresetSwitcher::load(const Parameters<float>& params, float fade_time)
+{
+  if(m_state.load(std::memory_order_acquire) != State::idle)
+    return false;
+
+  m_params[1 - m_active] = params;
+  m_fade_samples = static_cast<uint64_t>(std::max(fade_time, 0.f) * m_rate);
+  m_state.store(State::preparing, std::memory_order_release);
+
+  m_requests_count.fetch_add(1, std::memory_order_release);
+  m_requests_count.notify_one();
+  return true;
+}
+
+template <class Configure>
+bool PresetSwitcher::configure(Configure&& configure)
+{
+  State idle = State::idle;
+  if(!m_state.compare_exchange_strong(
+         idle, State::configuring, std::memory_order_acquire))
+    return false;
+
+  for(auto& engine : m_engines)
+    configure(*engine);
+  m_state.store(State::idle, std::memory_order_release);
+  return true;
+}
+
+bool PresetSwitcher::set_late_decimation(uint32_t factor)
+{
+  return configure([factor](DSP& engine) {
+    engine.set_late_decimation(factor);
+    engine.settle_parameters();
+  });
+}
+
+bool PresetSwitcher::set_early_diffusion(DSP::EarlyDiffusion diffusion)
+{
+  return configure([diffusion](DSP& engine) { engine.set_early_diffusion(diffusion); });
+}
+
+void PresetSwitcher::run() noexcept
+{
+  uint32_t seen = 0;
+  while(true)
+  {
+    m_requests_count.wait(seen, std::memory_order_acquire);
+    seen = m_requests_count.load(std::memory_order_acquire);
+    if(!m_running.load(std::memory_order_relaxed))
+      return;
+
+    if(m_state.load(std::memory_order_acquire) != State::preparing)
+      continue;
+
+    // starts from silence with all derived state of the new parameters
+    DSP& dsp = *m_engines[1 - m_active];
+    dsp.clear();
+    dsp.settle_parameters();
+    m_state.store(State::prepared, std::memory_order_release);
+  }
+}
+
+void PresetSwitcher::fade(
+    const float* const* inputs, float* const* outputs, uint32_t n) noexcept
+{
+  assert(n <= fade_block);
+
+  // the new instance reads the inputs before the old one may overwrite them
+  (*m_engines[1 - m_active])(inputs, m_fade_outputs.data(), n);
+  (*m_engines[m_active])(inputs, outputs, n);
+
+  // raised cosine, the gains of both instances add up to one
+  constexpr double pi = constants::pi_v<double>;
+  const auto length = static_cast<double>(m_fade_samples);
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    const double t = static_cast<double>(m_fade_position + i + 1) / length;
+    const auto gain = static_cast<float>(0.5 - 0.5 * std::cos(pi * t));
+    for(uint32_t ch = 0; ch < m_fade_outputs.size(); ++ch)
+      outputs[ch][i] += gain * (m_fade_outputs[ch][i] - outputs[ch][i]);
+  }
+  m_fade_position += n;
+}
+}
@@ -0,0 +1,127 @@
+#ifndef PRESET_SWITCHER_HPP
+#define PRESET_SWITCHER_HPP
+
+#include "aether_dsp.hpp"
+#include "parameters.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace Aether
+{
+/*
+    Switches between presets without clicks or parameter glides
+
+    Holds two instances of DSP with the same sample rate and channel
+    count, one of which is playing. load hands the parameters of a new
+    preset to a helper thread, which clears the other instance and applies
+    the parameters to it without smoothing. The audio thread then
+    crossfades from the playing instance to the prepared one and keeps the
+    old one for the next load. Neither the regeneration of the derived
+    state nor any allocation happens on the audio thread.
+
+    While switching, both instances run, which doubles the processing time
+    of those blocks. The tail of the old preset is faded out with it.
+*/
+class PresetSwitcher
+{
+public:
+  // the seeds of the two instances are 'seed' and 'seed + 1'
+  explicit PresetSwitcher(
+      float rate, const Parameters<float>& params, uint32_t channels = 2,
+      uint32_t seed = std::random_device{}());
+  ~PresetSwitcher();
+
+  PresetSwitcher(const PresetSwitcher&) = delete;
+  PresetSwitcher& operator=(const PresetSwitcher&) = delete;
+
+  // Audio thread
+
+  // inputs and outputs hold one buffer per channel and may be the same
+  void operator()(
+      const float* const* inputs, float* const* outputs, uint32_t n_samples) noexcept;
+
+  // Control thread
+
+  /*
+      Switches to 'params' with a crossfade of 'fade_time' seconds, which
+      starts with the first block after the preparation. Returns false
+      without effect while the previous switch has not finished.
+  */
+  bool load(const Parameters<float>& params, float fade_time = 0.1f);
+
+  // whether a switch is being prepared or crossfaded
+  bool switching() const noexcept
+  {
+    return m_state.load(std::memory_order_acquire) != State::idle;
+  }
+
+  /*
+      The playing instance, to be configured like any other DSP while
+      not switching, and the parameters it reads. Configuration other
+      than the parameters is not carried over to the other instance.
+  */
+  DSP& active() noexcept { return *m_engines[m_active]; }
+  const Parameters<float>& parameters() const noexcept { return m_params[m_active]; }
+
+  /*
+      See DSP::set_late_decimation and DSP::set_early_diffusion, for both
+      instances. Like those, they must not be called while processing.
+      They return false without effect while a switch has not finished,
+      since the helper thread may be preparing the other instance.
+  */
+  bool set_late_decimation(uint32_t factor);
+  bool set_early_diffusion(DSP::EarlyDiffusion diffusion);
+
+private:
+  enum class State : uint32_t
+  {
+    // the other instance is free for the next load
+    idle,
+    // the helper thread prepares the other instance
+    preparing,
+    // the other instance waits for the audio thread
+    prepared,
+    // the audio thread crossfades to the other instance
+    fading,
+    // the control thread configures both instances
+    configuring
+  };
+
+  // runs 'configure' on both instances unless switching
+  template <class Configure>
+  bool configure(Configure&& configure);
+
+  // frames of both instances processed at once while fading
+  static constexpr uint32_t fade_block = 256;
+
+  void run() noexcept;
+  void fade(const float* const* inputs, float* const* outputs, uint32_t n) noexcept;
+
+  std::array<std::unique_ptr<DSP>, 2> m_engines;
+  // the instances read their parameters from here
+  std::array<Parameters<float>, 2> m_params;
+  uint32_t m_active = 0;
+  float m_rate;
+
+  std::atomic<State> m_state = State::idle;
+
+  // written by load before preparing
+  uint64_t m_fade_samples = 0;
+  // audio thread
+  uint64_t m_fade_position = 0;
+  std::vector<std::array<float, fade_block>> m_fade_buffers;
+  std::vector<float*> m_fade_outputs;
+
+  std::atomic<uint32_t> m_requests_count = 0;
+  std::atomic<bool> m_running = true;
+  std::thread m_thread;
+};
+}
+
+#endif
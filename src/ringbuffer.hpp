@@ -2,11 +2,45 @@
 #define RINGBUFFER_HPP
 
 #include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
 
 namespace Aether
 {
-template <class T>
+/*
+    16 bit brain floating point, the upper half of a float
+
+    Only meant for storing samples, values are rounded to nearest even
+    and NaNs are not preserved.
+*/
+struct BFloat16
+{
+  BFloat16() = default;
+  explicit BFloat16(float value) noexcept
+  {
+    const uint32_t u = std::bit_cast<uint32_t>(value);
+    bits = static_cast<uint16_t>((u + 0x7FFFu + ((u >> 16) & 1u)) >> 16);
+  }
+
+  explicit operator float() const noexcept
+  {
+    return std::bit_cast<float>(static_cast<uint32_t>(bits) << 16);
+  }
+
+  uint16_t bits = 0;
+};
+
+/*
+    The samples are pushed and read as T and stored as Storage,
+    which may have a lower precision to save memory and bandwidth
+
+    Clearing takes constant time: the buffer counts the samples pushed
+    since the last clear and older samples read as zero until the write
+    head has overwritten them.
+*/
+template <class T, class Storage = T>
 struct Ringbuffer
 {
 
@@ -16,18 +50,18 @@ struct Ringbuffer
   }
   explicit Ringbuffer(size_t sz)
       : size{sz}
-      , buf{new T[sz]}
+      , buf{new Storage[sz]()}
+      , valid{sz}
   {
-    clear();
   }
 
   Ringbuffer(const Ringbuffer&) = delete;
   Ringbuffer& operator=(const Ringbuffer&) = delete;
 
-  Ringbuffer(Ringbuffer&& other) noexcept:
-      buf{}
-    , size{}
-    , end{}
+  Ringbuffer(Ringbuffer&& other) noexcept
+      : size{}
+      , buf{}
+      , valid{}
   {
     swap(other);
   }
@@ -44,27 +78,69 @@ struct Ringbuffer
   {
     ++end;
     end -= (end >= size ? size : 0);
-    buf[end] = value;
+    buf[end] = static_cast<Storage>(value);
+    if(valid != size)
+      ++valid;
   }
 
-  void clear() noexcept { std::fill_n(buf, size, T()); }
+  T operator[](size_t idx) const noexcept
+  {
+    if(valid != size && stale(idx))
+      return T{};
+
+    if constexpr(std::is_same_v<Storage, BFloat16>)
+      return static_cast<T>(static_cast<float>(buf[idx]));
+    else
+      return static_cast<T>(buf[idx]);
+  }
+
+  void clear() noexcept { valid = 0; }
+
+  // whether the sample at 'idx' was pushed before the last clear
+  bool stale(size_t idx) const noexcept
+  {
+    // the newest sample is at 'end'
+    const size_t age = end - idx + (end < idx ? size : 0);
+    return age >= valid;
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar)
+  {
+    ar(end);
+    // the samples from before the last clear are stored as zeros without
+    // touching the buffer, so the stored buffer is fully valid
+    if constexpr(Archive::loading)
+    {
+      ar.buffer(buf, size);
+      if(!ar.check(size != 0 ? end < size : end == 0))
+        end = 0;
+      valid = size;
+    }
+    else
+      ar.buffer(buf, size, [this](size_t idx) { return stale(idx); });
+  }
 
   void swap(Ringbuffer& other) noexcept
   {
     std::swap(end, other.end);
     std::swap(size, other.size);
     std::swap(buf, other.buf);
+    std::swap(valid, other.valid);
   }
 
   size_t end = 0;
   size_t size;
-  T* buf;
+  Storage* buf;
+  // number of samples pushed since the last clear, up to size
+  size_t valid;
 };
 }
 namespace std
 {
-template <class T>
-inline void swap(Aether::Ringbuffer<T>& lhs, Aether::Ringbuffer<T>& rhs) noexcept
+template <class T, class Storage>
+inline void
+swap(Aether::Ringbuffer<T, Storage>& lhs, Aether::Ringbuffer<T, Storage>& rhs) noexcept
 {
   lhs.swap(rhs);
 }
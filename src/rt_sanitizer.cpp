@@ -0,0 +1,391 @@
+// the wrappers replace functions the fortified headers define inline
+#undef _FORTIFY_SOURCE
+
+#include "rt_sanitizer.hpp"
+
+#if defined(AETHER_RT_SANITIZER)
+
+#include <cstdlib>
+
+#if !defined(__GLIBC__)
+#error "the real-time sanitizer interposes the GNU C library"
+#endif
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+
+// the allocator of the C library, which the wrappers forward to
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+
+// of the C++ runtime, which guards the initialization of local statics
+int __cxa_guard_acquire(int64_t* guard) noexcept;
+}
+
+// the interposed functions that forward to the next definition
+#define AETHER_INTERPOSED(X) \
+  X(pthread_mutex_lock)      \
+  X(pthread_mutex_timedlock) \
+  X(pthread_rwlock_rdlock)   \
+  X(pthread_rwlock_wrlock)   \
+  X(pthread_cond_wait)       \
+  X(pthread_cond_timedwait)  \
+  X(pthread_join)            \
+  X(pthread_once)            \
+  X(sem_wait)                \
+  X(sem_timedwait)           \
+  X(__cxa_guard_acquire)     \
+  X(syscall)                 \
+  X(open)                    \
+  X(read)                    \
+  X(write)                   \
+  X(fsync)                   \
+  X(poll)                    \
+  X(nanosleep)               \
+  X(clock_nanosleep)         \
+  X(usleep)                  \
+  X(sleep)
+
+namespace Aether::RtSanitizer
+{
+namespace
+{
+// initial-exec, so that the wrappers can read them without allocating
+[[gnu::tls_model("initial-exec")]] thread_local uint32_t depth = 0;
+// the report itself allocates and writes
+[[gnu::tls_model("initial-exec")]] thread_local bool reporting = false;
+
+std::atomic<uint64_t> violation_count = 0;
+
+bool log_only() noexcept
+{
+  static const bool log = [] {
+    const char* mode = std::getenv("AETHER_RT_SANITIZER");
+    return mode && std::strcmp(mode, "log") == 0;
+  }();
+  return log;
+}
+
+void report(const char* function) noexcept
+{
+  if(depth == 0 || reporting)
+    return;
+  reporting = true;
+  violation_count.fetch_add(1, std::memory_order_relaxed);
+
+  char message[128];
+  const int length = std::snprintf(
+      message, sizeof(message), "real-time violation: %s in a real-time scope\n",
+      function);
+  if(length > 0)
+    ::write(STDERR_FILENO, message, std::min<size_t>(length, sizeof(message) - 1));
+
+  // without the frame of this function
+  void* frames[64];
+  const int count = backtrace(frames, 64);
+  backtrace_symbols_fd(frames + 1, count - 1, STDERR_FILENO);
+
+  if(!log_only())
+    std::abort();
+  reporting = false;
+}
+
+// the next definition of 'name', the one of the C library
+template <class F>
+F next(F& function, const char* name) noexcept
+{
+  // only calls from constructors that run before resolve() get here
+  if(!function)
+    function = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+  return function;
+}
+
+#define AETHER_DECLARE(name) decltype(&::name) next_##name = nullptr;
+AETHER_INTERPOSED(AETHER_DECLARE)
+#undef AETHER_DECLARE
+
+/*
+    Resolves the forwarded functions before main, dlsym allocates and
+    locks. The first backtrace loads the unwinder and the mode is read
+    once, both would do the same in the first report.
+*/
+[[gnu::constructor]] void resolve() noexcept
+{
+#define AETHER_RESOLVE(name) next(next_##name, #name);
+  AETHER_INTERPOSED(AETHER_RESOLVE)
+#undef AETHER_RESOLVE
+
+  void* frame;
+  backtrace(&frame, 1);
+  log_only();
+}
+}
+
+void enter() noexcept
+{
+  ++depth;
+}
+
+void leave() noexcept
+{
+  --depth;
+}
+
+uint64_t violations() noexcept
+{
+  return violation_count.load(std::memory_order_relaxed);
+}
+}
+
+using Aether::RtSanitizer::report;
+
+#define AETHER_FORWARD(name, ...) \
+  report(#name);                  \
+  return Aether::RtSanitizer::next(Aether::RtSanitizer::next_##name, #name)(__VA_ARGS__)
+
+extern "C"
+{
+// Allocation
+
+void* malloc(size_t size) noexcept
+{
+  report("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+  report("calloc");
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+  report("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) noexcept
+{
+  if(ptr)
+    report("free");
+  __libc_free(ptr);
+}
+
+void* reallocarray(void* ptr, size_t count, size_t size) noexcept
+{
+  report("reallocarray");
+  size_t bytes;
+  if(__builtin_mul_overflow(count, size, &bytes))
+  {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return __libc_realloc(ptr, bytes);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+  report("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+  report("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+void* valloc(size_t size) noexcept
+{
+  report("valloc");
+  return __libc_valloc(size);
+}
+
+void* pvalloc(size_t size) noexcept
+{
+  report("pvalloc");
+  return __libc_pvalloc(size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+  report("posix_memalign");
+  if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  void* memory = __libc_memalign(alignment, size);
+  if(!memory)
+    return ENOMEM;
+  *ptr = memory;
+  return 0;
+}
+
+// Locks and waits
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+  AETHER_FORWARD(pthread_mutex_lock, mutex);
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t* mutex, const timespec* timeout) noexcept
+{
+  AETHER_FORWARD(pthread_mutex_timedlock, mutex, timeout);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+{
+  AETHER_FORWARD(pthread_rwlock_rdlock, lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+{
+  AETHER_FORWARD(pthread_rwlock_wrlock, lock);
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+  AETHER_FORWARD(pthread_cond_wait, cond, mutex);
+}
+
+int pthread_cond_timedwait(
+    pthread_cond_t* cond, pthread_mutex_t* mutex, const timespec* timeout)
+{
+  AETHER_FORWARD(pthread_cond_timedwait, cond, mutex, timeout);
+}
+
+int pthread_join(pthread_t thread, void** result)
+{
+  AETHER_FORWARD(pthread_join, thread, result);
+}
+
+int pthread_once(pthread_once_t* once, void (*function)())
+{
+  // the C library sets the second bit once 'function' has run
+  if(!(__atomic_load_n(once, __ATOMIC_ACQUIRE) & 2))
+    report("pthread_once");
+  return Aether::RtSanitizer::next(Aether::RtSanitizer::next_pthread_once, "pthread_once")(
+      once, function);
+}
+
+// only called before the first initialization of a local static is done
+int __cxa_guard_acquire(int64_t* guard) noexcept
+{
+  AETHER_FORWARD(__cxa_guard_acquire, guard);
+}
+
+int sem_wait(sem_t* sem)
+{
+  AETHER_FORWARD(sem_wait, sem);
+}
+
+int sem_timedwait(sem_t* sem, const timespec* timeout)
+{
+  AETHER_FORWARD(sem_timedwait, sem, timeout);
+}
+
+// System calls
+
+/*
+    Any system call, like the futex waits and wakes of std::atomic::wait
+    and notify_one. The C library reads six arguments whatever the number
+    and the kernel ignores those a call does not take, so does this: the
+    extra ones are leftovers of the argument registers or of the stack
+    of the caller, which are always readable.
+*/
+long syscall(long number, ...) noexcept
+{
+  va_list args;
+  va_start(args, number);
+  long arguments[6];
+  for(long& argument : arguments)
+    argument = va_arg(args, long);
+  va_end(args);
+
+  report(number == SYS_futex ? "syscall(SYS_futex)" : "syscall");
+  return Aether::RtSanitizer::next(Aether::RtSanitizer::next_syscall, "syscall")(
+      number, arguments[0], arguments[1], arguments[2], arguments[3], arguments[4],
+      arguments[5]);
+}
+
+int open(const char* path, int flags, ...)
+{
+  mode_t mode = 0;
+  if(flags & (O_CREAT | O_TMPFILE))
+  {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  AETHER_FORWARD(open, path, flags, mode);
+}
+
+ssize_t read(int fd, void* buffer, size_t size)
+{
+  AETHER_FORWARD(read, fd, buffer, size);
+}
+
+ssize_t write(int fd, const void* buffer, size_t size)
+{
+  AETHER_FORWARD(write, fd, buffer, size);
+}
+
+int fsync(int fd)
+{
+  AETHER_FORWARD(fsync, fd);
+}
+
+int poll(pollfd* fds, nfds_t count, int timeout)
+{
+  AETHER_FORWARD(poll, fds, count, timeout);
+}
+
+int nanosleep(const timespec* duration, timespec* remaining)
+{
+  AETHER_FORWARD(nanosleep, duration, remaining);
+}
+
+int clock_nanosleep(
+    clockid_t clock, int flags, const timespec* duration, timespec* remaining)
+{
+  AETHER_FORWARD(clock_nanosleep, clock, flags, duration, remaining);
+}
+
+int usleep(useconds_t duration)
+{
+  AETHER_FORWARD(usleep, duration);
+}
+
+unsigned int sleep(unsigned int seconds)
+{
+  AETHER_FORWARD(sleep, seconds);
+}
+}
+
+#undef AETHER_FORWARD
+#undef AETHER_INTERPOSED
+
+#endif
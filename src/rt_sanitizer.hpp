@@ -0,0 +1,59 @@
+#ifndef RT_SANITIZER_HPP
+#define RT_SANITIZER_HPP
+
+#include <cstdint>
+
+/*
+    Real-time safety checks, enabled by defining AETHER_RT_SANITIZER and
+    linking rt_sanitizer.cpp into the executable
+
+    The audio thread entry points mark their duration with a
+    RealtimeScope. Inside one, every allocation or deallocation, lock
+    acquisition, condition or semaphore wait, sleep, blocking file
+    operation and call of syscall the thread makes is reported on stderr
+    with a stack trace, as is the first initialization of a local static
+    or of a pthread_once. The environment variable AETHER_RT_SANITIZER selects
+    what happens then: abort, the default, or log to count it and carry
+    on.
+
+    The checks interpose the C library functions, so they see the calls
+    made by the C++ runtime, like operator new reaching malloc or
+    std::atomic::wait and notify_one reaching syscall(SYS_futex), but not
+    those the C library makes to itself. The interposed functions are
+    resolved before main. Without the definition the scope is empty and
+    nothing is interposed.
+*/
+namespace Aether
+{
+#if defined(AETHER_RT_SANITIZER)
+namespace RtSanitizer
+{
+void enter() noexcept;
+void leave() noexcept;
+
+// the number of calls reported since the start of the program
+uint64_t violations() noexcept;
+}
+
+class RealtimeScope
+{
+public:
+  RealtimeScope() noexcept { RtSanitizer::enter(); }
+  ~RealtimeScope() { RtSanitizer::leave(); }
+
+  RealtimeScope(const RealtimeScope&) = delete;
+  RealtimeScope& operator=(const RealtimeScope&) = delete;
+};
+#else
+class RealtimeScope
+{
+public:
+  RealtimeScope() noexcept = default;
+
+  RealtimeScope(const RealtimeScope&) = delete;
+  RealtimeScope& operator=(const RealtimeScope&) = delete;
+};
+#endif
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace Aether
+{
+/*
+    Binary archives used to checkpoint the processing state
+
+    Classes expose their state through a member function template
+        template <class Archive> void serialize(Archive& ar);
+    passing every member to 'ar'. The same function saves and restores.
+    Restored values that would be out of range pass through ar.check,
+    which fails the restore.
+
+    Values are stored in native byte order. Buffers are stored with their
+    length and sample size, followed by a sequence of runs, each made of a
+    number of zeros followed by a number of literal values, so silent
+    regions take almost no space.
+*/
+inline constexpr uint32_t state_magic = 0x48544541; // "AETH" in little endian
+inline constexpr uint32_t state_version = 6;
+
+template <class T, class Archive>
+concept Serializable = requires(T& value, Archive& ar) { value.serialize(ar); };
+
+template <class T>
+struct is_std_array : std::false_type
+{
+};
+template <class T, size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type
+{
+};
+
+class StateWriter
+{
+public:
+  static constexpr bool loading = false;
+
+  // appends to 'out'
+  explicit StateWriter(std::vector<std::byte>& out)
+      : m_out{out}
+  {
+  }
+
+  template <class... Ts>
+  void operator()(Ts&... values)
+  {
+    (write(values), ...);
+  }
+
+  // see StateReader::check, saving leaves the state as it is
+  bool check(bool) noexcept { return true; }
+
+  template <class T>
+  void buffer(const T* data, size_t size)
+  {
+    buffer(data, size, [](size_t) { return false; });
+  }
+
+  // stores the samples for which 'zeroed(index)' is true as zeros
+  template <class T, class Zeroed>
+  void buffer(const T* data, size_t size, Zeroed&& zeroed)
+  {
+    write_raw(static_cast<uint64_t>(size));
+    write_raw(static_cast<uint32_t>(sizeof(T)));
+
+    auto is_zero_at = [&](size_t i) { return zeroed(i) || is_zero(data[i]); };
+    auto zero_run_end = [&](size_t pos) {
+      while(pos < size && is_zero_at(pos))
+        ++pos;
+      return pos;
+    };
+
+    size_t pos = 0;
+    while(pos < size)
+    {
+      const size_t zeros_end = zero_run_end(pos);
+
+      // short zero runs are cheaper to store as literals,
+      // long ones and trailing zeros start the next run
+      size_t literals_end = zeros_end;
+      while(literals_end < size)
+      {
+        const size_t run_end = zero_run_end(literals_end);
+        const size_t run = run_end - literals_end;
+        if(run >= min_zero_run || (run != 0 && run_end == size))
+          break;
+        literals_end = std::max(run_end, literals_end + 1);
+      }
+
+      write_raw(static_cast<uint32_t>(zeros_end - pos));
+      write_raw(static_cast<uint32_t>(literals_end - zeros_end));
+      for(size_t i = zeros_end; i < literals_end;)
+      {
+        size_t span_end = i + 1;
+        while(span_end < literals_end && zeroed(span_end) == zeroed(i))
+          ++span_end;
+        if(zeroed(i))
+          for(; i < span_end; ++i)
+            write_raw(T{});
+        else
+          write_bytes(data + i, (span_end - i) * sizeof(T));
+        i = span_end;
+      }
+      pos = literals_end;
+    }
+  }
+
+private:
+  static constexpr size_t min_zero_run = 8;
+
+  std::vector<std::byte>& m_out;
+
+  template <class T>
+  void write(T& value)
+  {
+    if constexpr(Serializable<T, StateWriter>)
+      value.serialize(*this);
+    else if constexpr(is_std_array<T>::value && !std::is_trivially_copyable_v<T>)
+      for(auto& element : value)
+        write(element);
+    else
+      write_raw(value);
+  }
+
+  template <class T>
+  void write_raw(const T& value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write_bytes(&value, sizeof(T));
+  }
+
+  void write_bytes(const void* data, size_t size)
+  {
+    const auto* bytes = static_cast<const std::byte*>(data);
+    m_out.insert(m_out.end(), bytes, bytes + size);
+  }
+
+  // compares the representation, so that -0 is kept as a literal
+  template <class T>
+  static bool is_zero(const T& value) noexcept
+  {
+    static constexpr T zero{};
+    return std::memcmp(&value, &zero, sizeof(T)) == 0;
+  }
+
+};
+
+/*
+    Reads what StateWriter wrote
+
+    Reading past the end or into a buffer of a different size or
+    sample size fails, after which nothing else is read.
+*/
+class StateReader
+{
+public:
+  static constexpr bool loading = true;
+
+  StateReader(const std::byte* data, size_t size) noexcept
+      : m_pos{data}
+      , m_end{data + size}
+  {
+  }
+
+  template <class... Ts>
+  void operator()(Ts&... values) noexcept
+  {
+    (read(values), ...);
+  }
+
+  template <class T>
+  void buffer(T* data, size_t size) noexcept
+  {
+    // the sample size differs between storage formats
+    uint64_t stored_size = 0;
+    uint32_t sample_size = 0;
+    read_raw(stored_size);
+    read_raw(sample_size);
+    if(stored_size != size || sample_size != sizeof(T))
+      m_good = false;
+
+    size_t pos = 0;
+    while(m_good && pos < size)
+    {
+      uint32_t zeros = 0;
+      uint32_t literals = 0;
+      read_raw(zeros);
+      read_raw(literals);
+      if(!m_good || zeros + literals == 0 || size - pos < size_t{zeros} + literals)
+      {
+        m_good = false;
+        break;
+      }
+
+      std::fill_n(data + pos, zeros, T{});
+      pos += zeros;
+      read_bytes(data + pos, literals * sizeof(T));
+      pos += literals;
+    }
+  }
+
+  /*
+      Fails reading unless 'valid', for a value that is out of range.
+      Returns 'valid', so that the caller can still put the value back
+      in range for whatever reads it until the state is reset.
+  */
+  bool check(bool valid) noexcept
+  {
+    m_good &= valid;
+    return valid;
+  }
+
+  bool good() const noexcept { return m_good; }
+  bool at_end() const noexcept { return m_pos == m_end; }
+
+private:
+  const std::byte* m_pos;
+  const std::byte* m_end;
+  bool m_good = true;
+
+  template <class T>
+  void read(T& value) noexcept
+  {
+    if constexpr(Serializable<T, StateReader>)
+      value.serialize(*this);
+    else if constexpr(is_std_array<T>::value && !std::is_trivially_copyable_v<T>)
+      for(auto& element : value)
+        read(element);
+    else
+      read_raw(value);
+  }
+
+  template <class T>
+  void read_raw(T& value) noexcept
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    read_bytes(&value, sizeof(T));
+  }
+
+  void read_bytes(void* data, size_t size) noexcept
+  {
+    if(!m_good || static_cast<size_t>(m_end - m_pos) < size)
+    {
+      m_good = false;
+      return;
+    }
+    std::memcpy(data, m_pos, size);
+    m_pos += size;
+  }
+};
+}
+
+#endif
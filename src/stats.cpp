@@ -0,0 +1,193 @@
+#include "stats.hpp"
+
+#include <cstdlib>
+
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AETHER_STATS_SHM 1
+#endif
+
+namespace Aether
+{
+namespace
+{
+#if defined(AETHER_STATS_SHM)
+StatsSegment* map_segment(const char* name, bool writable) noexcept
+{
+  const int fd = shm_open(name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if(fd < 0)
+    return nullptr;
+
+  // a new object is empty, growing it fills it with zeros, which are free records
+  struct stat status;
+  if(fstat(fd, &status) != 0
+     || (static_cast<size_t>(status.st_size) < sizeof(StatsSegment)
+         && (!writable || ftruncate(fd, sizeof(StatsSegment)) != 0)))
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  void* memory = mmap(
+      nullptr, sizeof(StatsSegment), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+      MAP_SHARED, fd, 0);
+  close(fd);
+  if(memory == MAP_FAILED)
+    return nullptr;
+  return static_cast<StatsSegment*>(memory);
+}
+#endif
+}
+
+const char* StatsExport::default_name() noexcept
+{
+  const char* name = std::getenv("AETHER_STATS");
+  return name ? name : "/aether-stats";
+}
+
+StatsExport* StatsExport::instance() noexcept
+{
+#if defined(AETHER_STATS_SHM)
+  static StatsExport* exporter = []() -> StatsExport* {
+    StatsSegment* segment = map_segment(default_name(), true);
+    if(!segment)
+      return nullptr;
+
+    // the first process initializes the header, the others check it
+    uint32_t magic = 0;
+    if(segment->magic.compare_exchange_strong(magic, StatsSegment::magic_value))
+      segment->version = StatsSegment::version_value;
+    else if(
+        magic != StatsSegment::magic_value
+        || segment->version != StatsSegment::version_value)
+      return nullptr;
+
+    static StatsExport instance{segment, static_cast<uint32_t>(getpid())};
+    return &instance;
+  }();
+  return exporter;
+#else
+  return nullptr;
+#endif
+}
+
+uint64_t StatsExport::now() noexcept
+{
+  // CLOCK_MONOTONIC on POSIX, the same in every process
+  const auto time = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+}
+
+StatsRecord* StatsExport::claim() noexcept
+{
+#if defined(AETHER_STATS_SHM)
+  const uint64_t time = now();
+  auto take = [&](StatsRecord& record, bool reclaim) {
+    uint32_t owner = record.owner.load(std::memory_order_relaxed);
+    const bool available
+        = owner == 0
+          || (reclaim && stale(record.heartbeat.load(std::memory_order_relaxed), time));
+    return available
+           && record.owner.compare_exchange_strong(owner, m_pid, std::memory_order_acquire);
+  };
+
+  // the free records first, idle owners keep theirs while there are any
+  for(const bool reclaim : {false, true})
+  {
+    for(StatsRecord& record : m_segment->records)
+    {
+      if(!take(record, reclaim))
+        continue;
+
+      // the previous owner may have ended in the middle of a write
+      const uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+      record.sequence.store(sequence & ~uint32_t{1}, std::memory_order_relaxed);
+
+      record.begin_write();
+      record.instance.store(
+          m_segment->next_instance.fetch_add(1, std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+      record.heartbeat.store(time, std::memory_order_relaxed);
+      for(auto* counter :
+          {&record.blocks, &record.samples, &record.last_block_time,
+           &record.max_block_time, &record.total_time, &record.non_finite_blocks,
+           &record.state_resets, &record.derived_updates, &record.regenerations})
+        counter->store(0, std::memory_order_relaxed);
+      record.asleep.store(0, std::memory_order_relaxed);
+      record.end_write();
+      return &record;
+    }
+  }
+#endif
+  return nullptr;
+}
+
+void StatsExport::release(StatsRecord* record, uint64_t instance) noexcept
+{
+  if(record && record->instance.load(std::memory_order_relaxed) == instance)
+    record->owner.store(0, std::memory_order_release);
+}
+
+const StatsSegment* StatsExport::open_for_reading(const char* name) noexcept
+{
+#if defined(AETHER_STATS_SHM)
+  const StatsSegment* segment = map_segment(name, false);
+  if(!segment)
+    return nullptr;
+  if(segment->magic.load(std::memory_order_acquire) != StatsSegment::magic_value
+     || segment->version != StatsSegment::version_value)
+    return nullptr;
+  return segment;
+#else
+  (void)name;
+  return nullptr;
+#endif
+}
+
+bool StatsExport::read(const StatsRecord& record, StatsSnapshot& snapshot) noexcept
+{
+  // a write takes a few stores, a record that stays odd is being claimed again
+  constexpr uint32_t attempts = 1000;
+  constexpr auto relaxed = std::memory_order_relaxed;
+  for(uint32_t attempt = 0; attempt < attempts; ++attempt)
+  {
+    const uint32_t before = record.sequence.load(std::memory_order_acquire);
+    snapshot.owner = record.owner.load(relaxed);
+    if(snapshot.owner == 0)
+      return false;
+    if(before & 1)
+      continue;
+
+    snapshot.instance = record.instance.load(relaxed);
+    snapshot.heartbeat = record.heartbeat.load(relaxed);
+    snapshot.rate = record.rate.load(relaxed);
+    snapshot.channels = record.channels.load(relaxed);
+    snapshot.blocks = record.blocks.load(relaxed);
+    snapshot.samples = record.samples.load(relaxed);
+    snapshot.last_block_time = record.last_block_time.load(relaxed);
+    snapshot.max_block_time = record.max_block_time.load(relaxed);
+    snapshot.total_time = record.total_time.load(relaxed);
+    snapshot.late_delay_lines = record.late_delay_lines.load(relaxed);
+    snapshot.early_diffusion_stages = record.early_diffusion_stages.load(relaxed);
+    snapshot.late_diffusion_stages = record.late_diffusion_stages.load(relaxed);
+    snapshot.asleep = record.asleep.load(relaxed) != 0;
+    snapshot.non_finite_blocks = record.non_finite_blocks.load(relaxed);
+    snapshot.state_resets = record.state_resets.load(relaxed);
+    snapshot.output_energy_db = record.output_energy_db.load(relaxed);
+    snapshot.tail_energy_db = record.tail_energy_db.load(relaxed);
+    snapshot.derived_updates = record.derived_updates.load(relaxed);
+    snapshot.regenerations = record.regenerations.load(relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(record.sequence.load(relaxed) == before)
+      return true;
+  }
+  return false;
+}
+}
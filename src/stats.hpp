@@ -0,0 +1,184 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace Aether
+{
+/*
+    Statistics of DSP instances in a shared memory segment, for
+    monitoring from other processes
+
+    The segment holds a fixed number of records with a fixed layout.
+    Every instance with the export enabled claims a record and rewrites it
+    once per block, see DSP::set_stats_export, without locks or system
+    calls. The records are versioned like a sequence lock: the sequence
+    is odd while a record is being written, readers retry until they see
+    the same even sequence before and after copying it.
+
+    The segment is a POSIX shared memory object named by the environment
+    variable AETHER_STATS, "/aether-stats" by default, and is created by
+    the first process that opens it.
+
+    The owner stamps its record with the steady clock, the monotonic clock
+    of the system, at the claim and after every block. A record whose
+    stamp is older than StatsSegment::stale_after is taken for one of an
+    ended process, whatever its process id, which may have been reused or
+    be in another namespace. Such records are claimed again once no free
+    record is left. An owner that only went idle for that long notices
+    the new instance id at its next block and stops publishing, until
+    the export is enabled again outside of the processing.
+*/
+struct StatsRecord
+{
+  // odd while the record is being written
+  std::atomic<uint32_t> sequence;
+  // process id of the owner, 0 while the record is free
+  std::atomic<uint32_t> owner;
+  // unique within the segment, to tell instances apart across claims
+  std::atomic<uint64_t> instance;
+  // steady clock time of the claim or the last block in nanoseconds
+  std::atomic<uint64_t> heartbeat;
+
+  std::atomic<float> rate;
+  std::atomic<uint32_t> channels;
+
+  std::atomic<uint64_t> blocks;
+  std::atomic<uint64_t> samples;
+
+  // processing time in nanoseconds
+  std::atomic<uint64_t> last_block_time;
+  std::atomic<uint64_t> max_block_time;
+  std::atomic<uint64_t> total_time;
+
+  std::atomic<uint32_t> late_delay_lines;
+  std::atomic<uint32_t> early_diffusion_stages;
+  std::atomic<uint32_t> late_diffusion_stages;
+  // set once the input has been silent for longer than the tail length,
+  // hosts may skip the processing then
+  std::atomic<uint32_t> asleep;
+
+  // blocks with a non-finite output
+  std::atomic<uint64_t> non_finite_blocks;
+  /*
+      Clears of the state of a stage, when it is processed again after it
+      was skipped for being inaudible and by DSP::clear, one per stage.
+      The processing neither flushes denormals nor resets itself on
+      non-finite values, so these are the only resets of its state.
+  */
+  std::atomic<uint64_t> state_resets;
+  // mean square of the output of the last block in dB
+  std::atomic<float> output_energy_db;
+  // mean square of the feedback of the late delay lines after the last
+  // block in dB, the energy left in the tail
+  std::atomic<float> tail_energy_db;
+
+  // recomputations of derived state, and regenerations of delays and
+  // diffusers after a seed or line count change
+  std::atomic<uint64_t> derived_updates;
+  std::atomic<uint64_t> regenerations;
+
+  // the owner brackets its relaxed stores with these
+  void begin_write() noexcept
+  {
+    const uint32_t current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void end_write() noexcept
+  {
+    const uint32_t current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_release);
+  }
+};
+
+// a consistent copy of a record
+struct StatsSnapshot
+{
+  uint32_t owner;
+  uint64_t instance;
+  uint64_t heartbeat;
+  float rate;
+  uint32_t channels;
+  uint64_t blocks;
+  uint64_t samples;
+  uint64_t last_block_time;
+  uint64_t max_block_time;
+  uint64_t total_time;
+  uint32_t late_delay_lines;
+  uint32_t early_diffusion_stages;
+  uint32_t late_diffusion_stages;
+  bool asleep;
+  uint64_t non_finite_blocks;
+  uint64_t state_resets;
+  float output_energy_db;
+  float tail_energy_db;
+  uint64_t derived_updates;
+  uint64_t regenerations;
+};
+
+struct StatsSegment
+{
+  // "AEST", written once the segment is initialized
+  static constexpr uint32_t magic_value = 0x54534541;
+  // changes with the layout
+  static constexpr uint32_t version_value = 2;
+  static constexpr uint32_t capacity = 1024;
+  // nanoseconds without a heartbeat after which a record is stale
+  static constexpr uint64_t stale_after = 10'000'000'000;
+
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  std::atomic<uint64_t> next_instance;
+
+  alignas(64) StatsRecord records[capacity];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<float>::is_always_lock_free);
+
+class StatsExport
+{
+public:
+  // the segment of this process, null if it cannot be opened
+  static StatsExport* instance() noexcept;
+
+  // a free or else a stale record, or null if there is neither
+  StatsRecord* claim() noexcept;
+  // frees 'record' unless it has been claimed again since 'instance'
+  void release(StatsRecord* record, uint64_t instance) noexcept;
+
+  // the clock of the heartbeats in nanoseconds
+  static uint64_t now() noexcept;
+  static bool stale(uint64_t heartbeat, uint64_t now) noexcept
+  {
+    return now > heartbeat && now - heartbeat > StatsSegment::stale_after;
+  }
+
+  /*
+      Maps the segment 'name' read-only for readers, null if it does not
+      exist or has a different layout. The mapping stays for the lifetime
+      of the process.
+  */
+  static const StatsSegment* open_for_reading(const char* name) noexcept;
+
+  // copies 'record', returns false if it is free or keeps changing
+  static bool read(const StatsRecord& record, StatsSnapshot& snapshot) noexcept;
+
+  static const char* default_name() noexcept;
+
+private:
+  StatsExport(StatsSegment* segment, uint32_t pid) noexcept
+      : m_segment{segment}
+      , m_pid{pid}
+  {
+  }
+
+  StatsSegment* m_segment;
+  // the process id, taken once so that claims make no system call
+  uint32_t m_pid;
+};
+}
+
+#endif
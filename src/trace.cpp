@@ -0,0 +1,174 @@
+#include "trace.hpp"
+
+#include "bit_ops.hpp"
+#include "parameters.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace Aether
+{
+namespace
+{
+// in the order of Derived
+constexpr std::array<const char*, static_cast<size_t>(Derived::count)> derived_names
+    = {"early_low_cut",
+       "early_high_cut",
+       "tap_seed",
+       "tap_delays",
+       "tap_gains",
+       "early_diffusion_seed",
+       "early_diffusion_stages",
+       "early_diffusion_drive",
+       "early_diffusion_delay",
+       "early_diffusion_mod_depth",
+       "early_diffusion_mod_rate",
+       "late_lines",
+       "late_seed",
+       "late_delay",
+       "late_mod_depth",
+       "late_mod_rate",
+       "late_feedback",
+       "late_diffusion_seed",
+       "late_diffusion_stages",
+       "late_diffusion_drive",
+       "late_diffusion_delay",
+       "late_diffusion_mod_depth",
+       "late_diffusion_mod_rate",
+       "late_low_shelf",
+       "late_high_shelf",
+       "late_high_cut"};
+
+// in the order of TraceRecorder::Event
+constexpr std::array<const char*, static_cast<size_t>(TraceRecorder::Event::count)>
+    event_names
+    = {"block",
+       "prepare",
+       "process",
+       "early",
+       "late",
+       "mix",
+       "apply parameters",
+       "update",
+       "regenerate",
+       "derived pickup",
+       "parameter",
+       "lines",
+       "stages",
+       "clear"};
+}
+
+TraceRecorder::TraceRecorder(uint32_t capacity)
+    : m_slots{std::make_unique<Slot[]>(bits::bit_ceil(std::max(capacity, uint32_t{1})))}
+    , m_mask{bits::bit_ceil(std::max(capacity, uint32_t{1})) - uint64_t{1}}
+{
+}
+
+void TraceRecorder::snapshot(std::vector<Record>& records) const
+{
+  constexpr auto relaxed = std::memory_order_relaxed;
+  const uint64_t capacity = m_mask + 1;
+  const uint64_t end = m_write.load(std::memory_order_acquire);
+  const uint64_t start = end > capacity ? end - capacity : 0;
+
+  records.resize(end - start);
+  for(uint64_t i = start; i < end; ++i)
+  {
+    const Slot& slot = m_slots[i & m_mask];
+    const uint64_t data = slot.data.load(relaxed);
+    Record& record = records[i - start];
+    record.time = slot.time.load(relaxed);
+    record.event = static_cast<Event>(data & 0xff);
+    record.phase = static_cast<Phase>(data >> 8 & 0xff);
+    record.argument = static_cast<uint32_t>(data >> 32);
+  }
+
+  // the slots the producer may have reused meanwhile, including the one
+  // it is writing, are left out
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t overwritten = m_write.load(relaxed) + 1;
+  if(overwritten > start + capacity)
+  {
+    const uint64_t stale = std::min(overwritten - capacity - start, end - start);
+    records.erase(records.begin(), records.begin() + static_cast<ptrdiff_t>(stale));
+  }
+}
+
+bool TraceRecorder::write_chrome_trace(
+    std::FILE* file, const std::vector<Record>& records, uint32_t pid)
+{
+  const uint64_t origin = records.empty() ? 0 : records.front().time;
+  std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  const char* separator = "\n";
+  uint32_t depth = 0;
+  for(const Record& record : records)
+  {
+    if(record.event >= Event::count)
+      continue;
+
+    const char* phase = "i";
+    if(record.phase == Phase::begin)
+    {
+      phase = "B";
+      ++depth;
+    }
+    else if(record.phase == Phase::end)
+    {
+      if(depth == 0)
+        continue;
+      phase = "E";
+      --depth;
+    }
+
+    std::fprintf(
+        file, "%s{\"name\":\"%s\",\"cat\":\"aether\",\"ph\":\"%s\",\"ts\":%.3f,"
+              "\"pid\":%u,\"tid\":1",
+        separator, event_name(record.event), phase,
+        static_cast<double>(record.time - origin) * 1e-3, pid);
+    separator = ",\n";
+
+    if(record.phase == Phase::instant)
+      std::fprintf(file, ",\"s\":\"t\"");
+
+    const uint32_t argument = record.argument;
+    switch(record.phase == Phase::end ? Event::count : record.event)
+    {
+      case Event::block:
+        std::fprintf(file, ",\"args\":{\"samples\":%u}", argument);
+        break;
+      case Event::process:
+        std::fprintf(file, ",\"args\":{\"variant\":%u}", argument);
+        break;
+      case Event::update:
+      case Event::regenerate:
+        if(argument < derived_names.size())
+          std::fprintf(file, ",\"args\":{\"derived\":\"%s\"}", derived_names[argument]);
+        break;
+      case Event::parameter:
+        std::fprintf(file, ",\"args\":{\"parameter\":%u}", argument);
+        break;
+      case Event::lines:
+        std::fprintf(file, ",\"args\":{\"lines\":%u}", argument);
+        break;
+      case Event::stages:
+      case Event::clear:
+        std::fprintf(
+            file, ",\"args\":{\"predelay\":%u,\"early\":%u,\"late\":%u}",
+            argument & 1, argument >> 1 & 1, argument >> 2 & 1);
+        break;
+      default:
+        break;
+    }
+    std::fprintf(file, "}");
+  }
+
+  std::fprintf(file, "\n]}\n");
+  return std::ferror(file) == 0;
+}
+
+const char* TraceRecorder::event_name(Event event) noexcept
+{
+  return event < Event::count ? event_names[static_cast<size_t>(event)] : "unknown";
+}
+}
@@ -0,0 +1,172 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace Aether
+{
+/*
+    Timeline of the work of the audio thread, to find out what happened
+    in the blocks that took too long
+
+    The audio thread records timestamped events into a ring allocated up
+    front, without locks or system calls, overwriting the oldest events.
+    Any other thread can take a snapshot of the ring at any time, which
+    write_chrome_trace saves in the Chrome trace event format for
+    chrome://tracing and Perfetto.
+
+    Spans are recorded as a begin and an end event and nest, instants
+    mark a point in time. Events are recorded by a single thread at a
+    time, see DSP::set_trace.
+*/
+class TraceRecorder
+{
+public:
+  enum class Event : uint8_t
+  {
+    // spans
+    // a call of DSP::operator(), the argument is the number of samples
+    block,
+    prepare,
+    // the kernel of the block, the argument is its variant
+    process,
+    // the dry, predelay and early stages, the late stage and the mix of a chunk
+    early,
+    late,
+    mix,
+    apply_parameters,
+    // recomputing derived state, regenerating it after a seed or line
+    // count change, the argument is the Derived quantity
+    update,
+    regenerate,
+
+    // instants
+    // the state recomputed in the background has been taken over
+    derived_pickup,
+    // a modified parameter that affects the derived state, the argument
+    // is its index in Parameters
+    parameter,
+    // the number of late lines changed, the argument is the new number
+    lines,
+    // the processed stages changed, or stages were cleared, the argument
+    // holds the stages, see DSP::select_stages
+    stages,
+    clear,
+
+    count
+  };
+
+  enum class Phase : uint8_t
+  {
+    begin,
+    end,
+    instant
+  };
+
+  struct Record
+  {
+    // steady clock time in nanoseconds
+    uint64_t time;
+    Event event;
+    Phase phase;
+    uint32_t argument;
+  };
+
+  // 'capacity' is rounded up to a power of two
+  explicit TraceRecorder(uint32_t capacity = 1 << 16);
+
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+  // Producer
+
+  void begin(Event event, uint32_t argument = 0) noexcept
+  {
+    record(event, Phase::begin, argument);
+  }
+  void end(Event event) noexcept { record(event, Phase::end, 0); }
+  void instant(Event event, uint32_t argument = 0) noexcept
+  {
+    record(event, Phase::instant, argument);
+  }
+
+  // Consumer
+
+  // replaces 'records' with the events in the ring, oldest first
+  void snapshot(std::vector<Record>& records) const;
+
+  /*
+      Writes 'records' as a JSON trace, with times in microseconds
+      relative to the first record. Ends without a begin, cut off by the
+      ring, are left out. Returns whether writing succeeded.
+  */
+  static bool write_chrome_trace(
+      std::FILE* file, const std::vector<Record>& records, uint32_t pid = 1);
+
+  static const char* event_name(Event event) noexcept;
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> time;
+    // the event, the phase and the argument
+    std::atomic<uint64_t> data;
+  };
+
+  void record(Event event, Phase phase, uint32_t argument) noexcept
+  {
+    const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch());
+    const uint64_t data = uint64_t{static_cast<uint8_t>(event)}
+                        | uint64_t{static_cast<uint8_t>(phase)} << 8
+                        | uint64_t{argument} << 32;
+
+    // the slot of the oldest event is overwritten, which readers
+    // recognize by the write position, see snapshot
+    constexpr auto relaxed = std::memory_order_relaxed;
+    const uint64_t write = m_write.load(relaxed);
+    Slot& slot = m_slots[write & m_mask];
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.time.store(static_cast<uint64_t>(time.count()), relaxed);
+    slot.data.store(data, relaxed);
+    m_write.store(write + 1, std::memory_order_release);
+  }
+
+  std::unique_ptr<Slot[]> m_slots;
+  uint64_t m_mask;
+  // the number of events recorded so far
+  alignas(64) std::atomic<uint64_t> m_write = 0;
+};
+
+// records a span for its lifetime, if 'trace' is not null
+class TraceSpan
+{
+public:
+  TraceSpan(
+      TraceRecorder* trace, TraceRecorder::Event event, uint32_t argument = 0) noexcept
+      : m_trace{trace}
+      , m_event{event}
+  {
+    if(m_trace)
+      m_trace->begin(m_event, argument);
+  }
+  ~TraceSpan()
+  {
+    if(m_trace)
+      m_trace->end(m_event);
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+  TraceRecorder* m_trace;
+  TraceRecorder::Event m_event;
+};
+}
+#endif
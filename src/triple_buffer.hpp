@@ -0,0 +1,67 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace Aether
+{
+/*
+    Wait-free handover of the latest value from a single writer
+    to a single reader
+
+    The writer fills back() and publishes it by swapping it with the
+    middle slot, the reader takes the middle slot by swapping it with
+    its own. Values that are published before the reader gets to them
+    are dropped, so neither side ever waits for the other.
+*/
+template <class T>
+class TripleBuffer
+{
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+public:
+  // every slot is constructed from 'args'
+  template <class... Args>
+  explicit TripleBuffer(const Args&... args)
+      : m_slots{T(args...), T(args...), T(args...)}
+  {
+  }
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Writer
+
+  T& back() noexcept { return m_slots[m_back]; }
+
+  void publish() noexcept
+  {
+    m_back = m_middle.exchange(m_back | fresh, std::memory_order_acq_rel) & ~fresh;
+  }
+
+  // Reader
+
+  // returns null if nothing has been published since the last call
+  const T* acquire() noexcept
+  {
+    if(!(m_middle.load(std::memory_order_relaxed) & fresh))
+      return nullptr;
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~fresh;
+    return &m_slots[m_front];
+  }
+
+private:
+  // set in the middle index while it holds a value the reader has not seen
+  static constexpr uint32_t fresh = 4;
+
+  std::array<T, 3> m_slots;
+
+  alignas(64) uint32_t m_back = 0;
+  alignas(64) std::atomic<uint32_t> m_middle = 1;
+  alignas(64) uint32_t m_front = 2;
+};
+}
+
+#endif
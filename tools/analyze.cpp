@@ -0,0 +1,220 @@
+/*
+    Acoustic analysis of a preset catalog
+
+    Reads parameter sets from a catalog file and prints a table with
+    their reverberation time per octave band and broadband, early decay
+    time, echo density build-up, stereo correlation and peak level, see
+    analysis.hpp. The presets are rendered in parallel on all hardware
+    threads.
+
+    The catalog holds one preset per line, a name without spaces
+    followed by the parameters that differ from the defaults:
+        <name> [<parameter>=<value> ...]
+    with the names of Parameters. Empty lines and lines starting with #
+    are ignored.
+
+    Decay times are in seconds, "-" where the response does not decay
+    far enough, and marked with * where the response was cut at the
+    maximum length before it decayed to the floor.
+
+    usage: analyze <catalog> [rate] [max length in seconds] [threads]
+*/
+#include "analysis.hpp"
+#include "parameters.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Aether;
+
+namespace
+{
+struct Field
+{
+  std::string_view name;
+  float Parameters<float>::*value;
+};
+
+#define AETHER_FIELD(name) \
+  Field { #name, &Parameters<float>::name }
+
+// in the order of Parameters
+const std::array fields = {
+    AETHER_FIELD(mix),
+    AETHER_FIELD(dry_level),
+    AETHER_FIELD(predelay_level),
+    AETHER_FIELD(early_level),
+    AETHER_FIELD(late_level),
+    AETHER_FIELD(interpolate),
+    AETHER_FIELD(width),
+    AETHER_FIELD(predelay),
+    AETHER_FIELD(early_low_cut_enabled),
+    AETHER_FIELD(early_low_cut_cutoff),
+    AETHER_FIELD(early_high_cut_enabled),
+    AETHER_FIELD(early_high_cut_cutoff),
+    AETHER_FIELD(early_taps),
+    AETHER_FIELD(early_tap_length),
+    AETHER_FIELD(early_tap_mix),
+    AETHER_FIELD(early_tap_decay),
+    AETHER_FIELD(early_diffusion_stages),
+    AETHER_FIELD(early_diffusion_delay),
+    AETHER_FIELD(early_diffusion_mod_depth),
+    AETHER_FIELD(early_diffusion_mod_rate),
+    AETHER_FIELD(early_diffusion_feedback),
+    AETHER_FIELD(late_order),
+    AETHER_FIELD(late_delay_lines),
+    AETHER_FIELD(late_delay),
+    AETHER_FIELD(late_delay_mod_depth),
+    AETHER_FIELD(late_delay_mod_rate),
+    AETHER_FIELD(late_delay_line_feedback),
+    AETHER_FIELD(late_diffusion_stages),
+    AETHER_FIELD(late_diffusion_delay),
+    AETHER_FIELD(late_diffusion_mod_depth),
+    AETHER_FIELD(late_diffusion_mod_rate),
+    AETHER_FIELD(late_diffusion_feedback),
+    AETHER_FIELD(late_low_shelf_enabled),
+    AETHER_FIELD(late_low_shelf_cutoff),
+    AETHER_FIELD(late_low_shelf_gain),
+    AETHER_FIELD(late_high_shelf_enabled),
+    AETHER_FIELD(late_high_shelf_cutoff),
+    AETHER_FIELD(late_high_shelf_gain),
+    AETHER_FIELD(late_high_cut_enabled),
+    AETHER_FIELD(late_high_cut_cutoff),
+    AETHER_FIELD(seed_crossmix),
+    AETHER_FIELD(tap_seed),
+    AETHER_FIELD(early_diffusion_seed),
+    AETHER_FIELD(delay_seed),
+    AETHER_FIELD(late_diffusion_seed),
+    AETHER_FIELD(early_diffusion_drive),
+    AETHER_FIELD(late_diffusion_drive),
+};
+#undef AETHER_FIELD
+
+static_assert(fields.size() == Parameters<float>::size());
+
+struct Catalog
+{
+  std::vector<std::string> names;
+  std::vector<Parameters<float>> parameters;
+};
+
+std::optional<Catalog> read_catalog(const char* path)
+{
+  std::ifstream file(path);
+  if(!file)
+  {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return std::nullopt;
+  }
+
+  Catalog catalog;
+  std::string line;
+  for(uint32_t line_number = 1; std::getline(file, line); ++line_number)
+  {
+    std::istringstream tokens(line);
+    std::string name;
+    if(!(tokens >> name) || name.front() == '#')
+      continue;
+
+    Parameters<float> parameters = default_parameters();
+    for(std::string assignment; tokens >> assignment;)
+    {
+      const auto equals = assignment.find('=');
+      const std::string_view key = std::string_view(assignment).substr(0, equals);
+      const auto field = std::find_if(fields.begin(), fields.end(), [&](auto& f) {
+        return f.name == key;
+      });
+      if(equals == std::string::npos || field == fields.end())
+      {
+        std::fprintf(
+            stderr, "%s:%u: expected <parameter>=<value> instead of %s\n", path,
+            line_number, assignment.c_str());
+        return std::nullopt;
+      }
+      parameters.*(field->value) = std::strtof(assignment.c_str() + equals + 1, nullptr);
+    }
+
+    catalog.names.push_back(std::move(name));
+    catalog.parameters.push_back(parameters);
+  }
+  return catalog;
+}
+
+void print_time(float seconds, bool truncated)
+{
+  if(std::isnan(seconds))
+    std::printf(" %7s ", "-");
+  else
+    std::printf(" %7.2f%c", seconds, truncated ? '*' : ' ');
+}
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2)
+  {
+    std::fprintf(stderr, "usage: analyze <catalog> [rate] [max length] [threads]\n");
+    return 1;
+  }
+
+  const auto catalog = read_catalog(argv[1]);
+  if(!catalog)
+    return 1;
+
+  Analysis::Settings settings;
+  if(argc > 2)
+    settings.rate = std::strtof(argv[2], nullptr);
+  if(argc > 3)
+    settings.max_length = std::strtof(argv[3], nullptr);
+  if(argc > 4)
+    settings.threads = static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10));
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto metrics = Analysis::analyze(settings, catalog->parameters);
+  const auto stop = std::chrono::steady_clock::now();
+
+  int name_width = 6;
+  for(const auto& name : catalog->names)
+    name_width = std::max(name_width, static_cast<int>(name.size()));
+
+  std::printf("%-*s", name_width, "preset");
+  for(float frequency : Analysis::octave_bands)
+  {
+    if(frequency < 1000.f)
+      std::printf(" %6.0fHz", frequency);
+    else
+      std::printf(" %5.0fkHz", frequency / 1000.f);
+  }
+  std::printf(
+      " %7s  %7s  %7s  %7s  %8s %8s\n", "RT60", "EDT", "ED 0.5", "mixing", "corr",
+      "peak dB");
+
+  for(size_t i = 0; i < metrics.size(); ++i)
+  {
+    const Analysis::Metrics& m = metrics[i];
+    std::printf("%-*s", name_width, catalog->names[i].c_str());
+    for(float rt60 : m.rt60)
+      print_time(rt60, m.truncated);
+    print_time(m.broadband_rt60, m.truncated);
+    print_time(m.broadband_edt, m.truncated);
+    print_time(m.density_half_time, false);
+    print_time(m.mixing_time, false);
+    std::printf(" %8.3f %8.1f\n", m.correlation, m.peak_db);
+  }
+
+  std::fprintf(
+      stderr, "%zu presets in %.1f s\n", metrics.size(),
+      std::chrono::duration<double>(stop - start).count());
+  return 0;
+}
@@ -0,0 +1,728 @@
+/*
+    Differential test of the DSP against the frozen reference
+
+    Renders impulses, noise bursts, parameter sweeps and a resumed
+    modulation through both engines with the same seed and automation,
+    once for every stage in isolation and once for the full mix. Reports
+    the maximum and rms error relative to the reference peak, and the
+    divergence of the tail energy. Exits with 1 if any maximum error
+    exceeds the tolerance.
+
+    Then checks the other paths through the DSP against a continuous
+    render of a single instance: the segmented offline render, a state
+    restored into another instance, the lanes of DSPBatch, the ends of a
+    crossfade of PresetSwitcher and the background updates. Each check fails if its
+    maximum error exceeds the bound of its claim.
+
+    Built with AETHER_RT_SANITIZER and rt_sanitizer.cpp, every call that
+    is not real-time safe made while processing a block is reported, and
+    the test fails if there was any, see rt_sanitizer.hpp.
+
+    usage: difftest [rate] [channels] [seconds] [tolerance dB]
+*/
+#include "aether_dsp.hpp"
+#include "batch.hpp"
+#include "offline.hpp"
+#include "parameters.hpp"
+#include "preset_switcher.hpp"
+#include "random.hpp"
+#include "reference.hpp"
+#include "rt_sanitizer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace Aether;
+
+namespace
+{
+constexpr uint32_t seed = 1;
+
+struct Settings
+{
+  float rate = 48000.f;
+  uint32_t channels = 2;
+  float seconds = 6.f;
+  float tolerance_db = -100.f;
+};
+
+using Buffers = std::vector<std::vector<float>>;
+
+// changes the parameters before the block starting at 'position'
+using Automation
+    = std::function<void(Parameters<float>&, uint64_t position, float rate)>;
+
+struct Signal
+{
+  std::string_view name;
+  // the input stops after this fraction of the length, the rest is tail
+  float input_fraction;
+  bool impulse;
+  Automation automation;
+  // changes the parameters the engines settle on, may be null
+  void (*initial)(Parameters<float>&) = nullptr;
+};
+
+struct Stage
+{
+  std::string_view name;
+  float dry, predelay, early, late;
+};
+
+struct Errors
+{
+  float max_db;
+  float rms_db;
+  float tail_db;
+};
+
+struct Check
+{
+  // maximum error relative to the peak of the continuous render
+  float max_db;
+  // the error the claim allows, -600 dB for none
+  float bound_db;
+};
+
+using CheckFunction = Check (*)(Settings);
+
+float to_db(double value)
+{
+  return static_cast<float>(20. * std::log10(std::max(value, 1e-30)));
+}
+
+Buffers make_input(const Settings& settings, const Signal& signal, uint64_t length)
+{
+  Buffers input(settings.channels, std::vector<float>(length));
+  const auto end = static_cast<uint64_t>(signal.input_fraction * length);
+  Random::Xorshift64s rng{seed};
+  for(uint64_t i = 0; i < end; ++i)
+  {
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+    {
+      if(signal.impulse)
+        input[ch][i] = i == 0 ? 1.f : 0.f;
+      else
+        input[ch][i] = static_cast<float>(rng() >> 8) * 0x1.0p-23f - 1.f;
+    }
+  }
+  return input;
+}
+
+// a block as the audio thread processes it
+void process_block(DSP& dsp, const float* const* in, float* const* out, uint32_t n)
+{
+  [[maybe_unused]] RealtimeScope realtime;
+  dsp(in, out, n);
+}
+
+// renders in blocks of varying length to exercise the block boundaries
+template <class Process>
+Buffers render(const Settings& settings, const Buffers& input, Process&& process)
+{
+  static constexpr std::array<uint32_t, 6> block_sizes = {256, 1, 64, 1000, 17, 512};
+
+  const uint64_t length = input[0].size();
+  Buffers output(settings.channels, std::vector<float>(length));
+  std::vector<const float*> in(settings.channels);
+  std::vector<float*> out(settings.channels);
+
+  uint64_t pos = 0;
+  for(size_t block = 0; pos < length; ++block)
+  {
+    const auto n = static_cast<uint32_t>(
+        std::min<uint64_t>(block_sizes[block % block_sizes.size()], length - pos));
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+    {
+      in[ch] = input[ch].data() + pos;
+      out[ch] = output[ch].data() + pos;
+    }
+    process(pos, in.data(), out.data(), n);
+    pos += n;
+  }
+  return output;
+}
+
+Errors compare(const Buffers& reference, const Buffers& output, uint64_t tail_start)
+{
+  double peak = 0., sum_sq = 0., tail_reference = 0., tail_output = 0.;
+  float max_error = 0.f;
+  for(size_t ch = 0; ch < reference.size(); ++ch)
+  {
+    for(size_t i = 0; i < reference[ch].size(); ++i)
+    {
+      const float error = std::abs(output[ch][i] - reference[ch][i]);
+      peak = std::max(peak, static_cast<double>(std::abs(reference[ch][i])));
+      max_error = std::max(max_error, error);
+      sum_sq += static_cast<double>(error) * error;
+      if(i >= tail_start)
+      {
+        tail_reference += static_cast<double>(reference[ch][i]) * reference[ch][i];
+        tail_output += static_cast<double>(output[ch][i]) * output[ch][i];
+      }
+    }
+  }
+
+  const auto samples = static_cast<double>(reference.size() * reference[0].size());
+  Errors errors;
+  errors.max_db = to_db(max_error / peak);
+  errors.rms_db = to_db(std::sqrt(sum_sq / samples) / peak);
+  errors.tail_db = 0.f;
+  if(tail_reference > 0. && tail_output > 0.)
+    errors.tail_db = static_cast<float>(10. * std::log10(tail_output / tail_reference));
+  return errors;
+}
+
+Errors run(const Settings& settings, const Signal& signal, const Stage& stage)
+{
+  const auto length = static_cast<uint64_t>(settings.seconds * settings.rate);
+  const Buffers input = make_input(settings, signal, length);
+
+  Parameters<float> initial = default_parameters();
+  initial.dry_level = stage.dry;
+  initial.predelay_level = stage.predelay;
+  initial.early_level = stage.early;
+  initial.late_level = stage.late;
+  if(signal.initial)
+    signal.initial(initial);
+
+  Parameters<float> values = initial;
+  DSP dsp(settings.rate, settings.channels, seed);
+  dsp.connect_parameters(values);
+  dsp.settle_parameters();
+  const Buffers output = render(
+      settings, input,
+      [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+        if(signal.automation)
+          signal.automation(values, pos, settings.rate);
+        process_block(dsp, in, out, n);
+      });
+
+  values = initial;
+  Reference::Reverb reference(settings.rate, settings.channels, seed);
+  reference.settle(values);
+  const Buffers expected = render(
+      settings, input,
+      [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+        if(signal.automation)
+          signal.automation(values, pos, settings.rate);
+        reference.process(values, in, out, n);
+      });
+
+  const auto tail_start = static_cast<uint64_t>(signal.input_fraction * length);
+  return compare(expected, output, tail_start);
+}
+
+// moves every switch and most knobs over the length of the render
+void sweep(Parameters<float>& p, uint64_t position, float rate)
+{
+  const float t = static_cast<float>(position) / rate;
+  const auto step = static_cast<uint32_t>(t * 4.f);
+
+  p.seed_crossmix = 50.f + 50.f * std::sin(t);
+  p.width = 50.f + 50.f * std::cos(2.f * t);
+  p.predelay = 20.f + 10.f * t;
+  p.early_low_cut_enabled = static_cast<float>(step % 2);
+  p.early_low_cut_cutoff = 100.f + 200.f * t;
+  p.early_high_cut_enabled = static_cast<float>(step / 2 % 2);
+  p.early_high_cut_cutoff = 8000.f - 1000.f * t;
+  p.early_taps = static_cast<float>(1 + step * 7 % 50);
+  p.early_diffusion_stages = static_cast<float>(step % 9);
+  p.early_diffusion_mod_depth = step % 3 == 0 ? 0.f : 1.f;
+  p.early_diffusion_drive = step % 5 == 0 ? 3.f : -12.f;
+  p.late_order = static_cast<float>(step / 3 % 2);
+  p.late_delay_lines = static_cast<float>(1 + step * 5 % 12);
+  p.late_delay = 100.f + 50.f * std::sin(0.5f * t);
+  p.late_delay_mod_depth = step % 4 == 0 ? 0.f : 2.f;
+  p.late_diffusion_stages = static_cast<float>(step * 3 % 9);
+  p.late_diffusion_mod_depth = step % 6 == 0 ? 0.f : 0.5f;
+  p.late_diffusion_drive = step % 7 == 0 ? 6.f : -12.f;
+  p.interpolate = static_cast<float>(step / 4 % 2);
+  p.late_low_shelf_enabled = static_cast<float>(step % 2);
+  p.late_high_shelf_enabled = static_cast<float>(step / 2 % 2);
+  p.late_high_cut_enabled = static_cast<float>(step / 3 % 2);
+  p.late_high_cut_cutoff = 6000.f + 1000.f * std::sin(t);
+  p.delay_seed = static_cast<float>(1 + step / 5);
+  p.tap_seed = static_cast<float>(1 + step / 7);
+}
+
+// the modulation starts out at a depth of exactly zero, so the settled
+// blocks skip the LFOs, see LFO::skip, and resumes after two seconds
+void unmodulated(Parameters<float>& p)
+{
+  p.early_diffusion_mod_depth = 0.f;
+  p.late_delay_mod_depth = 0.f;
+  p.late_diffusion_mod_depth = 0.f;
+}
+
+void resume_modulation(Parameters<float>& p, uint64_t position, float rate)
+{
+  if(static_cast<float>(position) < 2.f * rate)
+    return;
+  p.early_diffusion_mod_depth = 1.f;
+  p.late_delay_mod_depth = 2.f;
+  p.late_diffusion_mod_depth = 0.5f;
+}
+
+// noise for the first half, then the tail
+Buffers check_input(const Settings& settings)
+{
+  const auto length = static_cast<uint64_t>(settings.seconds * settings.rate);
+  return make_input(settings, {"check", 0.5f, false, {}}, length);
+}
+
+Buffers render_continuous(
+    const Settings& settings, const Buffers& input, const Parameters<float>& params)
+{
+  DSP dsp(settings.rate, settings.channels, seed);
+  dsp.connect_parameters(params);
+  dsp.settle_parameters();
+  return render(
+      settings, input,
+      [&](uint64_t, const float* const* in, float* const* out, uint32_t n) {
+        process_block(dsp, in, out, n);
+      });
+}
+
+// Offline::render of 16 seconds in eight segments, in place, within the
+// error of its tail threshold, with a decay short enough that the second
+// half of the segments only pre-rolls part of the input before them
+Check segments(Settings settings)
+{
+  settings.seconds = 16.f;
+  const Buffers input = check_input(settings);
+  const uint64_t length = input[0].size();
+
+  Offline::Settings offline;
+  offline.rate = settings.rate;
+  offline.channels = settings.channels;
+  offline.seed = seed;
+  offline.parameters.late_delay_line_feedback = 0.1f;
+  offline.segment_length = (length + 7) / 8;
+  offline.tail_threshold_db = -80.f;
+
+  Buffers output = input;
+  std::vector<const float*> in;
+  std::vector<float*> out;
+  for(uint32_t ch = 0; ch < settings.channels; ++ch)
+  {
+    in.push_back(output[ch].data());
+    out.push_back(output[ch].data());
+  }
+  Offline::render(offline, in.data(), out.data(), length);
+
+  const Buffers expected = render_continuous(settings, input, offline.parameters);
+  return {compare(expected, output, length).max_db, offline.tail_threshold_db};
+}
+
+// DSP::save_state halfway through a sweep, restored into an instance with
+// another seed that continues, sample for sample, while the same state
+// with a NaN parameter fails to restore
+Check restore(Settings settings)
+{
+  const Buffers input = check_input(settings);
+  const uint64_t half = input[0].size() / 2;
+
+  bool restored = false;
+  auto process = [&](bool checkpoint) {
+    Parameters<float> values = default_parameters();
+    auto dsp = std::make_unique<DSP>(settings.rate, settings.channels, seed);
+    dsp->connect_parameters(values);
+    dsp->settle_parameters();
+    return render(
+        settings, input,
+        [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+          sweep(values, pos, settings.rate);
+          if(checkpoint && pos >= half)
+          {
+            std::vector<std::byte> state;
+            dsp->save_state(state);
+            dsp = std::make_unique<DSP>(settings.rate, settings.channels, seed + 1);
+            dsp->connect_parameters(values);
+            restored = dsp->restore_state(state.data(), state.size());
+            checkpoint = false;
+
+            // the parameters follow the header of seven 32 bit fields
+            const float nan = std::nanf("");
+            std::memcpy(state.data() + 7 * sizeof(uint32_t), &nan, sizeof(nan));
+            DSP corrupt(settings.rate, settings.channels, seed);
+            restored &= !corrupt.restore_state(state.data(), state.size());
+          }
+          process_block(*dsp, in, out, n);
+        });
+  };
+
+  const Buffers expected = process(false);
+  const Buffers output = process(true);
+  if(!restored)
+    return {0.f, to_db(0.)};
+  return {compare(expected, output, input[0].size()).max_db, to_db(0.)};
+}
+
+/*
+    DSPBatch against instances processed one by one, sample for sample,
+    with two lanes that share the late kernels, one whose kernels differ
+    and one under the parameter sweep, each with its own input, at the
+    full and at a decimated late rate. The blocks of the render longer
+    than the maximum block of the batch are split like the batch does.
+*/
+Check batch(Settings settings)
+{
+  constexpr uint32_t lanes = 4;
+  constexpr uint32_t max_block = 512;
+  const Buffers input = check_input(settings);
+  const uint64_t length = input[0].size();
+
+  std::array<Buffers, lanes> inputs;
+  for(uint32_t k = 0; k < lanes; ++k)
+  {
+    const float gain = (k % 2 ? -1.f : 1.f) * (1.f - 0.125f * static_cast<float>(k));
+    inputs[k] = input;
+    for(auto& channel : inputs[k])
+      for(float& x : channel)
+        x *= gain;
+  }
+
+  std::array<Parameters<float>, lanes> initial;
+  initial.fill(default_parameters());
+  initial[1].late_delay = 80.f;
+  initial[1].late_diffusion_drive = 6.f;
+  initial[2].late_order = 1.f;
+  constexpr uint32_t swept = 3;
+
+  float max_db = to_db(0.);
+  for(uint32_t decimation : {1u, 2u})
+  {
+    std::array<Parameters<float>, lanes> values = initial;
+    DSPBatch<lanes> dsps(settings.rate, settings.channels, max_block, seed);
+    dsps.set_late_decimation(decimation);
+    for(uint32_t k = 0; k < lanes; ++k)
+    {
+      dsps.lane(k).connect_parameters(values[k]);
+      dsps.lane(k).settle_parameters();
+    }
+
+    // the lanes interleaved, processed in place
+    std::array<Buffers, lanes> outputs;
+    outputs.fill(Buffers(settings.channels, std::vector<float>(length)));
+    std::vector<std::vector<float>> frames(settings.channels);
+    std::vector<float*> buffers(settings.channels);
+    render(
+        settings, input,
+        [&](uint64_t pos, const float* const*, float* const*, uint32_t n) {
+          sweep(values[swept], pos, settings.rate);
+          for(uint32_t ch = 0; ch < settings.channels; ++ch)
+          {
+            frames[ch].resize(size_t{n} * lanes);
+            for(uint32_t i = 0; i < n; ++i)
+              for(uint32_t k = 0; k < lanes; ++k)
+                frames[ch][i * lanes + k] = inputs[k][ch][pos + i];
+            buffers[ch] = frames[ch].data();
+          }
+          dsps(buffers.data(), buffers.data(), n);
+          for(uint32_t ch = 0; ch < settings.channels; ++ch)
+            for(uint32_t i = 0; i < n; ++i)
+              for(uint32_t k = 0; k < lanes; ++k)
+                outputs[k][ch][pos + i] = frames[ch][i * lanes + k];
+        });
+
+    for(uint32_t k = 0; k < lanes; ++k)
+    {
+      Parameters<float> params = initial[k];
+      DSP dsp(settings.rate, settings.channels, seed + k);
+      dsp.set_late_decimation(decimation);
+      dsp.connect_parameters(params);
+      dsp.settle_parameters();
+      const Buffers expected = render(
+          settings, inputs[k],
+          [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+            if(k == swept)
+              sweep(params, pos, settings.rate);
+            std::vector<const float*> part_in(in, in + settings.channels);
+            std::vector<float*> part_out(out, out + settings.channels);
+            for(uint32_t start = 0; start < n; start += max_block)
+            {
+              for(uint32_t ch = 0; ch < settings.channels; ++ch)
+              {
+                part_in[ch] = in[ch] + start;
+                part_out[ch] = out[ch] + start;
+              }
+              process_block(
+                  dsp, part_in.data(), part_out.data(), std::min(max_block, n - start));
+            }
+          });
+      max_db = std::max(max_db, compare(expected, outputs[k], length).max_db);
+    }
+  }
+  return {max_db, to_db(0.)};
+}
+
+/*
+    PresetSwitcher loading other parameters a quarter into the render and
+    the first ones again later, which has to play each instance outside
+    of the crossfades as if it had started from silence with the
+    crossfade to it, sample for sample. A crossfade starts with the first
+    block after the helper thread has prepared the instance, which is
+    found as the first block that differs from the playing instance.
+*/
+Check preset_switch(Settings settings)
+{
+  constexpr uint32_t block = 256;
+  constexpr float fade_time = 0.1f;
+  const Buffers input = check_input(settings);
+  const uint64_t length = input[0].size();
+  const auto fade_length = static_cast<uint64_t>(fade_time * settings.rate);
+
+  const Parameters<float> first = default_parameters();
+  Parameters<float> second = default_parameters();
+  second.predelay = 40.f;
+  second.early_taps = 20.f;
+  second.late_order = 1.f;
+  second.late_delay_lines = 6.f;
+  second.delay_seed = 3.f;
+  const std::array<std::pair<uint64_t, Parameters<float>>, 2> loads = {{
+      {length / 4 / block * block, second},
+      {length * 5 / 8 / block * block, first},
+  }};
+
+  // renders [begin, length) in blocks of 'block'
+  auto render_from = [&](uint64_t begin, auto&& process) {
+    Buffers output(settings.channels, std::vector<float>(length));
+    std::vector<const float*> in(settings.channels);
+    std::vector<float*> out(settings.channels);
+    for(uint64_t pos = begin; pos < length; pos += block)
+    {
+      for(uint32_t ch = 0; ch < settings.channels; ++ch)
+      {
+        in[ch] = input[ch].data() + pos;
+        out[ch] = output[ch].data() + pos;
+      }
+      process(pos, in.data(), out.data(), std::min<uint64_t>(block, length - pos));
+    }
+    return output;
+  };
+  auto render_dsp = [&](Parameters<float> params, uint32_t dsp_seed, uint64_t begin) {
+    DSP dsp(settings.rate, settings.channels, dsp_seed);
+    dsp.connect_parameters(params);
+    dsp.settle_parameters();
+    return render_from(
+        begin, [&](uint64_t, const float* const* in, float* const* out, uint32_t n) {
+          process_block(dsp, in, out, n);
+        });
+  };
+
+  PresetSwitcher switcher(settings.rate, first, settings.channels, seed);
+  bool loaded = true;
+  const Buffers output = render_from(
+      0, [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+        for(const auto& [position, params] : loads)
+        {
+          if(pos == position)
+            loaded &= switcher.load(params, fade_time);
+        }
+        switcher(in, out, n);
+      });
+
+  // the crossfades themselves are not compared, only what is around them
+  Buffers expected = output;
+  Buffers playing = render_dsp(first, seed, 0);
+  uint64_t played = 0;
+  for(size_t k = 0; k < loads.size(); ++k)
+  {
+    uint64_t fade_start = length;
+    for(uint64_t i = loads[k].first; i < length && fade_start == length; ++i)
+    {
+      for(uint32_t ch = 0; ch < settings.channels; ++ch)
+      {
+        if(output[ch][i] != playing[ch][i])
+          fade_start = i / block * block;
+      }
+    }
+    if(!loaded || fade_start + fade_length > length)
+      return {0.f, to_db(0.)};
+
+    for(uint32_t ch = 0; ch < settings.channels; ++ch)
+    {
+      std::copy(
+          playing[ch].begin() + played, playing[ch].begin() + fade_start,
+          expected[ch].begin() + played);
+    }
+    // the instances take turns
+    playing = render_dsp(loads[k].second, seed + (k + 1) % 2, fade_start);
+    played = fade_start + fade_length;
+  }
+  for(uint32_t ch = 0; ch < settings.channels; ++ch)
+  {
+    std::copy(
+        playing[ch].begin() + played, playing[ch].end(), expected[ch].begin() + played);
+  }
+  return {compare(expected, output, length).max_db, to_db(0.)};
+}
+
+/*
+    DSP::set_background_updates with every change handed to the instance
+    one block early and time for the helper thread to recompute the
+    derived state, which the instance then has to take over at the start
+    of the block in which a synchronous instance applies the change,
+    sample for sample. The changes are to unsmoothed parameters, which the
+    synchronous instance applies at the start of the block as well.
+*/
+Check background(Settings settings)
+{
+  const Buffers input = check_input(settings);
+  const uint64_t length = input[0].size();
+
+  // applies the changes up to 'position'
+  auto schedule = [&](Parameters<float>& p, uint64_t position) {
+    p = default_parameters();
+    const uint64_t step = length / 8;
+    if(position >= step)
+    {
+      p.delay_seed = 7.f;
+      p.late_diffusion_seed = 3.f;
+    }
+    if(position >= 2 * step)
+    {
+      p.late_delay_lines = 8.f;
+      p.late_diffusion_stages = 4.f;
+    }
+    if(position >= 3 * step)
+    {
+      p.early_diffusion_drive = 6.f;
+      p.late_diffusion_drive = 3.f;
+      p.late_high_cut_cutoff = 5000.f;
+    }
+    // the lines from before the decrease are silent when they come back
+    if(position >= 4 * step)
+    {
+      p.late_delay_lines = 2.f;
+      p.early_diffusion_seed = 5.f;
+      p.tap_seed = 9.f;
+    }
+    if(position >= 5 * step)
+    {
+      p.late_delay_lines = 10.f;
+      p.early_diffusion_stages = 3.f;
+      p.early_diffusion_mod_rate = 2.f;
+      p.late_delay_mod_rate = 1.f;
+      p.late_diffusion_mod_rate = 1.5f;
+    }
+  };
+
+  Parameters<float> values;
+  schedule(values, 0);
+  DSP dsp(settings.rate, settings.channels, seed);
+  dsp.connect_parameters(values);
+  dsp.settle_parameters();
+  const Buffers expected = render(
+      settings, input,
+      [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+        schedule(values, pos);
+        process_block(dsp, in, out, n);
+      });
+
+  Parameters<float> early_values;
+  schedule(early_values, 0);
+  DSP background(settings.rate, settings.channels, seed);
+  background.connect_parameters(early_values);
+  background.settle_parameters();
+  background.set_background_updates(true);
+  const Buffers output = render(
+      settings, input,
+      [&](uint64_t pos, const float* const* in, float* const* out, uint32_t n) {
+        const Parameters<float> previous = early_values;
+        schedule(early_values, pos + n);
+        process_block(background, in, out, n);
+        if(std::memcmp(&previous, &early_values, sizeof(previous)) != 0)
+          std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      });
+
+  return {compare(expected, output, length).max_db, to_db(0.)};
+}
+}
+
+int main(int argc, char** argv)
+{
+  Settings settings;
+  if(argc > 1)
+    settings.rate = std::strtof(argv[1], nullptr);
+  if(argc > 2)
+    settings.channels = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+  if(argc > 3)
+    settings.seconds = std::strtof(argv[3], nullptr);
+  if(argc > 4)
+    settings.tolerance_db = std::strtof(argv[4], nullptr);
+
+  const std::array<Signal, 4> signals = {{
+      {"impulse", 0.5f, true, {}},
+      {"noise", 0.25f, false, {}},
+      {"sweep", 0.75f, false, sweep},
+      {"resume", 0.75f, false, resume_modulation, unmodulated},
+  }};
+  const std::array<Stage, 4> stages = {{
+      {"predelay", 0, 100, 0, 0},
+      {"early", 0, 0, 100, 0},
+      {"late", 0, 0, 0, 100},
+      {"mix", 80, 20, 10, 20},
+  }};
+
+  std::printf(
+      "%-8s %-8s %10s %10s %10s\n", "signal", "stage", "max dB", "rms dB", "tail dB");
+
+  bool passed = true;
+  for(const auto& signal : signals)
+  {
+    for(const auto& stage : stages)
+    {
+      const Errors errors = run(settings, signal, stage);
+      const bool ok = errors.max_db <= settings.tolerance_db;
+      passed &= ok;
+      std::printf(
+          "%-8.*s %-8.*s %10.1f %10.1f %10.3f%s\n", static_cast<int>(signal.name.size()),
+          signal.name.data(), static_cast<int>(stage.name.size()), stage.name.data(),
+          errors.max_db, errors.rms_db, errors.tail_db, ok ? "" : "  FAILED");
+    }
+  }
+
+  const std::array<std::pair<std::string_view, CheckFunction>, 5> checks = {{
+      {"segments", segments},
+      {"restore", restore},
+      {"batch", batch},
+      {"preset switch", preset_switch},
+      {"background", background},
+  }};
+
+  std::printf("\n%-17s %10s %10s\n", "check", "max dB", "bound dB");
+  for(const auto& [name, function] : checks)
+  {
+    const Check check = function(settings);
+    const bool ok = check.max_db <= check.bound_db;
+    passed &= ok;
+    std::printf(
+        "%-17.*s %10.1f %10.1f%s\n", static_cast<int>(name.size()), name.data(),
+        check.max_db, check.bound_db, ok ? "" : "  FAILED");
+  }
+
+#if defined(AETHER_RT_SANITIZER)
+  const uint64_t violations = RtSanitizer::violations();
+  std::printf(
+      "%llu real-time violations\n", static_cast<unsigned long long>(violations));
+  passed &= violations == 0;
+#endif
+
+  std::printf("%s\n", passed ? "passed" : "failed");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,498 @@
+#include "reference.hpp"
+
+#include "math.hpp"
+#include "random.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace Aether::Reference
+{
+namespace
+{
+constexpr double pi = 3.141592653589793238462643383279502884;
+constexpr float pi_f = static_cast<float>(pi);
+
+/*
+    The ranges, defaults and smoothing times, in tenths of a millisecond,
+    of the parameters as the baseline defined them. Kept apart from
+    parameter_infos, so that changes to the engine do not change the
+    reference.
+*/
+struct Range
+{
+  float min;
+  float max;
+  float dflt;
+  float smoothing = 0.f;
+};
+
+constexpr Parameters<Range> ranges = {
+    .mix = {0, 100, 100, 50},
+
+    .dry_level = {0, 100, 80, 50},
+    .predelay_level = {0, 100, 20, 50},
+    .early_level = {0, 100, 10, 50},
+    .late_level = {0, 100, 20, 50},
+
+    .interpolate = {0, 1, 1},
+
+    .width = {0, 100, 100, 50},
+    .predelay = {0, 400, 20, 5000},
+
+    .early_low_cut_enabled = {0, 1, 0},
+    .early_low_cut_cutoff = {15, 22000, 15},
+    .early_high_cut_enabled = {0, 1, 0},
+    .early_high_cut_cutoff = {15, 22000, 20000},
+    .early_taps = {1, 50, 12},
+    .early_tap_length = {0, 500, 200, 4000},
+    .early_tap_mix = {0, 100, 100, 50},
+    .early_tap_decay = {0, 1, 0.5f, 25},
+    .early_diffusion_stages = {0, 8, 7},
+    .early_diffusion_delay = {10, 100, 20, 5000},
+    .early_diffusion_mod_depth = {0, 3, 0, 1000},
+    .early_diffusion_mod_rate = {0, 5, 1},
+    .early_diffusion_feedback = {0, 1, 0.7f, 500},
+
+    .late_order = {0, 1, 0},
+    .late_delay_lines = {1, 12, 3},
+    .late_delay = {0.05f, 1000, 100, 5000},
+    .late_delay_mod_depth = {0, 50, 0.2f, 1000},
+    .late_delay_mod_rate = {0, 5, 0.2f},
+    .late_delay_line_feedback = {0, 1, 0.7f, 50},
+    .late_diffusion_stages = {0, 8, 7},
+    .late_diffusion_delay = {10, 100, 50, 5000},
+    .late_diffusion_mod_depth = {0, 3, 0.2f, 2000},
+    .late_diffusion_mod_rate = {0, 5, 0.5f},
+    .late_diffusion_feedback = {0, 1, 0.7f, 500},
+    .late_low_shelf_enabled = {0, 1, 0},
+    .late_low_shelf_cutoff = {15, 22000, 100},
+    .late_low_shelf_gain = {-24, 0, -2},
+    .late_high_shelf_enabled = {0, 1, 0},
+    .late_high_shelf_cutoff = {15, 22000, 1500},
+    .late_high_shelf_gain = {-24, 0, -3},
+    .late_high_cut_enabled = {0, 1, 0},
+    .late_high_cut_cutoff = {15, 22000, 20000},
+
+    .seed_crossmix = {0, 100, 80, 5000},
+    .tap_seed = {1, 99999, 1},
+    .early_diffusion_seed = {1, 99999, 1},
+    .delay_seed = {1, 99999, 1},
+    .late_diffusion_seed = {1, 99999, 1},
+
+    .early_diffusion_drive = {-12, 12, -12},
+    .late_diffusion_drive = {-12, 12, -12},
+};
+
+float db_to_gain(float db)
+{
+  return std::pow(10.f, db / 20.f);
+}
+
+// Modulation
+
+Lfo lfo_at(float phase)
+{
+  Lfo lfo;
+  lfo.phase = std::polar(1.0, 2 * pi * static_cast<double>(phase));
+  return lfo;
+}
+
+void set_rate(Lfo& lfo, float rate)
+{
+  lfo.step = std::polar(1.0, 2 * pi * static_cast<double>(rate));
+}
+
+float next(Lfo& lfo)
+{
+  const float depth = static_cast<float>(lfo.phase.imag());
+  lfo.phase *= lfo.step;
+  return depth;
+}
+
+// Filters
+
+template <class T>
+void set_cutoff(Lowpass<T>& filter, T rate, T cutoff)
+{
+  const T w = 2 * static_cast<T>(pi) * cutoff / rate;
+  filter.a = w / (1 + w);
+}
+
+template <class T>
+T lowpass(Lowpass<T>& filter, T x)
+{
+  filter.y = filter.y + filter.a * (x - filter.y);
+  return filter.y;
+}
+
+void set_low_shelf(Biquad& filter, double rate, double cutoff, double gain)
+{
+  const double K = std::tan(pi * cutoff / rate);
+  const double sqrt2 = std::sqrt(2.0);
+  const double a0 = 1 + sqrt2 * K + K * K;
+  const double sqrt2G = std::sqrt(2 * gain);
+  filter.a1 = (-2 + 2 * K * K) / a0;
+  filter.a2 = (1 - sqrt2 * K + K * K) / a0;
+  filter.b0 = (1 + sqrt2G * K + gain * K * K) / a0;
+  filter.b1 = (-2 + 2 * gain * K * K) / a0;
+  filter.b2 = (1 - sqrt2G * K + gain * K * K) / a0;
+}
+
+void set_high_shelf(Biquad& filter, double rate, double cutoff, double gain)
+{
+  const double K = std::tan(pi * cutoff / rate);
+  const double sqrt2 = std::sqrt(2.0);
+  const double sqrt2G = std::sqrt(2 * gain);
+  const double a0 = 1 + sqrt2G * K + gain * K * K;
+  filter.a1 = (-2 + 2 * gain * K * K) / a0;
+  filter.a2 = (1 - sqrt2G * K + gain * K * K) / a0;
+  filter.b0 = gain * (1 + sqrt2 * K + K * K) / a0;
+  filter.b1 = gain * (-2 + 2 * K * K) / a0;
+  filter.b2 = gain * (1 - sqrt2 * K + K * K) / a0;
+}
+
+double biquad(Biquad& filter, double x)
+{
+  const double y = filter.b0 * x + filter.s1;
+  filter.s1 = filter.s2 + filter.b1 * x - filter.a1 * y;
+  filter.s2 = filter.b2 * x - filter.a2 * y;
+  return y;
+}
+
+// Diffusion
+
+template <class T>
+T allpass(
+    Allpass<T>& stage, T x, float feedback, bool interpolate, bool drive_on, float drive)
+{
+  const float delay = stage.delay + stage.mod_depth * next(stage.lfo) - 1.f;
+  const auto floor = static_cast<uint32_t>(delay);
+  const T t = static_cast<T>(delay - static_cast<float>(floor));
+  const T a = stage.buffer.read(floor);
+  const T b = stage.buffer.read(floor + 1);
+  const T delayed = interpolate ? a + t * (b - a) : a;
+
+  T input = x + delayed * static_cast<T>(feedback);
+  if(drive_on)
+  {
+    const T d = static_cast<T>(drive);
+    const T clipped = std::clamp<T>(input * d, -1, 1);
+    input = (clipped - clipped * clipped * clipped / 3) / d;
+  }
+  stage.buffer.push(input);
+  return delayed - input * static_cast<T>(feedback);
+}
+
+template <class T>
+T diffuse(Diffuser<T>& diffuser, T x, float feedback, bool interpolate)
+{
+  diffuser.drive = diffuser.target_drive
+                 - diffuser.drive_smoothing * (diffuser.target_drive - diffuser.drive);
+  const bool drive_on = diffuser.drive > 0.0001f;
+  for(uint32_t i = 0; i < diffuser.active; ++i)
+    x = allpass(diffuser.stages[i], x, feedback, interpolate, drive_on, diffuser.drive);
+  return x;
+}
+
+template <class T>
+void configure(
+    Diffuser<T>& diffuser, uint32_t seed, float crossmix, uint32_t stages, float drive,
+    float delay, float mod_depth, float mod_rate)
+{
+  Random::generate(diffuser.rand, seed, crossmix);
+  diffuser.active = stages;
+  diffuser.target_drive = drive;
+  for(uint32_t i = 0; i < diffuser.stages.size(); ++i)
+  {
+    auto& stage = diffuser.stages[i];
+    stage.delay = delay * std::exp(-2.3f * diffuser.rand[i]);
+    stage.mod_depth = std::min(
+        mod_depth * (0.85f + 0.3f * diffuser.rand[8 + i]), stage.delay - 1.f);
+    set_rate(stage.lfo, mod_rate * (0.85f + 0.3f * diffuser.rand[16 + i]));
+  }
+}
+
+// Late reverberations
+
+double modulated_delay(Line& line, double x)
+{
+  line.buffer.push(x);
+  const float delay = std::max(line.delay + line.mod_depth * next(line.lfo), 0.f);
+  const auto floor = static_cast<uint32_t>(delay);
+  const double t = static_cast<double>(delay - static_cast<float>(floor));
+  const double a = line.buffer.read(floor);
+  const double b = line.buffer.read(floor + 1);
+  return a + t * (b - a);
+}
+
+void clear(Line& line)
+{
+  line.buffer.clear();
+  for(auto& stage : line.diffuser.stages)
+    stage.buffer.clear();
+  line.low_shelf.s1 = line.low_shelf.s2 = 0;
+  line.high_shelf.s1 = line.high_shelf.s2 = 0;
+  line.high_cut.y = 0;
+  line.last_out = 0;
+}
+}
+
+template <class T>
+Allpass<T>::Allpass(float rate, float phase)
+    : buffer{static_cast<size_t>((0.1f + 0.003f) * rate)}
+    , lfo{lfo_at(phase)}
+{
+}
+
+template <class T>
+template <class RNG>
+Diffuser<T>::Diffuser(float rate, RNG& rng)
+    : drive_smoothing{std::exp(-2 * pi_f / (0.0001f * 100 * rate))}
+{
+  std::uniform_real_distribution<float> dist(0.f, 1.f);
+  for(uint32_t i = 0; i < 8; ++i)
+    stages.emplace_back(rate, dist(rng));
+}
+
+template <class RNG>
+Line::Line(float rate, RNG& rng)
+    : buffer{static_cast<size_t>((1.5f + 0.05f) * rate) + 1}
+    , lfo{lfo_at(std::uniform_real_distribution<float>{0.f, 1.f}(rng))}
+    , diffuser{rate, rng}
+{
+}
+
+template <class RNG>
+Channel::Channel(float rate, RNG& rng)
+    : predelay{static_cast<size_t>(0.5f * rate) + 1}
+    , multitap{static_cast<size_t>(0.5f * rate) + 1}
+    , early_diffuser{rate, rng}
+{
+  for(uint32_t i = 0; i < 12; ++i)
+    lines.emplace_back(rate, rng);
+}
+
+Reverb::Reverb(float rate, uint32_t channels, uint32_t seed)
+    : m_rate{rate}
+{
+  Random::Xorshift64s rng{seed};
+  for(uint32_t ch = 0; ch < channels; ++ch)
+    m_channels.emplace_back(rate, rng);
+
+  for(size_t p = 0; p < m_params.size(); ++p)
+  {
+    const float smoothing = ranges[p].smoothing;
+    m_smoothing[p]
+        = smoothing != 0.f ? std::exp(-2 * pi_f / (0.0001f * smoothing * rate)) : 0.f;
+    m_params[p] = m_targets[p] = ranges[p].dflt;
+  }
+  recompute();
+}
+
+void Reverb::set_targets(const Parameters<float>& values)
+{
+  for(size_t p = 0; p < values.size(); ++p)
+    m_targets[p] = std::clamp(values[p], ranges[p].min, ranges[p].max);
+}
+
+void Reverb::settle(const Parameters<float>& values)
+{
+  set_targets(values);
+  m_params = m_targets;
+  recompute();
+
+  for(auto& channel : m_channels)
+  {
+    channel.early_diffuser.drive = channel.early_diffuser.target_drive;
+    channel.gain = channel.gain_target;
+    for(uint32_t line = 0; line < channel.active_lines; ++line)
+      channel.lines[line].diffuser.drive = channel.lines[line].diffuser.target_drive;
+  }
+}
+
+void Reverb::recompute()
+{
+  const Parameters<float>& p = m_params;
+  // milliseconds to samples
+  auto ms = [this](float value) { return m_rate * value / 1000.f; };
+
+  for(uint32_t ch = 0; ch < m_channels.size(); ++ch)
+  {
+    Channel& channel = m_channels[ch];
+
+    // decorrelated in pairs, like left and right
+    const uint32_t pair_offset = (ch / 2) * 0x9E3779B9u;
+    const float crossmix
+        = ch % 2 == 0 ? 1.f - p.seed_crossmix / 200.f : 0.f + p.seed_crossmix / 200.f;
+    auto seed = [&](float value) { return static_cast<uint32_t>(value) + pair_offset; };
+
+    // early reflections
+    set_cutoff(channel.low_cut, m_rate, p.early_low_cut_cutoff);
+    set_cutoff(channel.high_cut, m_rate, p.early_high_cut_cutoff);
+
+    Random::generate(channel.tap_rand, seed(p.tap_seed), crossmix);
+    std::partial_sum(
+        channel.tap_rand.begin(), channel.tap_rand.begin() + 50,
+        channel.tap_delay.begin());
+    for(uint32_t tap = 0; tap < 50; ++tap)
+    {
+      const float gain = std::exp(
+          -4.f * p.early_tap_decay * channel.tap_delay[tap]
+          / (channel.tap_delay.back() + 1.f));
+      channel.tap_gain[tap] = gain * channel.tap_rand[50 + tap];
+    }
+
+    configure(
+        channel.early_diffuser, seed(p.early_diffusion_seed), crossmix,
+        static_cast<uint32_t>(p.early_diffusion_stages),
+        p.early_diffusion_drive == -12 ? 0.f : db_to_gain(p.early_diffusion_drive),
+        ms(p.early_diffusion_delay), ms(p.early_diffusion_mod_depth),
+        p.early_diffusion_mod_rate / m_rate);
+
+    // late reverberations
+    const auto lines = static_cast<uint32_t>(p.late_delay_lines);
+    for(uint32_t line = channel.active_lines; line < lines; ++line)
+      clear(channel.lines[line]);
+    channel.active_lines = lines;
+    channel.gain_target = 0.3f + 0.3f * 12 / static_cast<float>(7 + lines);
+
+    const float delay = ms(p.late_delay);
+    const float mod_depth = ms(p.late_delay_mod_depth);
+    channel.gain_smoothing = std::exp(-2 * pi_f / delay);
+
+    Random::generate(channel.line_rand, seed(p.delay_seed), crossmix);
+    for(uint32_t i = 0; i < channel.lines.size(); ++i)
+    {
+      Line& line = channel.lines[i];
+      const auto& rand = channel.line_rand;
+
+      line.delay = delay * (0.5f + 1.f * rand[i + 24]);
+      line.mod_depth = mod_depth * (0.7f + 0.3f * rand[i]);
+      set_rate(line.lfo, p.late_delay_mod_rate / m_rate * (0.7f + 0.3f * rand[i + 12]));
+      line.feedback = static_cast<double>(
+          std::pow(p.late_delay_line_feedback, line.delay / delay));
+
+      configure(
+          line.diffuser, seed(p.late_diffusion_seed) * (i + 1), crossmix,
+          static_cast<uint32_t>(p.late_diffusion_stages),
+          p.late_diffusion_drive == -12 ? 0.f : db_to_gain(p.late_diffusion_drive),
+          ms(p.late_diffusion_delay), ms(p.late_diffusion_mod_depth),
+          p.late_diffusion_mod_rate / m_rate);
+
+      const double rate = static_cast<double>(m_rate);
+      set_low_shelf(
+          line.low_shelf, rate, static_cast<double>(p.late_low_shelf_cutoff),
+          static_cast<double>(db_to_gain(p.late_low_shelf_gain)));
+      set_high_shelf(
+          line.high_shelf, rate, static_cast<double>(p.late_high_shelf_cutoff),
+          static_cast<double>(db_to_gain(p.late_high_shelf_gain)));
+      set_cutoff(line.high_cut, rate, static_cast<double>(p.late_high_cut_cutoff));
+    }
+  }
+}
+
+void Reverb::process(
+    const Parameters<float>& values, const float* const* inputs, float* const* outputs,
+    uint32_t n_samples)
+{
+  set_targets(values);
+
+  const auto channels = static_cast<uint32_t>(m_channels.size());
+  const Parameters<float>& p = m_params;
+
+  for(uint32_t i = 0; i < n_samples; ++i)
+  {
+    bool changed = false;
+    for(size_t k = 0; k < m_params.size(); ++k)
+    {
+      const float value = m_targets[k] - m_smoothing[k] * (m_targets[k] - m_params[k]);
+      changed |= value != m_params[k];
+      m_params[k] = value;
+    }
+    if(changed)
+      recompute();
+
+    float sum = 0.f;
+    for(uint32_t ch = 0; ch < channels; ++ch)
+      sum += inputs[ch][i];
+
+    for(uint32_t ch = 0; ch < channels; ++ch)
+    {
+      Channel& channel = m_channels[ch];
+      const float dry = inputs[ch][i];
+      float out = p.dry_level / 100.f * dry;
+
+      // predelay
+      const float width = 0.5f - p.width / 200.f;
+      float predelay
+          = dry + width * (2.f / static_cast<float>(channels) * sum - 2.f * dry);
+      const auto delay = static_cast<uint32_t>(p.predelay / 1000.f * m_rate);
+      channel.predelay.push(predelay);
+      predelay = channel.predelay.read(delay);
+      out += p.predelay_level / 100.f * predelay;
+
+      // early reflections
+      float early = predelay;
+      if(p.early_low_cut_enabled > 0.f)
+        early = early - lowpass(channel.low_cut, early);
+      if(p.early_high_cut_enabled > 0.f)
+        early = lowpass(channel.high_cut, early);
+
+      const auto taps = static_cast<uint32_t>(p.early_taps);
+      const float length = p.early_tap_length / 1000.f * m_rate;
+      channel.multitap.push(early);
+      float multitap = 0.f;
+      for(uint32_t tap = 0; tap < taps; ++tap)
+      {
+        const auto delay = static_cast<uint32_t>(
+            channel.tap_delay[tap] * (length / channel.tap_delay[taps - 1]));
+        multitap += channel.tap_gain[tap] * channel.multitap.read(delay);
+      }
+      multitap *= 0.35f + 0.21f * 50 / static_cast<float>(20 + taps);
+      early += p.early_tap_mix / 100.f * (multitap - early);
+
+      early = diffuse(channel.early_diffuser, early, p.early_diffusion_feedback, true);
+      out += p.early_level / 100.f * early;
+
+      // late reverberations
+      double late = 0;
+      for(uint32_t l = 0; l < channel.active_lines; ++l)
+      {
+        Line& line = channel.lines[l];
+        double feedback = line.last_out;
+        if(p.late_low_shelf_enabled > 0)
+          feedback = biquad(line.low_shelf, feedback);
+        if(p.late_high_shelf_enabled > 0)
+          feedback = biquad(line.high_shelf, feedback);
+        if(p.late_high_cut_enabled > 0)
+          feedback = lowpass(line.high_cut, feedback);
+        line.last_out = feedback;
+
+        double x = static_cast<double>(early) + feedback * line.feedback;
+        const bool interpolate = p.interpolate > 0;
+        if(p.late_order == 0)
+        {
+          x = modulated_delay(line, x);
+          line.last_out
+              = diffuse(line.diffuser, x, p.late_diffusion_feedback, interpolate);
+        }
+        else
+        {
+          x = diffuse(line.diffuser, x, p.late_diffusion_feedback, interpolate);
+          line.last_out = modulated_delay(line, x);
+        }
+        late += x;
+      }
+      channel.gain
+          = channel.gain - channel.gain_smoothing * (channel.gain - channel.gain_target);
+      out += p.late_level / 100.f * (channel.gain * static_cast<float>(late));
+
+      outputs[ch][i] = math::lerp(dry, out, p.mix / 100.f);
+    }
+  }
+}
+}
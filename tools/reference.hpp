@@ -0,0 +1,167 @@
+#ifndef REFERENCE_HPP
+#define REFERENCE_HPP
+
+#include "parameters.hpp"
+
+#include <array>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Aether::Reference
+{
+/*
+    A frozen, deliberately simple copy of the processing
+
+    Every stage is computed sample by sample in the most direct way, all
+    derived state is recomputed whenever any parameter changes and the late
+    buffers are stored in double precision. Nothing in here may be optimized
+    or shared with the engine, except the layout of the parameters and the
+    random number generation that defines the seeds. Optimized engines are
+    validated against it with difftest.
+*/
+template <class T>
+struct Buffer
+{
+  explicit Buffer(size_t size)
+      : samples(size)
+  {
+  }
+
+  void push(T sample)
+  {
+    end = (end + 1) % samples.size();
+    samples[end] = sample;
+  }
+
+  // the sample pushed 'delay' samples ago
+  T read(size_t delay) const
+  {
+    return samples[(end + samples.size() - delay) % samples.size()];
+  }
+
+  void clear() { std::fill(samples.begin(), samples.end(), T{}); }
+
+  std::vector<T> samples;
+  size_t end = 0;
+};
+
+struct Lfo
+{
+  std::complex<double> step = 1.0;
+  std::complex<double> phase = 1.0;
+};
+
+template <class T>
+struct Lowpass
+{
+  T a = 0;
+  T y = 0;
+};
+
+// transposed direct form 2
+struct Biquad
+{
+  double a1 = -2, a2 = 1, b0 = 1, b1 = -2, b2 = 1;
+  double s1 = 0, s2 = 0;
+};
+
+template <class T>
+struct Allpass
+{
+  Allpass(float rate, float phase);
+
+  Buffer<T> buffer;
+  float delay = 1.f;
+  float mod_depth = 0.f;
+  Lfo lfo;
+};
+
+template <class T>
+struct Diffuser
+{
+  template <class RNG>
+  Diffuser(float rate, RNG& rng);
+
+  std::vector<Allpass<T>> stages;
+  std::array<float, 24> rand = {};
+  uint32_t active = 0;
+  float drive = 0.f;
+  float target_drive = 0.f;
+  float drive_smoothing;
+};
+
+struct Line
+{
+  template <class RNG>
+  Line(float rate, RNG& rng);
+
+  // modulated delay
+  Buffer<double> buffer;
+  float delay = 0.f;
+  float mod_depth = 0.f;
+  Lfo lfo;
+
+  Diffuser<double> diffuser;
+
+  Biquad low_shelf;
+  Biquad high_shelf;
+  Lowpass<double> high_cut;
+
+  double feedback = 0;
+  double last_out = 0;
+};
+
+struct Channel
+{
+  template <class RNG>
+  Channel(float rate, RNG& rng);
+
+  Buffer<float> predelay;
+
+  Lowpass<float> low_cut;
+  Lowpass<float> high_cut;
+
+  Buffer<float> multitap;
+  std::array<float, 100> tap_rand = {};
+  std::array<float, 50> tap_delay = {};
+  std::array<float, 50> tap_gain = {};
+
+  Diffuser<float> early_diffuser;
+
+  std::vector<Line> lines;
+  std::array<float, 36> line_rand = {};
+  uint32_t active_lines = 0;
+  float gain = 1.f;
+  float gain_target = 1.f;
+  float gain_smoothing = 1.f;
+};
+
+class Reverb
+{
+public:
+  Reverb(float rate, uint32_t channels, uint32_t seed);
+
+  // jumps to 'values' without smoothing, like DSP::settle_parameters
+  void settle(const Parameters<float>& values);
+
+  // 'values' are read once per block, like the ports of the DSP
+  void process(
+      const Parameters<float>& values, const float* const* inputs,
+      float* const* outputs, uint32_t n_samples);
+
+private:
+  float m_rate;
+  std::vector<Channel> m_channels;
+
+  Parameters<float> m_params = {};
+  Parameters<float> m_targets = {};
+  Parameters<float> m_smoothing = {};
+
+  void set_targets(const Parameters<float>& values);
+  void recompute();
+};
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+    Monitor of the statistics that DSP instances export to shared memory
+
+    Prints a table of the live records of the segment, see stats.hpp,
+    one line per instance, followed by the totals. With an interval, the
+    table is printed again every interval, in seconds, until interrupted.
+
+    The load is the processing time relative to the duration of the
+    processed audio, times are in microseconds, the energy is the mean
+    square of the output of the last block in dB and the tail the mean
+    square of the feedback of the late delay lines. Records without a
+    heartbeat for longer than StatsSegment::stale_after are marked stale
+    and left out of the totals.
+
+    usage: stats [segment name] [interval]
+*/
+#include "stats.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <thread>
+
+using namespace Aether;
+
+namespace
+{
+void print(const StatsSegment& segment)
+{
+  std::printf(
+      "%8s %8s %6s %3s %10s %7s %8s %8s %5s %6s %6s %9s %8s %6s %9s %9s %6s %6s\n",
+      "pid", "instance", "rate", "ch", "blocks", "load %", "last us", "max us",
+      "lines", "early", "late", "asleep", "nonfin", "resets", "energy", "tail",
+      "updates", "regen");
+
+  const uint64_t now = StatsExport::now();
+  uint32_t instances = 0;
+  uint32_t asleep = 0;
+  double load = 0.;
+  uint64_t non_finite = 0;
+  for(const StatsRecord& record : segment.records)
+  {
+    StatsSnapshot s;
+    if(!StatsExport::read(record, s))
+      continue;
+    const bool stale = StatsExport::stale(s.heartbeat, now);
+
+    const double audio = s.rate > 0.f ? static_cast<double>(s.samples) / s.rate : 0.;
+    const double instance_load
+        = audio > 0. ? static_cast<double>(s.total_time) * 1e-9 / audio : 0.;
+    std::printf(
+        "%8u %8llu %6.0f %3u %10llu %7.2f %8.1f %8.1f %5u %6u %6u %9s %8llu %6llu "
+        "%9.1f %9.1f %6llu %6llu\n",
+        s.owner, static_cast<unsigned long long>(s.instance), s.rate, s.channels,
+        static_cast<unsigned long long>(s.blocks), 100. * instance_load,
+        static_cast<double>(s.last_block_time) * 1e-3,
+        static_cast<double>(s.max_block_time) * 1e-3, s.late_delay_lines,
+        s.early_diffusion_stages, s.late_diffusion_stages,
+        stale ? "stale" : s.asleep ? "yes" : "no",
+        static_cast<unsigned long long>(s.non_finite_blocks),
+        static_cast<unsigned long long>(s.state_resets), s.output_energy_db,
+        s.tail_energy_db,        static_cast<unsigned long long>(s.derived_updates),
+        static_cast<unsigned long long>(s.regenerations));
+
+    if(stale)
+      continue;
+    ++instances;
+    asleep += s.asleep;
+    load += instance_load;
+    non_finite += s.non_finite_blocks;
+  }
+
+  std::printf(
+      "%u instances, %u asleep, total load %.2f %%, %llu non-finite blocks\n",
+      instances, asleep, 100. * load, static_cast<unsigned long long>(non_finite));
+}
+}
+
+int main(int argc, char** argv)
+{
+  const char* name = argc > 1 ? argv[1] : StatsExport::default_name();
+  const double interval = argc > 2 ? std::strtod(argv[2], nullptr) : 0.;
+
+  const StatsSegment* segment = StatsExport::open_for_reading(name);
+  if(!segment)
+  {
+    std::fprintf(stderr, "cannot open the statistics segment %s\n", name);
+    return 1;
+  }
+
+  for(;;)
+  {
+    print(*segment);
+    if(interval <= 0.)
+      return 0;
+    std::fflush(stdout);
+    std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    std::printf("\n");
+  }
+}
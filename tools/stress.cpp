@@ -0,0 +1,392 @@
+/*
+    Real-time deadline stress test
+
+    Drives the plugin object at the usual host block sizes and sample
+    rates while replaying parameter automation, and reports the
+    distribution of the time spent per block relative to the real-time
+    deadline of that block. Spikes matter more than averages here, a
+    single block over its deadline is an xrun.
+
+    The automation is either built in, sweeping the seed crossmix, the
+    number of late delay lines and the filter cutoffs and changing the
+    seeds, or read from a file with one event per line:
+        <time in seconds> <parameter name> <value>
+    Events are applied at the start of the block containing them, like
+    a host does.
+
+    Built with AETHER_RT_SANITIZER and rt_sanitizer.cpp, every call that
+    is not real-time safe made while processing is reported, and the
+    test fails if there was any, see rt_sanitizer.hpp.
+
+    With the environment variable AETHER_TRACE set to a path prefix, the
+    timeline of the slowest block of every run is saved to
+    <prefix>-<rate>-<block size>.json, to be opened in chrome://tracing
+    or Perfetto, see trace.hpp.
+
+    usage: stress [seconds] [automation file]
+*/
+#include "aether_dsp.hpp"
+#include "parameters.hpp"
+#include "random.hpp"
+#include "rt_sanitizer.hpp"
+#include "trace.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Aether;
+
+namespace
+{
+struct Port
+{
+  std::string_view name;
+  float& (*value)(Object&);
+};
+
+#define AETHER_PORT(name) \
+  Port { #name, [](Object& o) -> float& { return o.inputs.name.value; } }
+
+// in the order of Parameters
+const std::array ports = {
+    AETHER_PORT(mix),
+    AETHER_PORT(dry_level),
+    AETHER_PORT(predelay_level),
+    AETHER_PORT(early_level),
+    AETHER_PORT(late_level),
+    AETHER_PORT(interpolate),
+    AETHER_PORT(width),
+    AETHER_PORT(predelay),
+    AETHER_PORT(early_low_cut_enabled),
+    AETHER_PORT(early_low_cut_cutoff),
+    AETHER_PORT(early_high_cut_enabled),
+    AETHER_PORT(early_high_cut_cutoff),
+    AETHER_PORT(early_taps),
+    AETHER_PORT(early_tap_length),
+    AETHER_PORT(early_tap_mix),
+    AETHER_PORT(early_tap_decay),
+    AETHER_PORT(early_diffusion_stages),
+    AETHER_PORT(early_diffusion_delay),
+    AETHER_PORT(early_diffusion_mod_depth),
+    AETHER_PORT(early_diffusion_mod_rate),
+    AETHER_PORT(early_diffusion_feedback),
+    AETHER_PORT(late_order),
+    AETHER_PORT(late_delay_lines),
+    AETHER_PORT(late_delay),
+    AETHER_PORT(late_delay_mod_depth),
+    AETHER_PORT(late_delay_mod_rate),
+    AETHER_PORT(late_delay_line_feedback),
+    AETHER_PORT(late_diffusion_stages),
+    AETHER_PORT(late_diffusion_delay),
+    AETHER_PORT(late_diffusion_mod_depth),
+    AETHER_PORT(late_diffusion_mod_rate),
+    AETHER_PORT(late_diffusion_feedback),
+    AETHER_PORT(late_low_shelf_enabled),
+    AETHER_PORT(late_low_shelf_cutoff),
+    AETHER_PORT(late_low_shelf_gain),
+    AETHER_PORT(late_high_shelf_enabled),
+    AETHER_PORT(late_high_shelf_cutoff),
+    AETHER_PORT(late_high_shelf_gain),
+    AETHER_PORT(late_high_cut_enabled),
+    AETHER_PORT(late_high_cut_cutoff),
+    AETHER_PORT(seed_crossmix),
+    AETHER_PORT(tap_seed),
+    AETHER_PORT(early_diffusion_seed),
+    AETHER_PORT(delay_seed),
+    AETHER_PORT(late_diffusion_seed),
+    AETHER_PORT(early_diffusion_drive),
+    AETHER_PORT(late_diffusion_drive),
+};
+#undef AETHER_PORT
+
+static_assert(ports.size() == Parameters<float>::size());
+
+std::optional<uint32_t> find_port(std::string_view name)
+{
+  for(uint32_t p = 0; p < ports.size(); ++p)
+    if(ports[p].name == name)
+      return p;
+  return std::nullopt;
+}
+
+struct Event
+{
+  double time;
+  uint32_t port;
+  float value;
+};
+
+using Automation = std::vector<Event>;
+
+std::optional<Automation> read_automation(const char* path)
+{
+  std::ifstream file(path);
+  if(!file)
+  {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    return std::nullopt;
+  }
+
+  Automation automation;
+  std::string line;
+  for(uint32_t line_number = 1; std::getline(file, line); ++line_number)
+  {
+    if(line.empty() || line.front() == '#')
+      continue;
+
+    std::istringstream fields(line);
+    double time;
+    std::string name;
+    float value;
+    if(!(fields >> time >> name >> value))
+    {
+      std::fprintf(
+          stderr, "%s:%u: expected <time> <parameter> <value>\n", path, line_number);
+      return std::nullopt;
+    }
+    const auto port = find_port(name);
+    if(!port)
+    {
+      std::fprintf(
+          stderr, "%s:%u: unknown parameter %s\n", path, line_number, name.c_str());
+      return std::nullopt;
+    }
+    automation.push_back({time, *port, value});
+  }
+
+  std::stable_sort(automation.begin(), automation.end(), [](auto& a, auto& b) {
+    return a.time < b.time;
+  });
+  return automation;
+}
+
+// knobs are moved at 100 Hz, about the rate at which hosts send automation
+Automation default_automation(double seconds)
+{
+  static constexpr double knob_interval = 0.01;
+
+  Automation automation;
+  auto add = [&](double time, std::string_view name, float value) {
+    automation.push_back({time, *find_port(name), value});
+  };
+
+  for(auto name :
+      {"early_low_cut_enabled", "early_high_cut_enabled", "late_low_shelf_enabled",
+       "late_high_shelf_enabled", "late_high_cut_enabled"})
+    add(0., name, 1.f);
+
+  for(double t = 0.; t < seconds; t += knob_interval)
+  {
+    const auto x = static_cast<float>(t);
+    add(t, "seed_crossmix", 50.f + 50.f * std::sin(1.5f * x));
+    add(t, "early_low_cut_cutoff", 15.f * std::pow(20.f, 1.f + std::sin(0.7f * x)));
+    add(t, "early_high_cut_cutoff", 1000.f * std::pow(4.5f, 1.f + std::cos(0.9f * x)));
+    add(t, "late_low_shelf_cutoff", 50.f * std::pow(10.f, 1.f + std::sin(1.1f * x)));
+    add(t, "late_high_shelf_cutoff", 500.f * std::pow(6.f, 1.f + std::cos(1.3f * x)));
+    add(t, "late_high_cut_cutoff", 1000.f * std::pow(4.5f, 1.f + std::sin(0.5f * x)));
+  }
+
+  // up and down through all the delay lines, twice a second
+  for(uint32_t step = 0; step * 0.5 < seconds; ++step)
+  {
+    const uint32_t phase = step % 22;
+    const uint32_t lines = phase < 11 ? phase + 2 : 23 - phase;
+    add(step * 0.5, "late_delay_lines", static_cast<float>(lines));
+  }
+
+  // every seed changes once a second, at different times
+  for(uint32_t second = 0; second < seconds; ++second)
+  {
+    add(second + 0.1, "tap_seed", static_cast<float>(second * 7 + 1));
+    add(second + 0.35, "early_diffusion_seed", static_cast<float>(second * 11 + 1));
+    add(second + 0.6, "delay_seed", static_cast<float>(second * 13 + 1));
+    add(second + 0.85, "late_diffusion_seed", static_cast<float>(second * 17 + 1));
+  }
+
+  std::stable_sort(automation.begin(), automation.end(), [](auto& a, auto& b) {
+    return a.time < b.time;
+  });
+  return automation;
+}
+
+struct Statistics
+{
+  double p50;
+  double p99;
+  double max;
+  uint64_t overruns;
+};
+
+// durations in seconds, relative to 'deadline'
+Statistics statistics(std::vector<double>& durations, double deadline)
+{
+  std::sort(durations.begin(), durations.end());
+  auto percentile = [&](double p) {
+    const auto idx = static_cast<size_t>(p * static_cast<double>(durations.size() - 1));
+    return durations[idx] / deadline;
+  };
+
+  Statistics stats;
+  stats.p50 = percentile(0.5);
+  stats.p99 = percentile(0.99);
+  stats.max = durations.back() / deadline;
+  stats.overruns = static_cast<uint64_t>(
+      durations.end()
+      - std::upper_bound(durations.begin(), durations.end(), deadline));
+  return stats;
+}
+
+// parameters are applied every sample while they are smoothed, which
+// takes tens of events per sample
+constexpr uint32_t trace_capacity = 1 << 17;
+
+bool save_trace(
+    const char* prefix, double rate, uint32_t block_size,
+    const std::vector<TraceRecorder::Record>& records)
+{
+  const std::string path = std::string(prefix) + "-" + std::to_string(std::lround(rate))
+                         + "-" + std::to_string(block_size) + ".json";
+  std::FILE* file = std::fopen(path.c_str(), "w");
+  if(!file)
+  {
+    std::fprintf(stderr, "cannot open %s\n", path.c_str());
+    return false;
+  }
+  const bool written = TraceRecorder::write_chrome_trace(file, records);
+  return std::fclose(file) == 0 && written;
+}
+
+Statistics
+run(double rate, uint32_t block_size, double seconds, const Automation& automation)
+{
+  using clock = std::chrono::steady_clock;
+
+  auto object = std::make_unique<Object>();
+  object->prepare({2, 2, static_cast<int>(block_size), rate});
+
+  const char* trace_prefix = std::getenv("AETHER_TRACE");
+  std::unique_ptr<TraceRecorder> trace;
+  std::vector<TraceRecorder::Record> slowest;
+  double slowest_duration = -1.;
+  if(trace_prefix && *trace_prefix)
+  {
+    trace = std::make_unique<TraceRecorder>(trace_capacity);
+    object->dsp.set_trace(trace.get());
+  }
+
+  std::array<std::vector<float>, 2> input, output;
+  std::array<float*, 2> in, out;
+  for(size_t ch = 0; ch < 2; ++ch)
+  {
+    input[ch].resize(block_size);
+    output[ch].resize(block_size);
+    in[ch] = input[ch].data();
+    out[ch] = output[ch].data();
+  }
+  object->inputs.audio.samples = in.data();
+  object->outputs.audio.samples = out.data();
+
+  const auto blocks
+      = std::max<uint64_t>(1, static_cast<uint64_t>(seconds * rate / block_size));
+  std::vector<double> durations;
+  durations.reserve(blocks);
+
+  Random::Xorshift64s rng{1};
+  auto event = automation.begin();
+  for(uint64_t block = 0; block < blocks; ++block)
+  {
+    const double end_time = static_cast<double>((block + 1) * block_size) / rate;
+    for(; event != automation.end() && event->time < end_time; ++event)
+      ports[event->port].value(*object) = event->value;
+
+    for(auto& channel : input)
+      for(float& sample : channel)
+        sample = static_cast<float>(rng() >> 8) * 0x1.0p-24f - 0.5f;
+
+    const auto start = clock::now();
+    (*object)(block_size);
+    const auto stop = clock::now();
+    const double duration = std::chrono::duration<double>(stop - start).count();
+
+    // outside of the measured time
+    if(trace && duration > slowest_duration)
+    {
+      // the events of this block only
+      trace->snapshot(slowest);
+      const auto begin = std::find_if(slowest.rbegin(), slowest.rend(), [](auto& r) {
+        return r.event == TraceRecorder::Event::block
+               && r.phase == TraceRecorder::Phase::begin;
+      });
+      if(begin != slowest.rend())
+        slowest.erase(slowest.begin(), std::prev(begin.base()));
+      slowest_duration = duration;
+    }
+    durations.push_back(duration);
+  }
+
+  if(trace)
+  {
+    object->dsp.set_trace(nullptr);
+    save_trace(trace_prefix, rate, block_size, slowest);
+  }
+
+  return statistics(durations, block_size / rate);
+}
+}
+
+int main(int argc, char** argv)
+{
+  const double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 10.;
+
+  const auto automation
+      = argc > 2 ? read_automation(argv[2]) : default_automation(seconds);
+  if(!automation)
+    return 1;
+
+  static constexpr std::array rates = {44100., 48000., 88200., 96000., 192000.};
+  static constexpr std::array<uint32_t, 6> block_sizes = {32, 64, 128, 256, 512, 1024};
+
+  std::printf("per block time in percent of the deadline\n");
+  std::printf(
+      "%8s %6s %12s %8s %8s %8s %9s\n", "rate", "block", "deadline us", "p50", "p99",
+      "max", "overruns");
+
+  uint64_t overruns = 0;
+  for(double rate : rates)
+  {
+    for(uint32_t block_size : block_sizes)
+    {
+      const Statistics stats = run(rate, block_size, seconds, *automation);
+      overruns += stats.overruns;
+      std::printf(
+          "%8.0f %6u %12.1f %7.2f%% %7.2f%% %7.2f%% %9llu\n", rate, block_size,
+          1e6 * block_size / rate, 100. * stats.p50, 100. * stats.p99, 100. * stats.max,
+          static_cast<unsigned long long>(stats.overruns));
+    }
+  }
+
+  std::printf(
+      "%llu blocks over their deadline\n", static_cast<unsigned long long>(overruns));
+
+#if defined(AETHER_RT_SANITIZER)
+  const uint64_t violations = RtSanitizer::violations();
+  std::printf(
+      "%llu real-time violations\n", static_cast<unsigned long long>(violations));
+  if(violations > 0)
+    return 1;
+#endif
+  return 0;
+}